@@ -28,17 +28,68 @@
 # OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
-from typing import List
+from typing import List, Optional, Union
+import contextlib
+import json
 import torch
 import FastGeodisCpp
 
+from .decomposition import generalised_geodesic3d_decomposed
+from .disk_cache import GeodesicDiskCache
+from .memory import estimate_memory
+from .calibration import auto_iterations, calibrate_iterations, set_auto_iterations
+
+
+def _smoothing_args(smooth_sigma, smooth_kernel):
+    if smooth_kernel not in ("gaussian", "box"):
+        raise ValueError("smooth_kernel must be 'gaussian' or 'box', received {}".format(smooth_kernel))
+    if smooth_sigma is None:
+        return [], False
+    if isinstance(smooth_sigma, (int, float)):
+        smooth_sigma = [smooth_sigma]
+    return [float(s) for s in smooth_sigma], smooth_kernel == "box"
+
+
+def _stats_dict(stats, num_dims):
+    r"""Statistics of a raster scanning call, collected only when requested.
+
+    Returns:
+        dict with
+            pass_ms: time of every pass in milliseconds, list of iterations with num_dims passes each
+            pass_improved: distance updates in every pass, same layout, a pixel improved by both sweeps of a
+                pass counts twice
+            iteration_ms: time of every iteration in milliseconds, including transposes
+            total_ms: time of the whole call in milliseconds
+            bytes_allocated: bytes of tensors allocated by the engine
+            threads: largest number of threads used by a pass
+    """
+    def per_iteration(values):
+        return [values[i : i + num_dims] for i in range(0, len(values), num_dims)]
+
+    return {
+        "pass_ms": per_iteration(stats["pass_ms"]),
+        "pass_improved": per_iteration([int(x) for x in stats["pass_improved"]]),
+        "iteration_ms": stats["iteration_ms"],
+        "total_ms": stats["total_ms"][0],
+        "bytes_allocated": int(stats["bytes_allocated"][0]),
+        "threads": int(stats["threads"][0]),
+    }
+
 
 def generalised_geodesic2d(
     image: torch.Tensor, 
     softmask: torch.Tensor, 
     v: float, 
     lamb: float, 
-    iter: int = 2
+    iter: Union[int, str] = 2,
+    return_parent: bool = False,
+    clip: Optional[float] = None,
+    normalise: bool = False,
+    decay: Optional[float] = None,
+    approx_factor: int = 1,
+    smooth_sigma: Optional[Union[float, List[float]]] = None,
+    smooth_kernel: str = "gaussian",
+    return_stats: bool = False,
 ):
     r"""Computes Generalised Geodesic Distance using FastGeodis raster scanning.
     For more details on generalised geodesic distance, check the following reference:
@@ -48,17 +99,64 @@ def generalised_geodesic2d(
     European Conference on Computer Vision, Berlin, Heidelberg, 2008.
 
     The function expects input as torch.Tensor, which can be run on CPU or GPU depending on Tensor's device location
+    Output transforms (clip, normalise, decay) are applied as the final pass writes the distance on CPU, and as separate operations on GPU.
+
+    With approx_factor > 1 the distance is computed on a grid downsampled by approx_factor (image averaged,
+    softmask min-pooled so no seed is lost) and bilinearly upsampled. Snapping seeds and queries to the coarse grid
+    bounds the error of the euclidean part by about (1 - lamb) * approx_factor * 2 pixels, while image structures
+    thinner than approx_factor pixels are averaged out of the geodesic part, so its error depends on the image.
+
+    With smooth_sigma the image is smoothed by a separable gaussian (or box) filter before the raster passes,
+    inside the engine on CPU so no smoothed copy has to be created by the caller.
 
     Args:
         image: input image, can be grayscale or multiple channels.
         softmask: softmask in range [0, 1] with seed information.
         v: weighting factor for establishing relationship between unary and spatial distances.
         lamb: weighting factor between 0.0 and 1.0. 0.0 returns euclidean distance, whereas 1.0 returns geodesic distance
-        iter: number of passes of the iterative distance transform method
+        iter: number of passes of the iterative distance transform method, or "auto" for the smallest number
+            within the tolerance of set_auto_iterations, calibrated against the exact distance once per
+            dataset profile without pre-smoothing, see auto_iterations
+        return_parent: additionally return the parent map for geodesic_backtrack (CPU only)
+        clip: clip the distance to [0, clip]
+        normalise: divide the distance by its maximum, after clipping
+        decay: return exp(-distance / decay), after clipping and normalising
+        approx_factor: integer downsampling factor trading accuracy for speed, 1 computes the exact raster result
+        smooth_sigma: gaussian sigma, or box half-width, in pixels for pre-smoothing the image, one value or one per spatial axis
+        smooth_kernel: "gaussian" or "box"
+        return_stats: additionally return a dict with time and improved pixels of every pass, time of every
+            iteration, bytes allocated and threads used (CPU only)
 
     Returns:
-        torch.Tensor with distance transform
+        torch.Tensor with distance transform, or tuple of distance and uint8 parent map if return_parent,
+        or tuple of distance and statistics if return_stats
     """
+    smoothing = _smoothing_args(smooth_sigma, smooth_kernel)
+    if iter == "auto":
+        iter = auto_iterations(image, softmask, v, lamb)
+    if return_stats:
+        if return_parent or approx_factor != 1:
+            raise ValueError("return_stats is not supported with return_parent or approx_factor")
+        distance, stats = FastGeodisCpp.generalised_geodesic2d_stats(
+            image, softmask, v, lamb, 1 - lamb, iter, clip or 0.0, normalise, decay or 0.0, *smoothing
+        )
+        return distance, _stats_dict(stats, 2)
+    if approx_factor != 1:
+        if return_parent:
+            raise ValueError("approx_factor is not supported with return_parent")
+        return FastGeodisCpp.generalised_geodesic2d_approx(
+            image, softmask, v, lamb, 1 - lamb, iter, approx_factor, clip or 0.0, normalise, decay or 0.0, *smoothing
+        )
+    if clip is not None or normalise or decay is not None or smooth_sigma is not None:
+        if return_parent:
+            raise ValueError("output transforms and smoothing are not supported with return_parent")
+        return FastGeodisCpp.generalised_geodesic2d_transformed(
+            image, softmask, v, lamb, 1 - lamb, iter, clip or 0.0, normalise, decay or 0.0, *smoothing
+        )
+    if return_parent:
+        return FastGeodisCpp.generalised_geodesic_parent2d(
+            image, softmask, v, lamb, 1 - lamb, iter
+        )
     return FastGeodisCpp.generalised_geodesic2d(
         image, softmask, v, lamb, 1 - lamb, iter
     )
@@ -70,7 +168,15 @@ def generalised_geodesic3d(
     spacing: List,
     v: float,
     lamb: float,
-    iter: int = 4,
+    iter: Union[int, str] = 4,
+    return_parent: bool = False,
+    clip: Optional[float] = None,
+    normalise: bool = False,
+    decay: Optional[float] = None,
+    approx_factor: int = 1,
+    smooth_sigma: Optional[Union[float, List[float]]] = None,
+    smooth_kernel: str = "gaussian",
+    return_stats: bool = False,
 ):
     r"""Computes Generalised Geodesic Distance using FastGeodis raster scanning.
     For more details on generalised geodesic distance, check the following reference:
@@ -80,6 +186,15 @@ def generalised_geodesic3d(
     European Conference on Computer Vision, Berlin, Heidelberg, 2008.
 
     The function expects input as torch.Tensor, which can be run on CPU or GPU depending on Tensor's device location
+    Output transforms (clip, normalise, decay) are applied as the final pass writes the distance on CPU, and as separate operations on GPU.
+
+    With approx_factor > 1 the distance is computed on a grid downsampled by approx_factor (image averaged,
+    softmask min-pooled so no seed is lost) and trilinearly upsampled. Snapping seeds and queries to the coarse grid
+    bounds the error of the euclidean part by about (1 - lamb) * approx_factor * 3 * max(spacing), while image
+    structures thinner than approx_factor voxels are averaged out of the geodesic part, so its error depends on the image.
+
+    With smooth_sigma the image is smoothed by a separable gaussian (or box) filter before the raster passes,
+    inside the engine on CPU so no smoothed copy has to be created by the caller.
 
     Args:
         image: input image, can be grayscale or multiple channels.
@@ -87,16 +202,242 @@ def generalised_geodesic3d(
         spacing: spacing for 3D data
         v: weighting factor for establishing relationship between unary and spatial distances.
         lamb: weighting factor between 0.0 and 1.0. 0.0 returns euclidean distance, whereas 1.0 returns geodesic distance
-        iter: number of passes of the iterative distance transform method
+        iter: number of passes of the iterative distance transform method, or "auto" for the smallest number
+            within the tolerance of set_auto_iterations, calibrated against the exact distance once per
+            dataset profile without pre-smoothing, see auto_iterations
+        return_parent: additionally return the parent map for geodesic_backtrack (CPU only)
+        clip: clip the distance to [0, clip]
+        normalise: divide the distance by its maximum, after clipping
+        decay: return exp(-distance / decay), after clipping and normalising
+        approx_factor: integer downsampling factor trading accuracy for speed, 1 computes the exact raster result
+        smooth_sigma: gaussian sigma, or box half-width, in spacing units for pre-smoothing the image, one value or one per spatial axis
+        smooth_kernel: "gaussian" or "box"
+        return_stats: additionally return a dict with time and improved pixels of every pass, time of every
+            iteration, bytes allocated and threads used (CPU only)
 
     Returns:
-        torch.Tensor with distance transform
+        torch.Tensor with distance transform, or tuple of distance and uint8 parent map if return_parent,
+        or tuple of distance and statistics if return_stats
     """
+    smoothing = _smoothing_args(smooth_sigma, smooth_kernel)
+    if iter == "auto":
+        iter = auto_iterations(image, softmask, v, lamb, spacing)
+    if return_stats:
+        if return_parent or approx_factor != 1:
+            raise ValueError("return_stats is not supported with return_parent or approx_factor")
+        distance, stats = FastGeodisCpp.generalised_geodesic3d_stats(
+            image, softmask, spacing, v, lamb, 1 - lamb, iter, clip or 0.0, normalise, decay or 0.0, *smoothing
+        )
+        return distance, _stats_dict(stats, 3)
+    if approx_factor != 1:
+        if return_parent:
+            raise ValueError("approx_factor is not supported with return_parent")
+        return FastGeodisCpp.generalised_geodesic3d_approx(
+            image, softmask, spacing, v, lamb, 1 - lamb, iter, approx_factor, clip or 0.0, normalise, decay or 0.0, *smoothing
+        )
+    if clip is not None or normalise or decay is not None or smooth_sigma is not None:
+        if return_parent:
+            raise ValueError("output transforms and smoothing are not supported with return_parent")
+        return FastGeodisCpp.generalised_geodesic3d_transformed(
+            image, softmask, spacing, v, lamb, 1 - lamb, iter, clip or 0.0, normalise, decay or 0.0, *smoothing
+        )
+    if return_parent:
+        return FastGeodisCpp.generalised_geodesic_parent3d(
+            image, softmask, spacing, v, lamb, 1 - lamb, iter
+        )
     return FastGeodisCpp.generalised_geodesic3d(
         image, softmask, spacing, v, lamb, 1 - lamb, iter
     )
 
 
+def _batch_call(batch_func, images, softmasks, *args):
+    # a batch tensor is split into single images and stacked back, lists may hold images of different sizes
+    if isinstance(images, torch.Tensor):
+        distances = batch_func(list(images.split(1)), list(softmasks.split(1)), *args)
+        return torch.cat(distances)
+    return batch_func(list(images), list(softmasks), *args)
+
+
+def generalised_geodesic2d_batch(
+    images: Union[torch.Tensor, List[torch.Tensor]],
+    softmasks: Union[torch.Tensor, List[torch.Tensor]],
+    v: float,
+    lamb: float,
+    iter: int = 2,
+    num_threads: Optional[int] = None,
+    schedule: str = "nested",
+):
+    r"""Computes Generalised Geodesic Distance of a batch of images using FastGeodis raster scanning.
+    On CPU images run concurrently and the threads of each image's raster passes are nested inside,
+    with "nested" scheduling every running image gets an equal share of the threads and the share grows
+    as other images finish. "batch" runs images concurrently with one thread each, "image" runs them one
+    after the other with all threads. CUDA tensors are processed one after the other.
+
+    Args:
+        images: batch tensor of shape (B, C, H, W), or list of (1, C, H, W) tensors of possibly different sizes
+        softmasks: softmasks in range [0, 1] with seed information, batched like images
+        v: weighting factor for establishing relationship between unary and spatial distances.
+        lamb: weighting factor between 0.0 and 1.0. 0.0 returns euclidean distance, whereas 1.0 returns geodesic distance
+        iter: number of passes of the iterative distance transform method
+        num_threads: total number of CPU threads, defaults to the OpenMP maximum
+        schedule: "nested", "batch" or "image"
+
+    Returns:
+        torch.Tensor of shape (B, 1, H, W) for a batch tensor, list of distance transforms for a list
+    """
+    return _batch_call(
+        FastGeodisCpp.generalised_geodesic2d_batch, images, softmasks, v, lamb, 1 - lamb, iter, num_threads or 0, schedule
+    )
+
+
+def generalised_geodesic3d_batch(
+    images: Union[torch.Tensor, List[torch.Tensor]],
+    softmasks: Union[torch.Tensor, List[torch.Tensor]],
+    spacing: List,
+    v: float,
+    lamb: float,
+    iter: int = 4,
+    num_threads: Optional[int] = None,
+    schedule: str = "nested",
+):
+    r"""Computes Generalised Geodesic Distance of a batch of volumes using FastGeodis raster scanning.
+    On CPU volumes run concurrently and the threads of each volume's raster passes are nested inside,
+    with "nested" scheduling every running volume gets an equal share of the threads and the share grows
+    as other volumes finish. "batch" runs volumes concurrently with one thread each, "image" runs them one
+    after the other with all threads. CUDA tensors are processed one after the other.
+
+    Args:
+        images: batch tensor of shape (B, C, D, H, W), or list of (1, C, D, H, W) tensors of possibly different sizes
+        softmasks: softmasks in range [0, 1] with seed information, batched like images
+        spacing: spacing for 3D data, shared by all volumes
+        v: weighting factor for establishing relationship between unary and spatial distances.
+        lamb: weighting factor between 0.0 and 1.0. 0.0 returns euclidean distance, whereas 1.0 returns geodesic distance
+        iter: number of passes of the iterative distance transform method
+        num_threads: total number of CPU threads, defaults to the OpenMP maximum
+        schedule: "nested", "batch" or "image"
+
+    Returns:
+        torch.Tensor of shape (B, 1, D, H, W) for a batch tensor, list of distance transforms for a list
+    """
+    return _batch_call(
+        FastGeodisCpp.generalised_geodesic3d_batch, images, softmasks, spacing, v, lamb, 1 - lamb, iter, num_threads or 0, schedule
+    )
+
+
+def cpu_isa():
+    r"""Instruction set of the CPU raster pass kernels in use.
+    The passes are compiled for several x86 instruction sets and the widest one supported by the host is
+    selected on import, the FASTGEODIS_CPU_ISA environment variable overrides the selection.
+    Builds for other architectures or compilers only have the "generic" kernels.
+
+    Returns:
+        "generic", "sse4.2", "avx2" or "avx512"
+    """
+    return FastGeodisCpp.cpu_isa()
+
+
+def set_cpu_isa(name: str):
+    r"""Selects the instruction set of the CPU raster pass kernels, e.g. to compare kernels in tests.
+    All kernels return identical distances. A kernel the host cannot run is replaced by the widest supported one.
+
+    Args:
+        name: "auto", "generic", "sse4.2", "avx2" or "avx512", "auto" restores the detected kernel
+
+    Returns:
+        name of the kernel selected
+    """
+    return FastGeodisCpp.set_cpu_isa(name)
+
+
+def set_result_cache(max_bytes: int):
+    r"""Enables an in-memory cache of CPU results of generalised_geodesic2d/3d, disabled by default.
+    Entries are keyed on a content hash of image and softmask together with all parameters, and the least
+    recently used entries are evicted once the cached distances exceed max_bytes. The cache also serves the
+    distances computed inside signed_generalised_geodesic, GSF and approx_factor calls. Hashing costs a
+    single read of the inputs, much less than the raster passes. CUDA tensors are not cached.
+
+    Args:
+        max_bytes: memory limit of cached distances in bytes, 0 disables the cache and drops its entries
+
+    Returns:
+        None
+    """
+    FastGeodisCpp.set_result_cache(max_bytes)
+
+
+def result_cache_info():
+    r"""Counters of the result cache.
+
+    Returns:
+        dict with hits, misses, evictions, entries, bytes and max_bytes
+    """
+    return FastGeodisCpp.result_cache_info()
+
+
+def clear_result_cache():
+    r"""Drops all entries of the result cache and resets its counters, the memory limit is kept."""
+    FastGeodisCpp.clear_result_cache()
+
+
+def workspace_memory():
+    r"""Memory of the CPU raster engine workspace, the distance, transposed copies and smoothed images of
+    generalised_geodesic2d/3d and the functions built on them. Bytes are released when the tensors are
+    freed, so returned distances count as current until they are dropped.
+    Compare peak_bytes with estimate_memory after reset_workspace_peak.
+
+    Returns:
+        dict with current_bytes and peak_bytes, the high-water mark since import or the last reset
+    """
+    return FastGeodisCpp.workspace_memory()
+
+
+def reset_workspace_peak():
+    r"""Resets the high-water mark of workspace_memory to the bytes currently in use."""
+    FastGeodisCpp.reset_workspace_peak()
+
+
+def start_trace():
+    r"""Starts recording execution spans of the CPU engines on all threads, discarding any previous spans.
+    Spans cover allocation, pre-smoothing, transposes, every pass and its forward and backward sweep,
+    output transforms, GSF thresholding and batch images. Recording takes a lock per span; while no
+    trace is running each span costs a single atomic load.
+    """
+    FastGeodisCpp.start_trace()
+
+
+def stop_trace(path: Optional[str] = None):
+    r"""Stops recording and returns the spans in the Chrome trace event format, which chrome://tracing
+    and Perfetto load. Timestamps are microseconds since start_trace, threads are numbered in order of
+    their first span.
+
+    Args:
+        path: file to write the trace json to, not written if None
+
+    Returns:
+        dict with traceEvents, one complete ("X") event per span
+    """
+    trace_json = FastGeodisCpp.stop_trace()
+    if path is not None:
+        with open(path, "w") as f:
+            f.write(trace_json)
+    return json.loads(trace_json)
+
+
+@contextlib.contextmanager
+def trace(path: str):
+    r"""Records execution spans of the CPU engines within a with block and writes them to path,
+    see start_trace and stop_trace.
+
+    Args:
+        path: file to write the Chrome trace json to
+    """
+    start_trace()
+    try:
+        yield
+    finally:
+        stop_trace(path)
+
+
 def signed_generalised_geodesic2d(
     image: torch.Tensor, 
     softmask: torch.Tensor, 
@@ -164,7 +505,7 @@ def signed_generalised_geodesic3d(
 def GSF2d(
     image: torch.Tensor,
     softmask: torch.Tensor,
-    theta: float,
+    theta: Union[float, List[float]],
     v: float,
     lamb: float,
     iter: int,
@@ -181,20 +522,24 @@ def GSF2d(
     Args:
         image: input image, can be grayscale or multiple channels.
         softmask: softmask in range [0, 1] with seed information.
+        theta: threshold on the signed distance, or list of thresholds to filter with all of them in one call
         v: weighting factor for establishing relationship between unary and spatial distances.
         lamb: weighting factor between 0.0 and 1.0. 0.0 returns euclidean distance, whereas 1.0 returns geodesic distance
         iter: number of passes of the iterative distance transform method
 
     Returns:
-        torch.Tensor with distance transform
+        torch.Tensor with distance transform, with one channel per theta if theta is a list
     """
+    if isinstance(theta, (list, tuple)):
+        # the signed distance of softmask is computed once and shared by all thetas
+        return FastGeodisCpp.GSF2d_multi(image, softmask, list(theta), v, lamb, iter)
     return FastGeodisCpp.GSF2d(image, softmask, theta, v, lamb, iter)
 
 
 def GSF3d(
     image: torch.Tensor,
     softmask: torch.Tensor,
-    theta: float,
+    theta: Union[float, List[float]],
     spacing: List,
     v: float,
     lamb: float,
@@ -212,12 +557,659 @@ def GSF3d(
     Args:
         image: input image, can be grayscale or multiple channels.
         softmask: softmask in range [0, 1] with seed information.
+        theta: threshold on the signed distance, or list of thresholds to filter with all of them in one call
         spacing: spacing for 3D data
         v: weighting factor for establishing relationship between unary and spatial distances.
         lamb: weighting factor between 0.0 and 1.0. 0.0 returns euclidean distance, whereas 1.0 returns geodesic distance
         iter: number of passes of the iterative distance transform method
 
     Returns:
-        torch.Tensor with distance transform
+        torch.Tensor with distance transform, with one channel per theta if theta is a list
     """
+    if isinstance(theta, (list, tuple)):
+        # the signed distance of softmask is computed once and shared by all thetas
+        return FastGeodisCpp.GSF3d_multi(image, softmask, list(theta), spacing, v, lamb, iter)
     return FastGeodisCpp.GSF3d(image, softmask, theta, spacing, v, lamb, iter)
+
+
+def GeoS2d(
+    image: torch.Tensor,
+    fg_likelihood: torch.Tensor,
+    bg_likelihood: torch.Tensor,
+    theta_d: List[float],
+    theta_e: List[float],
+    v: float,
+    lamb: float,
+    gamma: float,
+    iter: int = 2,
+):
+    r"""Computes two-label Geodesic image segmentation (GeoS) using FastGeodis raster scanning.
+    The likelihood ratio fg / (fg + bg) is filtered with GSF for every pair of dilation theta_d and
+    erosion theta_e, and the segmentation with the lowest energy is returned. The energy sums the
+    negative log likelihood of each label and gamma times a contrast sensitive boundary length.
+    All geodesic distances are computed with shared sweeps, 2 + 2 * (len(theta_d) + len(theta_e)) transforms in total.
+    For more details on GeoS, check the following reference:
+
+    Criminisi, Antonio, Toby Sharp, and Andrew Blake.
+    "Geos: Geodesic image segmentation."
+    European Conference on Computer Vision, Berlin, Heidelberg, 2008.
+
+    Args:
+        image: input image, can be grayscale or multiple channels.
+        fg_likelihood: foreground likelihood of shape (1, 1, H, W)
+        bg_likelihood: background likelihood of shape (1, 1, H, W)
+        theta_d: list of dilation thresholds to search
+        theta_e: list of erosion thresholds to search
+        v: weighting factor for establishing relationship between unary and spatial distances.
+        lamb: weighting factor between 0.0 and 1.0. 0.0 returns euclidean distance, whereas 1.0 returns geodesic distance
+        gamma: weight of the boundary term of the energy
+        iter: number of passes of the iterative distance transform method
+
+    Returns:
+        tuple of torch.Tensor with binary segmentation and torch.Tensor of shape (len(theta_d), len(theta_e)) with energies
+    """
+    return FastGeodisCpp.GeoS2d(
+        image, fg_likelihood, bg_likelihood, list(theta_d), list(theta_e), v, lamb, gamma, iter
+    )
+
+
+def GeoS3d(
+    image: torch.Tensor,
+    fg_likelihood: torch.Tensor,
+    bg_likelihood: torch.Tensor,
+    theta_d: List[float],
+    theta_e: List[float],
+    spacing: List,
+    v: float,
+    lamb: float,
+    gamma: float,
+    iter: int = 4,
+):
+    r"""Computes two-label Geodesic image segmentation (GeoS) using FastGeodis raster scanning.
+    The likelihood ratio fg / (fg + bg) is filtered with GSF for every pair of dilation theta_d and
+    erosion theta_e, and the segmentation with the lowest energy is returned. The energy sums the
+    negative log likelihood of each label and gamma times a contrast sensitive boundary area.
+    All geodesic distances are computed with shared sweeps, 2 + 2 * (len(theta_d) + len(theta_e)) transforms in total.
+    For more details on GeoS, check the following reference:
+
+    Criminisi, Antonio, Toby Sharp, and Andrew Blake.
+    "Geos: Geodesic image segmentation."
+    European Conference on Computer Vision, Berlin, Heidelberg, 2008.
+
+    Args:
+        image: input image, can be grayscale or multiple channels.
+        fg_likelihood: foreground likelihood of shape (1, 1, D, H, W)
+        bg_likelihood: background likelihood of shape (1, 1, D, H, W)
+        theta_d: list of dilation thresholds to search
+        theta_e: list of erosion thresholds to search
+        spacing: spacing for 3D data
+        v: weighting factor for establishing relationship between unary and spatial distances.
+        lamb: weighting factor between 0.0 and 1.0. 0.0 returns euclidean distance, whereas 1.0 returns geodesic distance
+        gamma: weight of the boundary term of the energy
+        iter: number of passes of the iterative distance transform method
+
+    Returns:
+        tuple of torch.Tensor with binary segmentation and torch.Tensor of shape (len(theta_d), len(theta_e)) with energies
+    """
+    return FastGeodisCpp.GeoS3d(
+        image, fg_likelihood, bg_likelihood, list(theta_d), list(theta_e), spacing, v, lamb, gamma, iter
+    )
+
+
+def generalised_geodesic_knn2d(
+    image: torch.Tensor,
+    labels: torch.Tensor,
+    k: int,
+    lamb: float,
+    iter: int = 2,
+):
+    r"""Computes Generalised Geodesic Distance to the k nearest distinct seed labels using FastGeodis raster scanning.
+    Each pixel keeps an ascending list of its k smallest distances, one per seed label, which are
+    propagated together in a single raster scanning schedule instead of one distance transform per label.
+
+    Only CPU tensors are supported.
+
+    Args:
+        image: input image, can be grayscale or multiple channels.
+        labels: seed labels of shape (1, 1, H, W), values >= 0 are seeds of that label, negative values are not seeds.
+        k: number of nearest seed labels kept for each pixel
+        lamb: weighting factor between 0.0 and 1.0. 0.0 returns euclidean distance, whereas 1.0 returns geodesic distance
+        iter: number of passes of the iterative distance transform method
+
+    Returns:
+        tuple of torch.Tensor with ascending distances of shape (1, k, H, W) and their labels (int64) of shape (1, k, H, W),
+        entries without a reachable label have distance inf and label -1
+    """
+    return FastGeodisCpp.generalised_geodesic_knn2d(
+        image, labels, k, lamb, 1 - lamb, iter
+    )
+
+
+def generalised_geodesic_knn3d(
+    image: torch.Tensor,
+    labels: torch.Tensor,
+    k: int,
+    spacing: List,
+    lamb: float,
+    iter: int = 4,
+):
+    r"""Computes Generalised Geodesic Distance to the k nearest distinct seed labels using FastGeodis raster scanning.
+    Each voxel keeps an ascending list of its k smallest distances, one per seed label, which are
+    propagated together in a single raster scanning schedule instead of one distance transform per label.
+
+    Only CPU tensors are supported.
+
+    Args:
+        image: input image, can be grayscale or multiple channels.
+        labels: seed labels of shape (1, 1, D, H, W), values >= 0 are seeds of that label, negative values are not seeds.
+        k: number of nearest seed labels kept for each voxel
+        spacing: spacing for 3D data
+        lamb: weighting factor between 0.0 and 1.0. 0.0 returns euclidean distance, whereas 1.0 returns geodesic distance
+        iter: number of passes of the iterative distance transform method
+
+    Returns:
+        tuple of torch.Tensor with ascending distances of shape (1, k, D, H, W) and their labels (int64) of shape (1, k, D, H, W),
+        entries without a reachable label have distance inf and label -1
+    """
+    return FastGeodisCpp.generalised_geodesic_knn3d(
+        image, labels, k, spacing, lamb, 1 - lamb, iter
+    )
+
+
+def generalised_geodesic_exact2d(
+    image: torch.Tensor,
+    softmask: torch.Tensor,
+    v: float,
+    lamb: float,
+    return_parent: bool = False,
+):
+    r"""Computes exact Generalised Geodesic Distance using Dijkstra's algorithm.
+    The graph and local distances are the same as used by generalised_geodesic2d, so this is the
+    value the raster scanning converges to with enough iterations. Useful as a reference, slower than raster scanning.
+
+    Only CPU tensors are supported.
+
+    Args:
+        image: input image, can be grayscale or multiple channels.
+        softmask: softmask in range [0, 1] with seed information.
+        v: weighting factor for establishing relationship between unary and spatial distances.
+        lamb: weighting factor between 0.0 and 1.0. 0.0 returns euclidean distance, whereas 1.0 returns geodesic distance
+        return_parent: additionally return the parent map for geodesic_backtrack
+
+    Returns:
+        torch.Tensor with distance transform, or tuple of distance and uint8 parent map if return_parent
+    """
+    distance, parent = FastGeodisCpp.generalised_geodesic_exact2d(
+        image, softmask, v, lamb, 1 - lamb
+    )
+    if return_parent:
+        return distance, parent
+    return distance
+
+
+def generalised_geodesic_exact3d(
+    image: torch.Tensor,
+    softmask: torch.Tensor,
+    spacing: List,
+    v: float,
+    lamb: float,
+    return_parent: bool = False,
+):
+    r"""Computes exact Generalised Geodesic Distance using Dijkstra's algorithm.
+    The graph and local distances are the same as used by generalised_geodesic3d, so this is the
+    value the raster scanning converges to with enough iterations. Useful as a reference, slower than raster scanning.
+
+    Only CPU tensors are supported.
+
+    Args:
+        image: input image, can be grayscale or multiple channels.
+        softmask: softmask in range [0, 1] with seed information.
+        spacing: spacing for 3D data
+        v: weighting factor for establishing relationship between unary and spatial distances.
+        lamb: weighting factor between 0.0 and 1.0. 0.0 returns euclidean distance, whereas 1.0 returns geodesic distance
+        return_parent: additionally return the parent map for geodesic_backtrack
+
+    Returns:
+        torch.Tensor with distance transform, or tuple of distance and uint8 parent map if return_parent
+    """
+    distance, parent = FastGeodisCpp.generalised_geodesic_exact3d(
+        image, softmask, spacing, v, lamb, 1 - lamb
+    )
+    if return_parent:
+        return distance, parent
+    return distance
+
+
+def generalised_geodesic_superpixel2d(
+    image: torch.Tensor,
+    softmask: torch.Tensor,
+    v: float,
+    lamb: float,
+    superpixel_size: int = 16,
+    compactness: float = 0.1,
+):
+    r"""Computes approximate Generalised Geodesic Distance over a superpixel graph, for coarse guidance on very large images.
+    SLIC superpixels of about superpixel_size pixels across are connected into a region adjacency graph whose edges
+    are weighted by centroid distance and mean colour difference. Dijkstra's algorithm on this graph gives the
+    distance of every superpixel, pixels take one step from the centroid of their own or an adjacent superpixel.
+    Superpixels holding seeds and their neighbours are then refined at pixel level with the same local distances
+    as generalised_geodesic2d. Noise inside a superpixel is averaged out of the geodesic term.
+
+    Only CPU tensors are supported.
+
+    Args:
+        image: input image, can be grayscale or multiple channels.
+        softmask: softmask in range [0, 1] with seed information.
+        v: weighting factor for establishing relationship between unary and spatial distances.
+        lamb: weighting factor between 0.0 and 1.0. 0.0 returns euclidean distance, whereas 1.0 returns geodesic distance
+        superpixel_size: initial grid step of the superpixels in pixels
+        compactness: weight of spatial against colour distance when forming superpixels, in image intensity units
+
+    Returns:
+        torch.Tensor with distance transform
+    """
+    return FastGeodisCpp.generalised_geodesic_superpixel2d(
+        image, softmask, v, lamb, 1 - lamb, superpixel_size, compactness
+    )
+
+
+def generalised_geodesic_superpixel3d(
+    image: torch.Tensor,
+    softmask: torch.Tensor,
+    spacing: List,
+    v: float,
+    lamb: float,
+    superpixel_size: int = 8,
+    compactness: float = 0.1,
+):
+    r"""Computes approximate Generalised Geodesic Distance over a supervoxel graph, for coarse guidance on very large volumes.
+    SLIC supervoxels of about superpixel_size voxels across are connected into a region adjacency graph whose edges
+    are weighted by centroid distance and mean colour difference. Dijkstra's algorithm on this graph gives the
+    distance of every supervoxel, voxels take one step from the centroid of their own or an adjacent supervoxel.
+    Supervoxels holding seeds and their neighbours are then refined at voxel level with the same local distances
+    as generalised_geodesic3d. Noise inside a supervoxel is averaged out of the geodesic term.
+
+    Only CPU tensors are supported.
+
+    Args:
+        image: input image, can be grayscale or multiple channels.
+        softmask: softmask in range [0, 1] with seed information.
+        spacing: spacing for 3D data
+        v: weighting factor for establishing relationship between unary and spatial distances.
+        lamb: weighting factor between 0.0 and 1.0. 0.0 returns euclidean distance, whereas 1.0 returns geodesic distance
+        superpixel_size: initial grid step of the supervoxels in voxels
+        compactness: weight of spatial against colour distance when forming supervoxels, in image intensity units
+
+    Returns:
+        torch.Tensor with distance transform
+    """
+    return FastGeodisCpp.generalised_geodesic_superpixel3d(
+        image, softmask, spacing, v, lamb, 1 - lamb, superpixel_size, compactness
+    )
+
+
+def simulate_click_guidance2d(
+    image: torch.Tensor,
+    labels: torch.Tensor,
+    fg_clicks: int,
+    bg_clicks: int,
+    v: float,
+    lamb: float,
+    iter: int = 2,
+    seed: int = 0,
+):
+    r"""Simulates clicks from labels and computes their geodesic guidance maps, as used for training
+    interactive segmentation models such as DeepIGeoS. For each sample, fg_clicks distinct voxels are drawn
+    from labels > 0 and bg_clicks from labels == 0, and the distances to both click sets are computed
+    in the same sweeps. Samples are processed in parallel, each with its own random generator seeded with seed + index.
+
+    Only CPU tensors are supported.
+
+    Args:
+        image: input images of shape (B, C, H, W)
+        labels: labels of shape (B, 1, H, W), voxels > 0 are foreground
+        fg_clicks: number of foreground clicks per sample
+        bg_clicks: number of background clicks per sample
+        v: weighting factor for establishing relationship between unary and spatial distances.
+        lamb: weighting factor between 0.0 and 1.0. 0.0 returns euclidean distance, whereas 1.0 returns geodesic distance
+        iter: number of passes of the iterative distance transform method
+        seed: seed of the random click sampling
+
+    Returns:
+        tuple of torch.Tensor of shape (B, 2, H, W) with foreground and background guidance maps, and int64
+        torch.Tensor of shape (B, fg_clicks + bg_clicks, 2) with click coordinates, foreground first and -1 for
+        clicks that did not fit in their region
+    """
+    return FastGeodisCpp.simulate_click_guidance2d(
+        image, labels, fg_clicks, bg_clicks, v, lamb, 1 - lamb, iter, seed
+    )
+
+
+def simulate_click_guidance3d(
+    image: torch.Tensor,
+    labels: torch.Tensor,
+    fg_clicks: int,
+    bg_clicks: int,
+    spacing: List,
+    v: float,
+    lamb: float,
+    iter: int = 4,
+    seed: int = 0,
+):
+    r"""Simulates clicks from labels and computes their geodesic guidance maps, as used for training
+    interactive segmentation models such as DeepIGeoS. For each sample, fg_clicks distinct voxels are drawn
+    from labels > 0 and bg_clicks from labels == 0, and the distances to both click sets are computed
+    in the same sweeps. Samples are processed in parallel, each with its own random generator seeded with seed + index.
+
+    Only CPU tensors are supported.
+
+    Args:
+        image: input images of shape (B, C, D, H, W)
+        labels: labels of shape (B, 1, D, H, W), voxels > 0 are foreground
+        fg_clicks: number of foreground clicks per sample
+        bg_clicks: number of background clicks per sample
+        spacing: spacing for 3D data
+        v: weighting factor for establishing relationship between unary and spatial distances.
+        lamb: weighting factor between 0.0 and 1.0. 0.0 returns euclidean distance, whereas 1.0 returns geodesic distance
+        iter: number of passes of the iterative distance transform method
+        seed: seed of the random click sampling
+
+    Returns:
+        tuple of torch.Tensor of shape (B, 2, D, H, W) with foreground and background guidance maps, and int64
+        torch.Tensor of shape (B, fg_clicks + bg_clicks, 3) with click coordinates, foreground first and -1 for
+        clicks that did not fit in their region
+    """
+    return FastGeodisCpp.simulate_click_guidance3d(
+        image, labels, fg_clicks, bg_clicks, spacing, v, lamb, 1 - lamb, iter, seed
+    )
+
+
+def geodesic_backtrack(parent: torch.Tensor, points: torch.Tensor):
+    r"""Extracts shortest paths from points to their seed by following a parent map.
+    Parent maps are returned by generalised_geodesic2d/3d and generalised_geodesic_exact2d/3d with return_parent=True.
+    Each entry is the code of the neighbour that provided the minimum distance, (dh + 1) * 3 + (dw + 1) in 2D
+    and (dz + 1) * 9 + (dh + 1) * 3 + (dw + 1) in 3D, the code of offset zero marks seeds.
+
+    Only CPU tensors are supported.
+
+    Args:
+        parent: uint8 parent map of shape (1, 1, H, W) or (1, 1, D, H, W)
+        points: int64 tensor of shape (N, 2) or (N, 3) with spatial coordinates of the path start points
+
+    Returns:
+        list of N int64 torch.Tensor of shape (L, 2) or (L, 3) with coordinates from the point to its seed
+    """
+    return FastGeodisCpp.geodesic_backtrack(parent, points)
+
+
+def geodesic_query2d(
+    image: torch.Tensor,
+    softmask: torch.Tensor,
+    points: torch.Tensor,
+    v: float,
+    lamb: float,
+    return_path: bool = False,
+):
+    r"""Computes Generalised Geodesic Distance at a few query points using A* search.
+    The search runs from each point towards the seeds, guided by the euclidean distance to the seeds
+    weighted by (1 - lamb), so only a fraction of the image is visited when the seeds are close.
+    Distances match generalised_geodesic_exact2d at the query points.
+
+    Only CPU tensors are supported.
+
+    Args:
+        image: input image, can be grayscale or multiple channels.
+        softmask: softmask in range [0, 1] with seed information.
+        points: int64 tensor of shape (N, 2) with spatial coordinates of the query points
+        v: weighting factor for establishing relationship between unary and spatial distances.
+        lamb: weighting factor between 0.0 and 1.0. 0.0 returns euclidean distance, whereas 1.0 returns geodesic distance
+        return_path: additionally return the shortest path from each point to its seed
+
+    Returns:
+        torch.Tensor of shape (N,) with distances, or tuple of distances and list of N int64 torch.Tensor
+        of shape (L, 2) with coordinates from the point to its seed if return_path
+    """
+    distance, _, paths = FastGeodisCpp.geodesic_query2d(
+        image, softmask, points, v, lamb, 1 - lamb, return_path
+    )
+    if return_path:
+        return distance, paths
+    return distance
+
+
+def geodesic_query3d(
+    image: torch.Tensor,
+    softmask: torch.Tensor,
+    points: torch.Tensor,
+    spacing: List,
+    v: float,
+    lamb: float,
+    return_path: bool = False,
+):
+    r"""Computes Generalised Geodesic Distance at a few query points using A* search.
+    The search runs from each point towards the seeds, guided by the euclidean distance to the seeds
+    weighted by (1 - lamb), so only a fraction of the volume is visited when the seeds are close.
+    Distances match generalised_geodesic_exact3d at the query points.
+
+    Only CPU tensors are supported.
+
+    Args:
+        image: input image, can be grayscale or multiple channels.
+        softmask: softmask in range [0, 1] with seed information.
+        points: int64 tensor of shape (N, 3) with spatial coordinates of the query points
+        spacing: spacing for 3D data
+        v: weighting factor for establishing relationship between unary and spatial distances.
+        lamb: weighting factor between 0.0 and 1.0. 0.0 returns euclidean distance, whereas 1.0 returns geodesic distance
+        return_path: additionally return the shortest path from each point to its seed
+
+    Returns:
+        torch.Tensor of shape (N,) with distances, or tuple of distances and list of N int64 torch.Tensor
+        of shape (L, 3) with coordinates from the point to its seed if return_path
+    """
+    distance, _, paths = FastGeodisCpp.geodesic_query3d(
+        image, softmask, points, spacing, v, lamb, 1 - lamb, return_path
+    )
+    if return_path:
+        return distance, paths
+    return distance
+
+
+class GeneralisedGeodesicFunction(torch.autograd.Function):
+    r"""Autograd Function for Generalised Geodesic Distance using FastGeodis raster scanning.
+    The forward pass records the neighbour providing the minimum distance of each pixel. The backward pass
+    propagates gradients along these parents in one sweep from the leaves to the seeds, giving gradients
+    with respect to image, softmask and lamb. Gradients are exact for the recorded paths, enough iterations
+    should be used so that the raster scanning has converged.
+
+    Only CPU tensors are supported.
+    """
+
+    @staticmethod
+    def forward(ctx, image, softmask, lamb, spacing, v, iter):
+        lamb_value = float(lamb)
+        if len(spacing) == 2:
+            distance, parent = FastGeodisCpp.generalised_geodesic_parent2d(
+                image, softmask, v, lamb_value, 1 - lamb_value, iter
+            )
+        else:
+            distance, parent = FastGeodisCpp.generalised_geodesic_parent3d(
+                image, softmask, spacing, v, lamb_value, 1 - lamb_value, iter
+            )
+        ctx.save_for_backward(image, parent)
+        ctx.spacing = spacing
+        ctx.v = v
+        ctx.lamb = lamb_value
+        ctx.lamb_shape = lamb.shape if torch.is_tensor(lamb) else None
+        return distance
+
+    @staticmethod
+    def backward(ctx, grad_distance):
+        image, parent = ctx.saved_tensors
+        grad_image, grad_mask, grad_l_grad, grad_l_eucl = FastGeodisCpp.generalised_geodesic_backward(
+            image, parent, grad_distance.contiguous(), ctx.spacing, ctx.v, ctx.lamb, 1 - ctx.lamb
+        )
+
+        # l_grad = lamb and l_eucl = 1 - lamb
+        grad_lamb = None
+        if ctx.lamb_shape is not None and ctx.needs_input_grad[2]:
+            grad_lamb = (grad_l_grad - grad_l_eucl).reshape(ctx.lamb_shape)
+        return (
+            grad_image if ctx.needs_input_grad[0] else None,
+            grad_mask if ctx.needs_input_grad[1] else None,
+            grad_lamb,
+            None,
+            None,
+            None,
+        )
+
+
+def differentiable_generalised_geodesic2d(
+    image: torch.Tensor,
+    softmask: torch.Tensor,
+    v: float,
+    lamb,
+    iter: int = 2,
+):
+    r"""Computes Generalised Geodesic Distance using FastGeodis raster scanning, with gradients
+    with respect to image, softmask and lamb through GeneralisedGeodesicFunction.
+
+    Only CPU tensors are supported.
+
+    Args:
+        image: input image, can be grayscale or multiple channels.
+        softmask: softmask in range [0, 1] with seed information.
+        v: weighting factor for establishing relationship between unary and spatial distances.
+        lamb: float or scalar torch.Tensor between 0.0 and 1.0. 0.0 returns euclidean distance, whereas 1.0 returns geodesic distance
+        iter: number of passes of the iterative distance transform method
+
+    Returns:
+        torch.Tensor with distance transform
+    """
+    return GeneralisedGeodesicFunction.apply(image, softmask, lamb, [1.0, 1.0], v, iter)
+
+
+def differentiable_generalised_geodesic3d(
+    image: torch.Tensor,
+    softmask: torch.Tensor,
+    spacing: List,
+    v: float,
+    lamb,
+    iter: int = 4,
+):
+    r"""Computes Generalised Geodesic Distance using FastGeodis raster scanning, with gradients
+    with respect to image, softmask and lamb through GeneralisedGeodesicFunction.
+
+    Only CPU tensors are supported.
+
+    Args:
+        image: input image, can be grayscale or multiple channels.
+        softmask: softmask in range [0, 1] with seed information.
+        spacing: spacing for 3D data
+        v: weighting factor for establishing relationship between unary and spatial distances.
+        lamb: float or scalar torch.Tensor between 0.0 and 1.0. 0.0 returns euclidean distance, whereas 1.0 returns geodesic distance
+        iter: number of passes of the iterative distance transform method
+
+    Returns:
+        torch.Tensor with distance transform
+    """
+    return GeneralisedGeodesicFunction.apply(image, softmask, lamb, list(spacing), v, iter)
+
+
+class GeodesicStream3d:
+    r"""Streaming Generalised Geodesic Distance for 3D volumes acquired slice by slice.
+    Each appended slice is propagated front-to-back from the previous slice, followed
+    by a back-to-front repair sweep that stops at the first slice whose distance does not change.
+
+    The raster scanning and local distances follow generalised_geodesic3d, so the streamed
+    volume approximates generalised_geodesic3d on the same data without recomputing it on every slice.
+    Only CPU tensors are supported.
+
+    Args:
+        spacing: spacing for 3D data (depth, height, width), depth being the streaming direction
+        v: weighting factor for establishing relationship between unary and spatial distances.
+        lamb: weighting factor between 0.0 and 1.0. 0.0 returns euclidean distance, whereas 1.0 returns geodesic distance
+        iter: maximum number of in-plane passes of the iterative distance transform method for each updated slice
+    """
+
+    def __init__(self, spacing: List, v: float, lamb: float, iter: int = 4):
+        self._stream = FastGeodisCpp.GeodesicStream3d(spacing, v, lamb, 1 - lamb, iter)
+
+    def append_slice(self, image: torch.Tensor, softmask: torch.Tensor):
+        r"""Appends a slice at the back of the volume and updates the distance.
+
+        Args:
+            image: input slice of shape (1, C, H, W), can be grayscale or multiple channels.
+            softmask: softmask slice of shape (1, 1, H, W) in range [0, 1] with seed information.
+
+        Returns:
+            torch.Tensor with distance transform of the appended slice, shape (1, 1, H, W)
+        """
+        return self._stream.append_slice(image, softmask)
+
+    @property
+    def distance(self):
+        r"""torch.Tensor with distance transform of all streamed slices, shape (1, 1, D, H, W)"""
+        return self._stream.distance()
+
+    @property
+    def depth(self):
+        r"""Number of streamed slices"""
+        return self._stream.depth()
+
+    @property
+    def repaired_slices(self):
+        r"""Number of previous slices updated by the repair sweep of the last append"""
+        return self._stream.repaired_slices()
+
+    def reset(self):
+        r"""Clears all streamed slices"""
+        self._stream.reset()
+
+
+class GeodesicVideo2d:
+    r"""Warm-started Generalised Geodesic Distance for 2D+t video frames.
+    Each frame starts from the previous frame's distance. Pixels whose image changed beyond
+    threshold, or whose seed weight increased, invalidate all pixels with a previous distance
+    at least as large as theirs, as only those can have shortest paths through a changed pixel.
+    Raster scanning is then repeated within the bounding box of invalidated pixels, growing as
+    distances change, until no pixel changes or max_iter is reached.
+
+    With threshold 0.0 and enough iterations the result matches a converged generalised_geodesic2d.
+    Image changes below threshold are ignored and may leave a small error in the warm-started distance.
+    Only CPU tensors are supported.
+
+    Args:
+        v: weighting factor for establishing relationship between unary and spatial distances.
+        lamb: weighting factor between 0.0 and 1.0. 0.0 returns euclidean distance, whereas 1.0 returns geodesic distance
+        threshold: l1 image change per pixel above which a pixel is repaired
+        max_iter: maximum number of passes of the iterative distance transform method for each frame
+    """
+
+    def __init__(self, v: float, lamb: float, threshold: float = 0.0, max_iter: int = 16):
+        self._video = FastGeodisCpp.GeodesicVideo2d(v, lamb, 1 - lamb, threshold, max_iter)
+
+    def process_frame(self, image: torch.Tensor, softmask: torch.Tensor):
+        r"""Computes distance of the next frame, warm-started from the previous one.
+
+        Args:
+            image: input frame of shape (1, C, H, W), can be grayscale or multiple channels.
+            softmask: softmask of shape (1, 1, H, W) in range [0, 1] with seed information.
+
+        Returns:
+            torch.Tensor with distance transform of the frame
+        """
+        return self._video.process_frame(image, softmask)
+
+    @property
+    def iterations(self):
+        r"""Number of passes of the iterative distance transform run for the last frame"""
+        return self._video.iterations()
+
+    @property
+    def repaired_pixels(self):
+        r"""Number of pixels reset to their seed value for the last frame"""
+        return self._video.repaired_pixels()
+
+    def reset(self):
+        r"""Forgets the previous frame, next frame is computed from scratch"""
+        self._video.reset()
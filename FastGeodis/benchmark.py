@@ -0,0 +1,361 @@
+# BSD 3-Clause License
+
+# Copyright (c) 2021, Muhammad Asad (masadcv@gmail.com)
+# All rights reserved.
+
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+
+# 1. Redistributions of source code must retain the above copyright notice, this
+#    list of conditions and the following disclaimer.
+
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+#    this list of conditions and the following disclaimer in the documentation
+#    and/or other materials provided with the distribution.
+
+# 3. Neither the name of the copyright holder nor the names of its
+#    contributors may be used to endorse or promote products derived from
+#    this software without specific prior written permission.
+
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+# OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+r"""Benchmark of FastGeodis functions on reproducible synthetic workloads.
+
+    python -m FastGeodis.benchmark --dims 2 3 --iters 1 2 4 8 --json results.json
+
+Every function is timed with warmup runs and statistics over repeats, and distance functions are
+compared with generalised_geodesic_exact2d/3d, so that iter and engines can be chosen from data.
+Workloads:
+    noise: uniform noise, every pixel is an edge
+    spiral: walls with alternating gaps around the seed, paths wind outwards and need many iterations
+    flat: large constant regions with a few step edges
+    multichannel: three channel noise
+"""
+
+import argparse
+import json
+import statistics
+import sys
+import time
+from typing import List, Optional
+
+import torch
+import FastGeodis
+
+WORKLOADS = ["noise", "spiral", "flat", "multichannel"]
+
+
+def _spiral2d(size: int):
+    # concentric square walls, each with a gap on the opposite side to the previous wall
+    image = torch.zeros((size, size))
+    c = size // 2
+    for k, r in enumerate(range(3, c - 1, 4)):
+        lo, hi = c - r, c + r
+        image[lo, lo : hi + 1] = 1.0
+        image[hi, lo : hi + 1] = 1.0
+        image[lo : hi + 1, lo] = 1.0
+        image[lo : hi + 1, hi] = 1.0
+        if k % 2 == 0:
+            image[lo, lo + 1 : lo + 3] = 0.0
+        else:
+            image[hi, hi - 2 : hi] = 0.0
+    return image
+
+
+def _flat2d(size: int, generator: torch.Generator):
+    # four by four constant blocks
+    blocks = torch.rand((4, 4), generator=generator)
+    index = torch.arange(size) * 4 // size
+    return blocks[index][:, index]
+
+
+def make_workload(name: str, dims: int, size: int, seed: int = 0):
+    r"""Generates a reproducible workload with a single seed at the centre.
+
+    Args:
+        name: one of "noise", "spiral", "flat" or "multichannel"
+        dims: 2 or 3
+        size: number of pixels along every spatial axis
+        seed: seed of the random generator
+
+    Returns:
+        tuple of image of shape (1, C, *spatial) and softmask of shape (1, 1, *spatial)
+    """
+    if name not in WORKLOADS:
+        raise ValueError("unknown workload {}, expected one of {}".format(name, WORKLOADS))
+    if dims not in (2, 3):
+        raise ValueError("dims must be 2 or 3, received {}".format(dims))
+    generator = torch.Generator().manual_seed(seed)
+    spatial = (size,) * dims
+
+    if name == "noise":
+        image = torch.rand((1, 1) + spatial, generator=generator)
+    elif name == "multichannel":
+        image = torch.rand((1, 3) + spatial, generator=generator)
+    else:
+        plane = _spiral2d(size) if name == "spiral" else _flat2d(size, generator)
+        # the 3D workload extrudes the plane along depth
+        image = plane.expand(spatial).reshape((1, 1) + spatial).contiguous()
+
+    mask = torch.ones((1, 1) + spatial)
+    mask[(0, 0) + (size // 2,) * dims] = 0.0
+    return image, mask
+
+
+def _functions(dims: int, spacing: List[float], v: float, num_query: int = 16):
+    # name -> (function of image, mask, iter, lamb, whether iter is used, whether the output is a distance map)
+    d = "{}d".format(dims)
+    fg = FastGeodis
+    sp = [spacing] if dims == 3 else []
+
+    def knn(image, mask, it, lamb):
+        labels = torch.full_like(mask, -1.0).long()
+        size = mask.shape[2]
+        for i, corner in enumerate([size // 4, 3 * size // 4]):
+            labels[(0, 0) + (corner,) * dims] = i
+        return getattr(fg, "generalised_geodesic_knn" + d)(image, labels, 2, *sp, lamb, it)
+
+    def query(image, mask, it, lamb):
+        points = _query_points(mask, num_query)
+        return getattr(fg, "geodesic_query" + d)(image, mask, points, *sp, v, lamb)
+
+    def clicks(image, mask, it, lamb):
+        labels = (image.mean(1, keepdim=True) > 0.5).float()
+        return getattr(fg, "simulate_click_guidance" + d)(image, labels, 2, 2, *sp, v, lamb, it)
+
+    def geos(image, mask, it, lamb):
+        fg_likelihood = image.mean(1, keepdim=True).clamp(0.05, 0.95)
+        return getattr(fg, "GeoS" + d)(image, fg_likelihood, 1 - fg_likelihood, [1.0], [1.0], *sp, v, lamb, 1.0, it)
+
+    functions = {
+        "generalised_geodesic": (lambda i, m, it, l: getattr(fg, "generalised_geodesic" + d)(i, m, *sp, v, l, it), True, True),
+        "approx_factor2": (
+            lambda i, m, it, l: getattr(fg, "generalised_geodesic" + d)(i, m, *sp, v, l, it, approx_factor=2), True, True
+        ),
+        "signed_generalised_geodesic": (
+            lambda i, m, it, l: getattr(fg, "signed_generalised_geodesic" + d)(i, m, *sp, v, l, it), True, False
+        ),
+        "GSF": (lambda i, m, it, l: getattr(fg, "GSF" + d)(i, m, 1.0, *sp, v, l, it), True, False),
+        "GeoS": (geos, True, False),
+        "knn": (knn, True, False),
+        "batch": (
+            lambda i, m, it, l: getattr(fg, "generalised_geodesic" + d + "_batch")(
+                torch.cat([i] * 4), torch.cat([m] * 4), *sp, v, l, it
+            ),
+            True,
+            False,
+        ),
+        "simulate_click_guidance": (clicks, True, False),
+        "exact": (lambda i, m, it, l: getattr(fg, "generalised_geodesic_exact" + d)(i, m, *sp, v, l), False, True),
+        "superpixel": (lambda i, m, it, l: getattr(fg, "generalised_geodesic_superpixel" + d)(i, m, *sp, v, l), False, True),
+        "query": (query, False, False),
+    }
+    if dims == 3:
+        functions["decomposed"] = (
+            lambda i, m, it, l: fg.generalised_geodesic3d_decomposed(i, m, spacing, v, l, it), True, True
+        )
+    return functions
+
+
+def _query_points(mask: torch.Tensor, num_query: int):
+    generator = torch.Generator().manual_seed(1)
+    spatial = torch.tensor(mask.shape[2:])
+    return (torch.rand((num_query, len(spatial)), generator=generator) * spatial).long()
+
+
+def _time(function, warmup: int, repeats: int, cuda: bool):
+    for _ in range(warmup):
+        function()
+    times = []
+    out = None
+    for _ in range(repeats):
+        if cuda:
+            torch.cuda.synchronize()
+        tic = time.perf_counter()
+        out = function()
+        if cuda:
+            torch.cuda.synchronize()
+        times.append(time.perf_counter() - tic)
+    stats = {
+        "mean": statistics.mean(times),
+        "std": statistics.pstdev(times),
+        "median": statistics.median(times),
+        "min": min(times),
+        "max": max(times),
+    }
+    return out, stats
+
+
+def _accuracy(distance: torch.Tensor, reference: torch.Tensor, v: float):
+    # pixels the raster scan has not reached keep a distance of about v and are counted separately
+    distance = distance.detach().cpu().float()
+    reached = distance < 0.5 * v
+    error = (distance - reference).abs()[reached]
+    return {
+        "mean_abs_error": error.mean().item() if error.numel() > 0 else 0.0,
+        "max_abs_error": error.max().item() if error.numel() > 0 else 0.0,
+        "mean_rel_error": (error.sum() / reference[reached].abs().sum().clamp(min=1e-12)).item(),
+        "unreached_fraction": 1.0 - reached.float().mean().item(),
+    }
+
+
+def run(
+    dims: List[int] = [2, 3],
+    size2d: int = 256,
+    size3d: int = 48,
+    workloads: Optional[List[str]] = None,
+    functions: Optional[List[str]] = None,
+    iters: List[int] = [1, 2, 4, 8],
+    lambdas: List[float] = [1.0],
+    v: float = 1e10,
+    warmup: int = 1,
+    repeats: int = 5,
+    device: str = "cpu",
+    seed: int = 0,
+    verbose: bool = True,
+):
+    r"""Runs the benchmark and returns its results as a dictionary ready for json.
+
+    Args:
+        dims: spatial dimensions to benchmark
+        size2d: size of 2D workloads along each axis
+        size3d: size of 3D workloads along each axis
+        workloads: workloads to run, all if None
+        functions: function names to run, e.g. "generalised_geodesic" or "exact", all if None
+        iters: iteration counts of functions using iter
+        lambdas: values of lamb
+        v: weighting factor for establishing relationship between unary and spatial distances.
+        warmup: untimed runs before timing
+        repeats: timed runs
+        device: device of the inputs, functions not supporting it are reported with their error
+        seed: seed of the workloads
+        verbose: print a line per result
+
+    Returns:
+        dict with system information and a list of results
+    """
+    workloads = workloads or WORKLOADS
+    cuda = device.startswith("cuda")
+    results = []
+    for d in dims:
+        size = size2d if d == 2 else size3d
+        spacing = [1.0] * d
+        table = _functions(d, spacing, v)
+        names = functions or list(table.keys())
+        for name in names:
+            if name not in table:
+                raise ValueError("unknown function {} for {}D, expected one of {}".format(name, d, list(table.keys())))
+
+        for workload in workloads:
+            image, mask = make_workload(workload, d, size, seed)
+            for lamb in lambdas:
+                # exact reference on cpu, shared by all functions of this workload
+                reference = None
+                if any(table[name][2] for name in names):
+                    exact = FastGeodis.generalised_geodesic_exact2d if d == 2 else FastGeodis.generalised_geodesic_exact3d
+                    reference = exact(image, mask, *([spacing] if d == 3 else []), v, lamb)
+
+                image_d, mask_d = image.to(device), mask.to(device)
+                for name in names:
+                    function, uses_iter, is_distance = table[name]
+                    for it in iters if uses_iter else [None]:
+                        result = {
+                            "function": name,
+                            "dims": d,
+                            "workload": workload,
+                            "shape": list(image.shape),
+                            "iter": it,
+                            "lamb": lamb,
+                            "device": device,
+                        }
+                        try:
+                            out, result["time"] = _time(
+                                lambda: function(image_d, mask_d, it, lamb), warmup, repeats, cuda
+                            )
+                            if is_distance:
+                                result["accuracy"] = _accuracy(out, reference, v)
+                        except Exception as e:
+                            result["error"] = "{}: {}".format(type(e).__name__, e)
+                        results.append(result)
+                        if verbose:
+                            _print_result(result)
+
+    return {
+        "system": {
+            "torch": torch.__version__,
+            "num_threads": torch.get_num_threads(),
+            "cpu_isa": FastGeodis.cpu_isa(),
+            "device": device,
+        },
+        "results": results,
+    }
+
+
+def _print_result(result):
+    line = "{:<28} {}d {:<13} iter {:<4} lamb {:<4}".format(
+        result["function"], result["dims"], result["workload"], str(result["iter"]), result["lamb"]
+    )
+    if "error" in result:
+        print(line + " error: " + result["error"])
+        return
+    line += " median {:9.4f} s  std {:8.4f} s".format(result["time"]["median"], result["time"]["std"])
+    if "accuracy" in result:
+        accuracy = result["accuracy"]
+        line += "  mean err {:9.4f}  max err {:9.4f}  unreached {:6.2%}".format(
+            accuracy["mean_abs_error"], accuracy["max_abs_error"], accuracy["unreached_fraction"]
+        )
+    print(line)
+
+
+def main(argv: Optional[List[str]] = None):
+    parser = argparse.ArgumentParser(prog="python -m FastGeodis.benchmark", description=__doc__.split("\n\n")[0])
+    parser.add_argument("--dims", type=int, nargs="+", default=[2, 3], choices=[2, 3])
+    parser.add_argument("--size2d", type=int, default=256, help="size of 2D workloads along each axis")
+    parser.add_argument("--size3d", type=int, default=48, help="size of 3D workloads along each axis")
+    parser.add_argument("--workloads", nargs="+", default=None, choices=WORKLOADS)
+    parser.add_argument("--functions", nargs="+", default=None, help="function names, all by default")
+    parser.add_argument("--iters", type=int, nargs="+", default=[1, 2, 4, 8])
+    parser.add_argument("--lambdas", type=float, nargs="+", default=[1.0])
+    parser.add_argument("--v", type=float, default=1e10)
+    parser.add_argument("--warmup", type=int, default=1)
+    parser.add_argument("--repeats", type=int, default=5)
+    parser.add_argument("--device", default="cpu")
+    parser.add_argument("--seed", type=int, default=0)
+    parser.add_argument("--json", default=None, help="output file, - for stdout")
+    args = parser.parse_args(argv)
+
+    report = run(
+        dims=args.dims,
+        size2d=args.size2d,
+        size3d=args.size3d,
+        workloads=args.workloads,
+        functions=args.functions,
+        iters=args.iters,
+        lambdas=args.lambdas,
+        v=args.v,
+        warmup=args.warmup,
+        repeats=args.repeats,
+        device=args.device,
+        seed=args.seed,
+        verbose=args.json != "-",
+    )
+    if args.json == "-":
+        json.dump(report, sys.stdout, indent=2)
+    elif args.json is not None:
+        with open(args.json, "w") as f:
+            json.dump(report, f, indent=2)
+    return report
+
+
+if __name__ == "__main__":
+    main()
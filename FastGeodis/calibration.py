@@ -0,0 +1,192 @@
+# BSD 3-Clause License
+
+# Copyright (c) 2021, Muhammad Asad (masadcv@gmail.com)
+# All rights reserved.
+
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+
+# 1. Redistributions of source code must retain the above copyright notice, this
+#    list of conditions and the following disclaimer.
+
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+#    this list of conditions and the following disclaimer in the documentation
+#    and/or other materials provided with the distribution.
+
+# 3. Neither the name of the copyright holder nor the names of its
+#    contributors may be used to endorse or promote products derived from
+#    this software without specific prior written permission.
+
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+# OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+r"""Calibration of the number of raster scanning iterations against the exact distance.
+
+Raster scanning converges to the distance of generalised_geodesic_exact2d/3d, and the number of iterations
+it needs depends on how often shortest paths turn back against the scan directions in the data. Sample
+images are compared with the exact engine for every iteration count, and iter="auto" picks the smallest
+count within a tolerance, calibrated once per dataset profile.
+"""
+
+import math
+import time
+from typing import Dict, List, Optional, Sequence, Union
+
+import torch
+import FastGeodisCpp
+
+_auto_settings = {"tolerance": 1e-3, "max_iter": 16}
+_auto_cache: Dict = {}
+
+
+def _as_list(tensors):
+    return [tensors] if isinstance(tensors, torch.Tensor) else list(tensors)
+
+
+def _raster(image, softmask, v, lamb, spacing, iterations):
+    if image.dim() == 4:
+        return FastGeodisCpp.generalised_geodesic2d(image, softmask, v, lamb, 1 - lamb, iterations)
+    return FastGeodisCpp.generalised_geodesic3d(image, softmask, spacing, v, lamb, 1 - lamb, iterations)
+
+
+def _exact(image, softmask, v, lamb, spacing):
+    if image.dim() == 4:
+        return FastGeodisCpp.generalised_geodesic_exact2d(image, softmask, v, lamb, 1 - lamb)[0]
+    return FastGeodisCpp.generalised_geodesic_exact3d(image, softmask, spacing, v, lamb, 1 - lamb)[0]
+
+
+def calibrate_iterations(
+    images: Union[torch.Tensor, Sequence[torch.Tensor]],
+    softmasks: Union[torch.Tensor, Sequence[torch.Tensor]],
+    v: float,
+    lamb: float,
+    spacing: Optional[List[float]] = None,
+    max_iter: int = 16,
+):
+    r"""Reports the error of raster scanning against the exact distance for 1 to max_iter iterations.
+    Errors are relative to the largest exact distance below v / 2 of each sample, so that one tolerance fits
+    images of any intensity range, and pixels the raster scan has not reached yet count with an error of
+    about v. Calibration stops early once every sample matches the exact distance.
+    Runs on CPU, the exact engine costs much more than a few raster iterations.
+
+    Args:
+        images: sample image or list of sample images of shape [1, C, H, W] or [1, C, D, H, W]
+        softmasks: softmask or list of softmasks matching images
+        v: weighting factor for establishing relationship between unary and spatial distances.
+        lamb: weighting factor between 0.0 and 1.0. 0.0 returns euclidean distance, whereas 1.0 returns geodesic distance
+        spacing: spacing of 3D images, ignored for 2D images
+        max_iter: largest number of iterations to compare
+
+    Returns:
+        list with a dict per iteration count of iter, max_rel_error and mean_rel_error (the largest and the
+        mean over samples), max_abs_error and time in seconds summed over samples
+    """
+    images, softmasks = _as_list(images), _as_list(softmasks)
+    if len(images) == 0 or len(images) != len(softmasks):
+        raise ValueError("calibration needs matching non-empty lists of images and softmasks")
+    if max_iter < 1:
+        raise ValueError("max_iter must be at least 1, received {}".format(max_iter))
+    dims = images[0].dim()
+    if dims not in (4, 5) or any(image.dim() != dims for image in images):
+        raise ValueError("images must all be 2D [1, C, H, W] or all be 3D [1, C, D, H, W]")
+    if dims == 5 and spacing is None:
+        spacing = [1.0, 1.0, 1.0]
+
+    samples = []
+    for image, softmask in zip(images, softmasks):
+        image, softmask = image.detach().cpu().float(), softmask.detach().cpu().float()
+        reference = _exact(image, softmask, v, lamb, spacing)
+        reached = reference < 0.5 * v
+        scale = reference[reached].max().item() if reached.any() else 1.0
+        samples.append((image, softmask, reference, max(scale, 1e-12)))
+
+    report = []
+    for iterations in range(1, max_iter + 1):
+        entry = {"iter": iterations, "max_rel_error": 0.0, "mean_rel_error": 0.0, "max_abs_error": 0.0, "time": 0.0}
+        for image, softmask, reference, scale in samples:
+            tic = time.perf_counter()
+            distance = _raster(image, softmask, v, lamb, spacing, iterations)
+            entry["time"] += time.perf_counter() - tic
+            error = (distance - reference).abs()
+            entry["max_abs_error"] = max(entry["max_abs_error"], error.max().item())
+            entry["max_rel_error"] = max(entry["max_rel_error"], error.max().item() / scale)
+            entry["mean_rel_error"] += error.mean().item() / scale / len(samples)
+        report.append(entry)
+        if entry["max_abs_error"] == 0:
+            break
+    return report
+
+
+def select_iterations(report: List[Dict], tolerance: float):
+    r"""Smallest iteration count of a calibrate_iterations report with max_rel_error within tolerance.
+
+    Args:
+        report: output of calibrate_iterations
+        tolerance: largest acceptable relative error
+
+    Returns:
+        number of iterations, the largest count of the report if none meets the tolerance
+    """
+    for entry in report:
+        if entry["max_rel_error"] <= tolerance:
+            return entry["iter"]
+    return report[-1]["iter"]
+
+
+def _profile(image, v, lamb, spacing):
+    # images of similar size, channels and parameters are taken to need the same number of iterations,
+    # sizes are bucketed to powers of two since path lengths grow with the size
+    sizes = tuple(2 ** math.ceil(math.log2(max(s, 1))) for s in image.shape[2:])
+    return (image.dim() - 2, image.shape[1], sizes, float(v), float(lamb), tuple(spacing) if spacing is not None else None)
+
+
+def set_auto_iterations(tolerance: float = 1e-3, max_iter: int = 16):
+    r"""Sets tolerance and largest iteration count of iter="auto" and drops all calibrated profiles.
+
+    Args:
+        tolerance: largest acceptable max_rel_error, see calibrate_iterations
+        max_iter: largest number of iterations iter="auto" may pick
+    """
+    if tolerance < 0 or max_iter < 1:
+        raise ValueError("tolerance must be non-negative and max_iter at least 1")
+    _auto_settings["tolerance"] = tolerance
+    _auto_settings["max_iter"] = max_iter
+    _auto_cache.clear()
+
+
+def auto_iterations(
+    image: torch.Tensor,
+    softmask: torch.Tensor,
+    v: float,
+    lamb: float,
+    spacing: Optional[List[float]] = None,
+    profile=None,
+):
+    r"""Number of iterations used by iter="auto", calibrated with calibrate_iterations on the first image
+    of each dataset profile and reused for later images of that profile.
+
+    Args:
+        image: input image, the calibration sample if its profile has not been seen yet
+        softmask: softmask in range [0, 1] with seed information.
+        v: weighting factor for establishing relationship between unary and spatial distances.
+        lamb: weighting factor between 0.0 and 1.0. 0.0 returns euclidean distance, whereas 1.0 returns geodesic distance
+        spacing: spacing of 3D images, ignored for 2D images
+        profile: hashable name of the dataset, by default the profile is made of the number of dimensions,
+            channels, sizes rounded up to powers of two, v, lamb and spacing
+
+    Returns:
+        number of iterations
+    """
+    key = profile if profile is not None else _profile(image, v, lamb, spacing)
+    if key not in _auto_cache:
+        report = calibrate_iterations(image, softmask, v, lamb, spacing, _auto_settings["max_iter"])
+        _auto_cache[key] = select_iterations(report, _auto_settings["tolerance"])
+    return _auto_cache[key]
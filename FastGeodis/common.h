@@ -31,8 +31,16 @@
 #pragma once
 #include <torch/extension.h>
 #include <iostream>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
-void print_shape(const torch::Tensor &data)
+inline void print_shape(const torch::Tensor &data)
 {
     auto num_dims = data.dim();
     std::cout << "Shape: (";
@@ -50,7 +58,7 @@ void print_shape(const torch::Tensor &data)
     }
 }
 
-void check_spatial_shape_match(const torch::Tensor &in1, const torch::Tensor &in2, const int &dims)
+inline void check_spatial_shape_match(const torch::Tensor &in1, const torch::Tensor &in2, const int &dims)
 {
     if (in1.dim() != in2.dim())
     {
@@ -70,7 +78,7 @@ void check_spatial_shape_match(const torch::Tensor &in1, const torch::Tensor &in
     }
 }
 
-void check_cpu(const torch::Tensor &in)
+inline void check_cpu(const torch::Tensor &in)
 {
     if (in.is_cuda())
     {
@@ -78,7 +86,7 @@ void check_cpu(const torch::Tensor &in)
     }
 }
 
-void check_cuda(const torch::Tensor &in)
+inline void check_cuda(const torch::Tensor &in)
 {
     if (!in.is_cuda())
     {
@@ -86,7 +94,7 @@ void check_cuda(const torch::Tensor &in)
     }
 }
 
-void check_single_batch(const torch::Tensor &in)
+inline void check_single_batch(const torch::Tensor &in)
 {
     if (in.size(0) != 1)
     {
@@ -94,7 +102,7 @@ void check_single_batch(const torch::Tensor &in)
     }
 }
 
-void check_data_dim(const torch::Tensor &in, const int &dims)
+inline void check_data_dim(const torch::Tensor &in, const int &dims)
 {
     // check input dimensions
     const int num_dims = in.dim();
@@ -105,7 +113,7 @@ void check_data_dim(const torch::Tensor &in, const int &dims)
     }
 }
 
-void check_input_dimensions(const torch::Tensor &image, const torch::Tensor &mask, const int &num_dims)
+inline void check_input_dimensions(const torch::Tensor &image, const torch::Tensor &mask, const int &num_dims)
 {
     // check tensor dims
     check_data_dim(image, num_dims);
@@ -118,3 +126,227 @@ void check_input_dimensions(const torch::Tensor &image, const torch::Tensor &mas
     // check spatial shapes match
     check_spatial_shape_match(image, mask, num_dims-2);    
 }
+
+inline void check_cpu_inputs(const torch::Tensor &image, const torch::Tensor &mask, const int &num_dims, const std::vector<float> &spacing)
+{
+    // check input dimensions
+    check_input_dimensions(image, mask, num_dims);
+    check_cpu(image);
+    check_cpu(mask);
+
+    if (num_dims == 5 && spacing.size() != 3)
+    {
+        throw std::invalid_argument(
+            "function only supports 3D spacing inputs, received " + std::to_string(spacing.size()));
+    }
+}
+
+inline float l1distance_strided(const float *image_p, const float *image_q, const int64_t &p, const int64_t &q, const int &channel, const int64_t &plane)
+{
+    // l1 distance between pixel p and q of channel-first images with channel stride plane
+    float ret_sum = 0.0;
+    for (int c_i = 0; c_i < channel; c_i++)
+    {
+        ret_sum += std::abs(image_p[c_i * plane + p] - image_q[c_i * plane + q]);
+    }
+    return ret_sum;
+}
+
+// transform of the output distance, applied as the final pass writes each value back
+struct OutputTransform
+{
+    // clip distance to [0, clip], disabled if not positive
+    float clip = 0.0;
+    // divide by the maximum distance
+    bool normalise = false;
+    // exp(-distance / decay), disabled if not positive
+    float decay = 0.0;
+
+    bool enabled() const
+    {
+        return clip > 0 || normalise || decay > 0;
+    }
+
+    // part of the transform independent of other voxels, decay waits for the maximum when normalising
+    float apply_local(float dist) const
+    {
+        if (clip > 0)
+            dist = std::min(std::max(dist, 0.0f), clip);
+        if (!normalise && decay > 0)
+            dist = std::exp(-dist / decay);
+        return dist;
+    }
+
+    // remaining part once the maximum of apply_local outputs is known
+    float apply_global(float dist, const float &max_dist) const
+    {
+        if (!normalise)
+            return dist;
+        dist = max_dist > 0 ? dist / max_dist : 0.0f;
+        if (decay > 0)
+            dist = std::exp(-dist / decay);
+        return dist;
+    }
+};
+
+// outcome of a raster pass
+struct PassResult
+{
+    // maximum output of a fused transform, 0 without a transform
+    float max_dist = 0.0;
+    // distance updates of the forward and backward sweeps, a pixel improved by both counts twice
+    int64_t improved = 0;
+};
+
+// separable smoothing of the image, applied by the engine before the raster passes
+struct Presmoothing
+{
+    // gaussian sigma, or box half-width, per spatial axis in spacing units, disabled if not positive
+    std::vector<float> sigma;
+    // box window instead of gaussian
+    bool box = false;
+
+    bool enabled() const
+    {
+        return std::any_of(sigma.begin(), sigma.end(), [](const float &s) { return s > 0; });
+    }
+
+    // normalised weights from -radius to radius along axis, a single weight if the axis is not smoothed
+    std::vector<float> weights(const int &axis, const float &spacing) const
+    {
+        const float s = sigma[axis] / spacing;
+        const int radius = box ? int(std::round(s)) : int(std::ceil(3.0f * s));
+        if (s <= 0 || radius < 1)
+        {
+            return std::vector<float>(1, 1.0f);
+        }
+
+        std::vector<float> w(2 * radius + 1, 1.0f);
+        float sum = 0.0;
+        for (int k = -radius; k <= radius; k++)
+        {
+            if (!box)
+            {
+                w[k + radius] = std::exp(-0.5f * float(k * k) / (s * s));
+            }
+            sum += w[k + radius];
+        }
+        for (float &wk : w)
+        {
+            wk /= sum;
+        }
+        return w;
+    }
+};
+
+// splits threads between images of a batch running concurrently, each image gets an equal share of
+// the threads left by the images still running, so the last images speed up as the others finish
+struct BatchScheduler
+{
+    int total_threads = 1;
+    // threads per image when positive, instead of the adaptive share
+    int fixed_threads = 0;
+    std::atomic<int> active{0};
+
+    int image_threads() const
+    {
+        if (fixed_threads > 0)
+            return fixed_threads;
+        return std::max(1, total_threads / std::max(1, active.load()));
+    }
+};
+
+// scheduler of the image processed by the calling thread, null outside of a batch
+inline const BatchScheduler *&current_batch_scheduler()
+{
+    static thread_local const BatchScheduler *scheduler = nullptr;
+    return scheduler;
+}
+
+// per pass statistics of a raster scan engine call, collected only while current_geodesic_stats() is set
+struct GeodesicStats
+{
+    // time and number of distance updates of each pass in execution order, num_dims passes per iteration
+    std::vector<double> pass_ms;
+    std::vector<double> pass_improved;
+    std::vector<double> iteration_ms;
+    int64_t bytes_allocated = 0;
+    int threads = 0;
+};
+
+// statistics of the engine call running on the calling thread, null when not requested
+inline GeodesicStats *&current_geodesic_stats()
+{
+    static thread_local GeodesicStats *stats = nullptr;
+    return stats;
+}
+
+// collects statistics of engine calls on the calling thread for the lifetime of the scope
+struct GeodesicStatsScope
+{
+    GeodesicStats *previous;
+
+    explicit GeodesicStatsScope(GeodesicStats *stats) : previous(current_geodesic_stats())
+    {
+        current_geodesic_stats() = stats;
+    }
+
+    ~GeodesicStatsScope()
+    {
+        current_geodesic_stats() = previous;
+    }
+};
+
+// tracing of engine execution spans, enabled by start_trace() and written as chrome trace json by
+// stop_trace(), see fastgeodis_trace.cpp
+inline std::atomic<bool> &geodesic_tracing()
+{
+    static std::atomic<bool> enabled{false};
+    return enabled;
+}
+
+inline int64_t trace_clock_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void record_trace_span(const char *name, const int64_t &begin_ns, const int64_t &end_ns);
+
+// records a span named after a string literal from construction until end() or destruction on the
+// calling thread, costs a single atomic load while tracing is disabled
+struct TraceSpan
+{
+    const char *name;
+    int64_t begin_ns = 0;
+
+    explicit TraceSpan(const char *name) : name(geodesic_tracing().load(std::memory_order_relaxed) ? name : nullptr)
+    {
+        if (this->name != nullptr)
+            begin_ns = trace_clock_ns();
+    }
+
+    void end()
+    {
+        if (name != nullptr)
+            record_trace_span(name, begin_ns, trace_clock_ns());
+        name = nullptr;
+    }
+
+    ~TraceSpan()
+    {
+        end();
+    }
+};
+
+// team size for the parallel loops of the raster passes, re-evaluated at every loop
+inline int geodesic_num_threads()
+{
+    const BatchScheduler *scheduler = current_batch_scheduler();
+    if (scheduler != nullptr)
+        return scheduler->image_threads();
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
@@ -0,0 +1,169 @@
+# BSD 3-Clause License
+
+# Copyright (c) 2021, Muhammad Asad (masadcv@gmail.com)
+# All rights reserved.
+
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+
+# 1. Redistributions of source code must retain the above copyright notice, this
+#    list of conditions and the following disclaimer.
+
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+#    this list of conditions and the following disclaimer in the documentation
+#    and/or other materials provided with the distribution.
+
+# 3. Neither the name of the copyright holder nor the names of its
+#    contributors may be used to endorse or promote products derived from
+#    this software without specific prior written permission.
+
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+# OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+import os
+from typing import List, Optional
+
+import torch
+import torch.multiprocessing as mp
+import FastGeodisCpp
+
+
+def _slab_bounds(depth: int, num_workers: int):
+    return [i * depth // num_workers for i in range(num_workers + 1)]
+
+
+def _decomposition_worker(
+    rank, image, distance, boundary, changed, barrier, spacing, lamb, iter, max_rounds, num_threads, worker_cpus
+):
+    try:
+        if worker_cpus is not None:
+            os.sched_setaffinity(0, worker_cpus[rank])
+        torch.set_num_threads(num_threads)
+
+        num_workers = changed.shape[1]
+        depth = distance.shape[2]
+        bounds = _slab_bounds(depth, num_workers)
+        begin, end = bounds[rank], bounds[rank + 1]
+        lo, hi = max(begin - 1, 0), min(end + 1, depth)
+
+        # private copy of the owned slab with one halo plane from each neighbour
+        local_image = image[:, :, lo:hi]
+        local = distance[:, :, lo:hi].clone()
+        first, last = begin - lo, end - 1 - lo
+
+        for r in range(max_rounds):
+            # boundaries are double buffered so that a fast worker never overwrites planes still being read
+            if r > 0:
+                published = boundary[(r - 1) % 2]
+                if rank > 0:
+                    local[0, 0, 0] = torch.minimum(local[0, 0, 0], published[rank - 1, 1])
+                if rank < num_workers - 1:
+                    local[0, 0, -1] = torch.minimum(local[0, 0, -1], published[rank + 1, 0])
+
+            updated = FastGeodisCpp.generalised_geodesic_relax3d(
+                local_image, local, spacing, lamb, 1 - lamb, iter if r == 0 else 1
+            )
+            boundary[r % 2, rank, 0] = local[0, 0, first]
+            boundary[r % 2, rank, 1] = local[0, 0, last]
+            changed[r % 2, rank] = updated
+            barrier.wait()
+
+            # every worker reads the same flags, so all of them stop in the same round
+            if changed[r % 2].sum().item() == 0:
+                break
+
+        distance[:, :, begin:end] = local[:, :, first : last + 1]
+    except BaseException:
+        # release the other workers instead of leaving them waiting at the barrier
+        barrier.abort()
+        raise
+
+
+def generalised_geodesic3d_decomposed(
+    image: torch.Tensor,
+    softmask: torch.Tensor,
+    spacing: List,
+    v: float,
+    lamb: float,
+    iter: int = 4,
+    num_workers: int = 2,
+    num_threads: Optional[int] = None,
+    worker_cpus: Optional[List[List[int]]] = None,
+    max_rounds: int = 1000,
+):
+    r"""Computes Generalised Geodesic Distance with the volume split into depth slabs over worker processes.
+    Image and distance live in POSIX shared memory. Each worker owns a slab and runs raster passes on it,
+    then publishes its first and last plane through a shared boundary buffer, which its neighbours use
+    as halo planes in the next round. Rounds repeat until no worker updates any value, at which point the
+    distance is the fixed point of the raster passes, the same as generalised_geodesic_exact3d.
+
+    Workers are started with the spawn method, scripts calling this function need an
+    if __name__ == "__main__": guard. The image is moved to shared memory in place with share_memory_().
+
+    Only CPU tensors are supported.
+
+    Args:
+        image: input image, can be grayscale or multiple channels.
+        softmask: softmask in range [0, 1] with seed information.
+        spacing: spacing for 3D data
+        v: weighting factor for establishing relationship between unary and spatial distances.
+        lamb: weighting factor between 0.0 and 1.0. 0.0 returns euclidean distance, whereas 1.0 returns geodesic distance
+        iter: number of passes of the first round, later rounds run a single pass
+        num_workers: number of worker processes, each owning a slab of the depth axis
+        num_threads: OpenMP threads per worker, defaults to splitting torch.get_num_threads() between workers
+        worker_cpus: optional list of CPU ids per worker for pinning, e.g. one socket per worker
+        max_rounds: maximum number of boundary exchange rounds
+
+    Returns:
+        torch.Tensor with distance transform
+    """
+    if image.is_cuda or softmask.is_cuda:
+        raise ValueError("decomposition only supports CPU tensors")
+    if image.dim() != 5 or softmask.dim() != 5 or image.shape[0] != 1 or softmask.shape[0] != 1:
+        raise ValueError("image and softmask must have shape (1, C, D, H, W)")
+    if image.shape[2:] != softmask.shape[2:]:
+        raise ValueError("shapes of input tensors do not match")
+    if len(spacing) != 3:
+        raise ValueError("function only supports 3D spacing inputs, received {}".format(len(spacing)))
+    if worker_cpus is not None and len(worker_cpus) != num_workers:
+        raise ValueError("worker_cpus needs one list of CPU ids per worker")
+
+    depth, height, width = softmask.shape[2:]
+    num_workers = max(1, min(num_workers, depth))
+    if num_threads is None:
+        num_threads = max(1, torch.get_num_threads() // num_workers)
+
+    image = image.contiguous().share_memory_()
+    distance = (v * softmask).contiguous().share_memory_()
+    boundary = torch.empty((2, num_workers, 2, height, width), dtype=torch.float32).share_memory_()
+    changed = torch.zeros((2, num_workers), dtype=torch.int64).share_memory_()
+
+    ctx = mp.get_context("spawn")
+    barrier = ctx.Barrier(num_workers)
+    processes = [
+        ctx.Process(
+            target=_decomposition_worker,
+            args=(
+                rank, image, distance, boundary, changed, barrier, list(spacing), lamb, iter, max_rounds, num_threads, worker_cpus
+            ),
+        )
+        for rank in range(num_workers)
+    ]
+    for process in processes:
+        process.start()
+    for process in processes:
+        process.join()
+
+    for rank, process in enumerate(processes):
+        if process.exitcode != 0:
+            raise RuntimeError("decomposition worker {} failed with exit code {}".format(rank, process.exitcode))
+
+    return distance
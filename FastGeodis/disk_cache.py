@@ -0,0 +1,231 @@
+# BSD 3-Clause License
+
+# Copyright (c) 2021, Muhammad Asad (masadcv@gmail.com)
+# All rights reserved.
+
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+
+# 1. Redistributions of source code must retain the above copyright notice, this
+#    list of conditions and the following disclaimer.
+
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+#    this list of conditions and the following disclaimer in the documentation
+#    and/or other materials provided with the distribution.
+
+# 3. Neither the name of the copyright holder nor the names of its
+#    contributors may be used to endorse or promote products derived from
+#    this software without specific prior written permission.
+
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+# OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+import hashlib
+import os
+import tempfile
+from typing import List, Optional, Union
+
+import numpy as np
+import torch
+import FastGeodis
+
+
+def _check_single_output(kwargs):
+    # only the distance is stored, outputs returned next to it can not be served from the cache
+    for name in ("return_parent", "return_stats"):
+        if kwargs.get(name, False):
+            raise ValueError("{} is not supported by the disk cache".format(name))
+
+
+class GeodesicDiskCache:
+    r"""Persistent cache of geodesic maps on disk, e.g. to reuse maps of fixed seeds across training epochs.
+    Each map is stored as a .npy file named after a hash of the inputs' content and all parameters, and is
+    loaded memory-mapped, so that a hit costs little more than reading the file. Least recently used files
+    are deleted once the directory exceeds max_bytes. Files are written atomically, so several processes,
+    e.g. data loader workers, can share a directory.
+
+    With fp16 maps take half the space and are returned as float32 after conversion, distances above
+    65504 become inf. Results of CUDA inputs are returned on the device of the image.
+
+    Args:
+        directory: cache directory, created if missing
+        max_bytes: limit on the total size of cached files, unlimited if None
+        fp16: store maps as float16
+    """
+
+    def __init__(self, directory: str, max_bytes: Optional[int] = None, fp16: bool = False):
+        if max_bytes is not None and max_bytes < 0:
+            raise ValueError("max_bytes must not be negative, received {}".format(max_bytes))
+        os.makedirs(directory, exist_ok=True)
+        self.directory = directory
+        self.max_bytes = max_bytes
+        self.fp16 = fp16
+        self.hits = 0
+        self.misses = 0
+
+    def _key(self, name, tensors, params):
+        digest = hashlib.blake2b(digest_size=20)
+        digest.update(repr((name, params, self.fp16)).encode())
+        for tensor in tensors:
+            array = np.ascontiguousarray(tensor.detach().cpu().numpy())
+            digest.update(repr((array.dtype.str, array.shape)).encode())
+            digest.update(array.data)
+        return digest.hexdigest()
+
+    def _cached(self, name, tensors, params, compute):
+        path = os.path.join(self.directory, self._key(name, tensors, params) + ".npy")
+        try:
+            # copy-on-write mapping, pages are read on first access and changes stay private
+            array = np.load(path, mmap_mode="c")
+        except FileNotFoundError:
+            array = None
+        if array is not None:
+            try:
+                # hits refresh the modification time used for eviction
+                os.utime(path)
+            except OSError:
+                pass
+            self.hits += 1
+            result = torch.from_numpy(array)
+            if result.dtype != torch.float32:
+                result = result.float()
+            return result.to(tensors[0].device)
+
+        self.misses += 1
+        result = compute()
+        array = result.detach().cpu().numpy()
+        if self.fp16:
+            # return what later hits load, not the map before rounding
+            array = array.astype(np.float16)
+            result = torch.from_numpy(array).float().to(result.device)
+        if self.max_bytes is not None and array.nbytes > self.max_bytes:
+            return result
+
+        handle, tmp_path = tempfile.mkstemp(dir=self.directory, suffix=".tmp")
+        try:
+            with os.fdopen(handle, "wb") as f:
+                np.save(f, array)
+            os.replace(tmp_path, path)
+        except BaseException:
+            os.remove(tmp_path)
+            raise
+        self._evict()
+        return result
+
+    def _entries(self):
+        entries = []
+        for entry in os.scandir(self.directory):
+            if entry.name.endswith(".npy"):
+                try:
+                    stat = entry.stat()
+                except FileNotFoundError:
+                    continue
+                entries.append((stat.st_mtime, stat.st_size, entry.path))
+        return entries
+
+    def _evict(self):
+        if self.max_bytes is None:
+            return
+        entries = sorted(self._entries())
+        total = sum(size for _, size, _ in entries)
+        for _, size, path in entries:
+            if total <= self.max_bytes:
+                break
+            try:
+                os.remove(path)
+            except OSError:
+                # removed by another process, or still mapped on windows
+                pass
+            total -= size
+
+    def info(self):
+        r"""Counters of this cache object and size of the cache directory.
+
+        Returns:
+            dict with hits, misses, entries and bytes
+        """
+        entries = self._entries()
+        return {
+            "hits": self.hits,
+            "misses": self.misses,
+            "entries": len(entries),
+            "bytes": sum(size for _, size, _ in entries),
+        }
+
+    def clear(self):
+        r"""Deletes all cached maps and resets the counters."""
+        for _, _, path in self._entries():
+            try:
+                os.remove(path)
+            except FileNotFoundError:
+                pass
+        self.hits = 0
+        self.misses = 0
+
+    def generalised_geodesic2d(
+        self, image: torch.Tensor, softmask: torch.Tensor, v: float, lamb: float, iter: int = 2, **kwargs
+    ):
+        r"""Cached FastGeodis.generalised_geodesic2d, keyword arguments are passed on, except return_parent and return_stats."""
+        _check_single_output(kwargs)
+        if iter == "auto":
+            # key on the resolved count, maps of an earlier auto tolerance must not be served
+            iter = FastGeodis.auto_iterations(image, softmask, v, lamb)
+        return self._cached(
+            "generalised_geodesic2d",
+            [image, softmask],
+            (v, lamb, iter, sorted(kwargs.items())),
+            lambda: FastGeodis.generalised_geodesic2d(image, softmask, v, lamb, iter, **kwargs),
+        )
+
+    def generalised_geodesic3d(
+        self, image: torch.Tensor, softmask: torch.Tensor, spacing: List, v: float, lamb: float, iter: int = 4, **kwargs
+    ):
+        r"""Cached FastGeodis.generalised_geodesic3d, keyword arguments are passed on, except return_parent and return_stats."""
+        _check_single_output(kwargs)
+        if iter == "auto":
+            # key on the resolved count, maps of an earlier auto tolerance must not be served
+            iter = FastGeodis.auto_iterations(image, softmask, v, lamb, spacing)
+        return self._cached(
+            "generalised_geodesic3d",
+            [image, softmask],
+            (list(spacing), v, lamb, iter, sorted(kwargs.items())),
+            lambda: FastGeodis.generalised_geodesic3d(image, softmask, spacing, v, lamb, iter, **kwargs),
+        )
+
+    def GSF2d(
+        self, image: torch.Tensor, softmask: torch.Tensor, theta: Union[float, List[float]], v: float, lamb: float, iter: int
+    ):
+        r"""Cached FastGeodis.GSF2d."""
+        return self._cached(
+            "GSF2d",
+            [image, softmask],
+            (theta, v, lamb, iter),
+            lambda: FastGeodis.GSF2d(image, softmask, theta, v, lamb, iter),
+        )
+
+    def GSF3d(
+        self,
+        image: torch.Tensor,
+        softmask: torch.Tensor,
+        theta: Union[float, List[float]],
+        spacing: List,
+        v: float,
+        lamb: float,
+        iter: int,
+    ):
+        r"""Cached FastGeodis.GSF3d."""
+        return self._cached(
+            "GSF3d",
+            [image, softmask],
+            (theta, list(spacing), v, lamb, iter),
+            lambda: FastGeodis.GSF3d(image, softmask, theta, spacing, v, lamb, iter),
+        )
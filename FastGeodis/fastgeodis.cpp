@@ -29,8 +29,10 @@
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <torch/extension.h>
+#include <chrono>
 #include <iostream>
 #include <vector>
+#include <limits>
 #include "fastgeodis.h"
 #include "common.h"
 
@@ -40,6 +42,31 @@
 
 #define VERBOSE 0
 
+std::vector<float> cache_params(const float &v, const float &l_grad, const float &l_eucl, const int &iterations, const OutputTransform &transform, const Presmoothing &smoothing)
+{
+    std::vector<float> params = {v, l_grad, l_eucl, float(iterations), transform.clip, float(transform.normalise), transform.decay, float(smoothing.box)};
+    params.insert(params.end(), smoothing.sigma.begin(), smoothing.sigma.end());
+    return params;
+}
+
+torch::Tensor cached_geodesic2d_cpu(torch::Tensor &image, const torch::Tensor &mask, const float &v, const float &l_grad, const float &l_eucl, const int &iterations, const OutputTransform &transform = OutputTransform(), const Presmoothing &smoothing = Presmoothing())
+{
+    return cached_result("generalised_geodesic2d", {image, mask}, cache_params(v, l_grad, l_eucl, iterations, transform, smoothing), [&]()
+    {
+        return generalised_geodesic2d_cpu(image, mask, v, l_grad, l_eucl, iterations, transform, smoothing);
+    });
+}
+
+torch::Tensor cached_geodesic3d_cpu(torch::Tensor &image, const torch::Tensor &mask, const std::vector<float> &spacing, const float &v, const float &l_grad, const float &l_eucl, const int &iterations, const OutputTransform &transform = OutputTransform(), const Presmoothing &smoothing = Presmoothing())
+{
+    std::vector<float> params = cache_params(v, l_grad, l_eucl, iterations, transform, smoothing);
+    params.insert(params.end(), spacing.begin(), spacing.end());
+    return cached_result("generalised_geodesic3d", {image, mask}, params, [&]()
+    {
+        return generalised_geodesic3d_cpu(image, mask, spacing, v, l_grad, l_eucl, iterations, transform, smoothing);
+    });
+}
+
 torch::Tensor generalised_geodesic2d(torch::Tensor &image, const torch::Tensor &mask, const float &v, const float &l_grad, const float &l_eucl, const int &iterations)
 {
     #if VERBOSE
@@ -85,7 +112,7 @@ torch::Tensor generalised_geodesic2d(torch::Tensor &image, const torch::Tensor &
     {
         check_cpu(mask);
     }
-    return generalised_geodesic2d_cpu(image, mask, v, l_grad, l_eucl, iterations);
+    return cached_geodesic2d_cpu(image, mask, v, l_grad, l_eucl, iterations);
 }
 
 torch::Tensor generalised_geodesic3d(torch::Tensor &image, const torch::Tensor &mask, const std::vector<float> &spacing, const float &v, const float &l_grad, const float &l_eucl, const int &iterations)
@@ -141,58 +168,812 @@ torch::Tensor generalised_geodesic3d(torch::Tensor &image, const torch::Tensor &
     {
         check_cpu(mask);
     }
-    return generalised_geodesic3d_cpu(image, mask, spacing, v, l_grad, l_eucl, iterations);
+    return cached_geodesic3d_cpu(image, mask, spacing, v, l_grad, l_eucl, iterations);
+}
+
+OutputTransform make_output_transform(const float &clip, const bool &normalise, const float &decay)
+{
+    if (clip < 0 || decay < 0)
+    {
+        throw std::invalid_argument("clip and decay must be non-negative, zero disables them");
+    }
+    OutputTransform transform;
+    transform.clip = clip;
+    transform.normalise = normalise;
+    transform.decay = decay;
+    return transform;
+}
+
+torch::Tensor output_transform(const torch::Tensor &distance, const OutputTransform &transform)
+{
+    // same transform as fused into the CPU passes, as separate ops for CUDA
+    torch::Tensor out = distance;
+    if (transform.clip > 0)
+    {
+        out = out.clamp(0, transform.clip);
+    }
+    if (transform.normalise)
+    {
+        const float max_dist = out.max().item<float>();
+        out = max_dist > 0 ? out / max_dist : torch::zeros_like(out);
+    }
+    if (transform.decay > 0)
+    {
+        out = torch::exp(-out / transform.decay);
+    }
+    return out;
+}
+
+Presmoothing make_presmoothing(const std::vector<float> &sigma, const bool &box, const int &num_spatial)
+{
+    Presmoothing smoothing;
+    if (sigma.empty())
+    {
+        return smoothing;
+    }
+    if (sigma.size() != 1 && int(sigma.size()) != num_spatial)
+    {
+        throw std::invalid_argument(
+            "smoothing sigma needs 1 or " + std::to_string(num_spatial) + " values, received " + std::to_string(sigma.size()));
+    }
+    if (std::any_of(sigma.begin(), sigma.end(), [](const float &s) { return s < 0; }))
+    {
+        throw std::invalid_argument("smoothing sigma must be non-negative, zero disables an axis");
+    }
+    smoothing.sigma = sigma.size() == 1 ? std::vector<float>(num_spatial, sigma[0]) : sigma;
+    smoothing.box = box;
+    return smoothing;
+}
+
+torch::Tensor smooth_image(const torch::Tensor &image, const Presmoothing &smoothing, const std::vector<float> &spacing)
+{
+    // same smoothing as the CPU engine, as separate ops for CUDA
+    torch::Tensor out = image;
+    for (int a = 0; a < int(smoothing.sigma.size()); a++)
+    {
+        const std::vector<float> weights = smoothing.weights(a, spacing[a]);
+        if (weights.size() < 2)
+        {
+            continue;
+        }
+        const int dim = a + 2;
+        const int radius = int(weights.size() / 2);
+        const int64_t len = out.size(dim);
+        torch::Tensor index = torch::arange(len, torch::TensorOptions().dtype(torch::kLong).device(out.device()));
+        torch::Tensor acc = torch::zeros_like(out);
+        for (int k = -radius; k <= radius; k++)
+        {
+            acc += weights[k + radius] * out.index_select(dim, (index + k).clamp(0, len - 1));
+        }
+        out = acc;
+    }
+    return out.contiguous();
+}
+
+torch::Tensor generalised_geodesic2d_transformed(torch::Tensor &image, const torch::Tensor &mask, const float &v, const float &l_grad, const float &l_eucl, const int &iterations, const float &clip, const bool &normalise, const float &decay, const std::vector<float> &sigma, const bool &box)
+{
+    const OutputTransform transform = make_output_transform(clip, normalise, decay);
+    const Presmoothing smoothing = make_presmoothing(sigma, box, 2);
+    if (image.is_cuda())
+    {
+        torch::Tensor image_smoothed = smoothing.enabled() ? smooth_image(image, smoothing, {1.0, 1.0}) : image;
+        return output_transform(generalised_geodesic2d(image_smoothed, mask, v, l_grad, l_eucl, iterations), transform);
+    }
+
+    check_input_dimensions(image, mask, 4);
+    check_cpu(mask);
+    return cached_geodesic2d_cpu(image, mask, v, l_grad, l_eucl, iterations, transform, smoothing);
+}
+
+torch::Tensor generalised_geodesic3d_transformed(torch::Tensor &image, const torch::Tensor &mask, const std::vector<float> &spacing, const float &v, const float &l_grad, const float &l_eucl, const int &iterations, const float &clip, const bool &normalise, const float &decay, const std::vector<float> &sigma, const bool &box)
+{
+    const OutputTransform transform = make_output_transform(clip, normalise, decay);
+    const Presmoothing smoothing = make_presmoothing(sigma, box, 3);
+    if (image.is_cuda())
+    {
+        if (spacing.size() != 3)
+        {
+            throw std::invalid_argument(
+                "function only supports 3D spacing inputs, received " + std::to_string(spacing.size()));
+        }
+        torch::Tensor image_smoothed = smoothing.enabled() ? smooth_image(image, smoothing, spacing) : image;
+        return output_transform(generalised_geodesic3d(image_smoothed, mask, spacing, v, l_grad, l_eucl, iterations), transform);
+    }
+
+    check_cpu_inputs(image, mask, 5, spacing);
+    return cached_geodesic3d_cpu(image, mask, spacing, v, l_grad, l_eucl, iterations, transform, smoothing);
+}
+
+std::map<std::string, std::vector<double>> stats_dict(const GeodesicStats &stats, const double &total_ms)
+{
+    return {
+        {"pass_ms", stats.pass_ms},
+        {"pass_improved", stats.pass_improved},
+        {"iteration_ms", stats.iteration_ms},
+        {"total_ms", {total_ms}},
+        {"bytes_allocated", {double(stats.bytes_allocated)}},
+        {"threads", {double(stats.threads)}}};
+}
+
+std::tuple<torch::Tensor, std::map<std::string, std::vector<double>>> generalised_geodesic2d_stats(torch::Tensor &image, const torch::Tensor &mask, const float &v, const float &l_grad, const float &l_eucl, const int &iterations, const float &clip, const bool &normalise, const float &decay, const std::vector<float> &sigma, const bool &box)
+{
+    check_cpu_inputs(image, mask, 4, {});
+    const OutputTransform transform = make_output_transform(clip, normalise, decay);
+    const Presmoothing smoothing = make_presmoothing(sigma, box, 2);
+
+    GeodesicStats stats;
+    GeodesicStatsScope scope(&stats);
+    const auto tic = std::chrono::steady_clock::now();
+    torch::Tensor distance = generalised_geodesic2d_cpu(image, mask, v, l_grad, l_eucl, iterations, transform, smoothing);
+    const double total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tic).count();
+    return {distance, stats_dict(stats, total_ms)};
+}
+
+std::tuple<torch::Tensor, std::map<std::string, std::vector<double>>> generalised_geodesic3d_stats(torch::Tensor &image, const torch::Tensor &mask, const std::vector<float> &spacing, const float &v, const float &l_grad, const float &l_eucl, const int &iterations, const float &clip, const bool &normalise, const float &decay, const std::vector<float> &sigma, const bool &box)
+{
+    check_cpu_inputs(image, mask, 5, spacing);
+    const OutputTransform transform = make_output_transform(clip, normalise, decay);
+    const Presmoothing smoothing = make_presmoothing(sigma, box, 3);
+
+    GeodesicStats stats;
+    GeodesicStatsScope scope(&stats);
+    const auto tic = std::chrono::steady_clock::now();
+    torch::Tensor distance = generalised_geodesic3d_cpu(image, mask, spacing, v, l_grad, l_eucl, iterations, transform, smoothing);
+    const double total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tic).count();
+    return {distance, stats_dict(stats, total_ms)};
+}
+
+torch::Tensor generalised_geodesic2d_approx(torch::Tensor &image, const torch::Tensor &mask, const float &v, const float &l_grad, const float &l_eucl, const int &iterations, const int &factor, const float &clip, const bool &normalise, const float &decay, const std::vector<float> &sigma, const bool &box)
+{
+    // runs on a grid downsampled by factor, the image is averaged and the mask is min-pooled so that no seed is lost,
+    // euclidean steps are scaled by factor to keep distances in full resolution pixels
+    check_input_dimensions(image, mask, 4);
+    if (factor < 1)
+    {
+        throw std::invalid_argument("approx_factor must be at least 1, received " + std::to_string(factor));
+    }
+    if (factor == 1)
+    {
+        return generalised_geodesic2d_transformed(image, mask, v, l_grad, l_eucl, iterations, clip, normalise, decay, sigma, box);
+    }
+
+    torch::Tensor image_s = torch::avg_pool2d(image, {factor, factor}, {factor, factor}, {0, 0}, true, false).contiguous();
+    torch::Tensor mask_s = (-torch::max_pool2d(-mask, {factor, factor}, {factor, factor}, {0, 0}, {1, 1}, true)).contiguous();
+    // sigma stays in full resolution pixels on the coarse grid
+    std::vector<float> sigma_s(sigma);
+    for (float &s : sigma_s)
+    {
+        s /= factor;
+    }
+    torch::Tensor distance_s = generalised_geodesic2d_transformed(image_s, mask_s, v, l_grad, l_eucl * factor, iterations, clip, normalise, decay, sigma_s, box);
+
+    return torch::upsample_bilinear2d(distance_s.contiguous(), {mask.size(2), mask.size(3)}, false, double(factor), double(factor));
+}
+
+torch::Tensor generalised_geodesic3d_approx(torch::Tensor &image, const torch::Tensor &mask, const std::vector<float> &spacing, const float &v, const float &l_grad, const float &l_eucl, const int &iterations, const int &factor, const float &clip, const bool &normalise, const float &decay, const std::vector<float> &sigma, const bool &box)
+{
+    // runs on a grid downsampled by factor, the image is averaged and the mask is min-pooled so that no seed is lost,
+    // spacing is scaled by factor to keep distances in full resolution units
+    check_input_dimensions(image, mask, 5);
+    if (factor < 1)
+    {
+        throw std::invalid_argument("approx_factor must be at least 1, received " + std::to_string(factor));
+    }
+    if (factor == 1)
+    {
+        return generalised_geodesic3d_transformed(image, mask, spacing, v, l_grad, l_eucl, iterations, clip, normalise, decay, sigma, box);
+    }
+    if (spacing.size() != 3)
+    {
+        throw std::invalid_argument(
+            "function only supports 3D spacing inputs, received " + std::to_string(spacing.size()));
+    }
+
+    std::vector<float> spacing_s(spacing);
+    for (float &sp : spacing_s)
+    {
+        sp *= factor;
+    }
+    torch::Tensor image_s = torch::avg_pool3d(image, {factor, factor, factor}, {factor, factor, factor}, {0, 0, 0}, true, false).contiguous();
+    torch::Tensor mask_s = (-torch::max_pool3d(-mask, {factor, factor, factor}, {factor, factor, factor}, {0, 0, 0}, {1, 1, 1}, true)).contiguous();
+    torch::Tensor distance_s = generalised_geodesic3d_transformed(image_s, mask_s, spacing_s, v, l_grad, l_eucl, iterations, clip, normalise, decay, sigma, box);
+
+    return torch::upsample_trilinear3d(distance_s.contiguous(), {mask.size(2), mask.size(3), mask.size(4)}, false, double(factor), double(factor), double(factor));
+}
+
+torch::Tensor filter_empty(const torch::Tensor &like, const int64_t &channels = 1)
+{
+    // full size temporaries of the signed distance and GSF, cpu ones are taken from the workspace so that
+    // their high-water mark can be compared with estimate_memory()
+    std::vector<int64_t> sizes = like.sizes().vec();
+    sizes[1] = channels;
+    if (like.is_cuda())
+    {
+        return torch::empty(sizes, like.options().dtype(torch::kFloat));
+    }
+    return workspace_empty(sizes, torch::kFloat);
+}
+
+torch::Tensor complement_mask(const torch::Tensor &mask)
+{
+    return filter_empty(mask).fill_(1).sub_(mask);
+}
+
+torch::Tensor threshold_mask(const torch::Tensor &distance, const float &theta)
+{
+    return filter_empty(distance).copy_(distance).gt_(theta);
+}
+
+torch::Tensor distance_difference(const torch::Tensor &a, const torch::Tensor &b)
+{
+    return filter_empty(a).copy_(a).sub_(b);
 }
 
 torch::Tensor getDs2d(torch::Tensor &image, const torch::Tensor &mask, const float &v, const float &l_grad, const float &l_eucl, const int &iterations)
 {
+    TraceSpan span("signed distance");
     torch::Tensor D_M = generalised_geodesic2d(image, mask, v, l_grad, l_eucl, iterations);
-    torch::Tensor D_Mb = generalised_geodesic2d(image, 1 - mask, v, l_grad, l_eucl, iterations);
+    torch::Tensor D_Mb = generalised_geodesic2d(image, complement_mask(mask), v, l_grad, l_eucl, iterations);
 
-    return D_M - D_Mb;
+    return distance_difference(D_M, D_Mb);
 }
 
 torch::Tensor GSF2d(torch::Tensor &image, const torch::Tensor &mask, const float &theta, const float &v, const float &lambda, const int &iterations)
 {
+    TraceSpan span("GSF2d");
     torch::Tensor Ds_M = getDs2d(image, mask, v, lambda, 1 - lambda, iterations);
 
-    torch::Tensor Md = (Ds_M > theta).type_as(Ds_M);
-    torch::Tensor Me = (Ds_M > -theta).type_as(Ds_M);
+    TraceSpan threshold("threshold");
+    torch::Tensor Md = threshold_mask(Ds_M, theta);
+    torch::Tensor Me = threshold_mask(Ds_M, -theta);
+    threshold.end();
+    Ds_M.reset();
 
-    torch::Tensor Dd_Md = -getDs2d(image, 1 - Md, v, lambda, 1 - lambda, iterations);
+    torch::Tensor Dd_Md = getDs2d(image, complement_mask(Md), v, lambda, 1 - lambda, iterations).neg_();
     torch::Tensor De_Me = getDs2d(image, Me, v, lambda, 1 - lambda, iterations);
 
-    return Dd_Md + De_Me;
+    return Dd_Md.add_(De_Me);
 }
 
 torch::Tensor getDs3d(torch::Tensor &image, const torch::Tensor &mask, const std::vector<float> &spacing, const float &v, const float &l_grad, const float &l_eucl, const int &iterations)
 {
+    TraceSpan span("signed distance");
     torch::Tensor D_M = generalised_geodesic3d(image, mask, spacing, v, l_grad, l_eucl, iterations);
-    torch::Tensor D_Mb = generalised_geodesic3d(image, 1 - mask, spacing, v, l_grad, l_eucl, iterations);
+    torch::Tensor D_Mb = generalised_geodesic3d(image, complement_mask(mask), spacing, v, l_grad, l_eucl, iterations);
 
-    return D_M - D_Mb;
+    return distance_difference(D_M, D_Mb);
 }
 
 torch::Tensor GSF3d(torch::Tensor &image, const torch::Tensor &mask, const float &theta, const std::vector<float> &spacing, const float &v, const float &lambda, const int &iterations)
 {
+    TraceSpan span("GSF3d");
     torch::Tensor Ds_M = getDs3d(image, mask, spacing, v, lambda, 1 - lambda, iterations);
 
-    torch::Tensor Md = (Ds_M > theta).type_as(Ds_M);
-    torch::Tensor Me = (Ds_M > -theta).type_as(Ds_M);
+    TraceSpan threshold("threshold");
+    torch::Tensor Md = threshold_mask(Ds_M, theta);
+    torch::Tensor Me = threshold_mask(Ds_M, -theta);
+    threshold.end();
+    Ds_M.reset();
 
-    torch::Tensor Dd_Md = -getDs3d(image, 1 - Md, spacing, v, lambda, 1 - lambda, iterations);
+    torch::Tensor Dd_Md = getDs3d(image, complement_mask(Md), spacing, v, lambda, 1 - lambda, iterations).neg_();
     torch::Tensor De_Me = getDs3d(image, Me, spacing, v, lambda, 1 - lambda, iterations);
 
-    return Dd_Md + De_Me;
+    return Dd_Md.add_(De_Me);
+}
+
+torch::Tensor generalised_geodesic_multi2d(torch::Tensor &image, const torch::Tensor &masks, const float &v, const float &l_grad, const float &l_eucl, const int &iterations)
+{
+    // distance transform of each mask channel, sharing the sweeps on CPU
+    if (image.is_cuda())
+    {
+        std::vector<torch::Tensor> distances;
+        for (int64_t m = 0; m < masks.size(1); m++)
+        {
+            distances.push_back(generalised_geodesic2d(image, masks.narrow(1, m, 1).contiguous(), v, l_grad, l_eucl, iterations));
+        }
+        return torch::cat(distances, 1);
+    }
+    check_cpu(masks);
+    return generalised_geodesic_multi_cpu(image, masks, {1.0, 1.0}, v, l_grad, l_eucl, iterations);
+}
+
+torch::Tensor generalised_geodesic_multi3d(torch::Tensor &image, const torch::Tensor &masks, const std::vector<float> &spacing, const float &v, const float &l_grad, const float &l_eucl, const int &iterations)
+{
+    // distance transform of each mask channel, sharing the sweeps on CPU
+    if (image.is_cuda())
+    {
+        std::vector<torch::Tensor> distances;
+        for (int64_t m = 0; m < masks.size(1); m++)
+        {
+            distances.push_back(generalised_geodesic3d(image, masks.narrow(1, m, 1).contiguous(), spacing, v, l_grad, l_eucl, iterations));
+        }
+        return torch::cat(distances, 1);
+    }
+    check_cpu(masks);
+    return generalised_geodesic_multi_cpu(image, masks, spacing, v, l_grad, l_eucl, iterations);
+}
+
+template <typename Transform>
+torch::Tensor GSF_multi(const torch::Tensor &mask, const std::vector<float> &thetas, Transform transform)
+{
+    // transform maps masks stacked along channels to their distances, stage one runs once for all thetas
+    // and stage two runs the four transforms of every theta together. inputs of each stage are released
+    // before the next allocation, so that the peak is the masks and distances of stage two
+    const int64_t num_thetas = thetas.size();
+    torch::Tensor first = filter_empty(mask, 2);
+    first.narrow(1, 0, 1).copy_(mask);
+    first.narrow(1, 1, 1).fill_(1).sub_(mask);
+    torch::Tensor D_first = transform(first);
+    first.reset();
+    torch::Tensor Ds_M = distance_difference(D_first.narrow(1, 0, 1), D_first.narrow(1, 1, 1));
+    D_first.reset();
+
+    TraceSpan threshold("threshold");
+    torch::Tensor masks = filter_empty(mask, 4 * num_thetas);
+    for (int64_t t = 0; t < num_thetas; t++)
+    {
+        torch::Tensor Md = masks.narrow(1, 4 * t + 1, 1).copy_(Ds_M).gt_(thetas[t]);
+        torch::Tensor Me = masks.narrow(1, 4 * t + 2, 1).copy_(Ds_M).gt_(-thetas[t]);
+        masks.narrow(1, 4 * t, 1).fill_(1).sub_(Md);
+        masks.narrow(1, 4 * t + 3, 1).fill_(1).sub_(Me);
+    }
+    threshold.end();
+    Ds_M.reset();
+    torch::Tensor D_second = transform(masks);
+    masks.reset();
+
+    // same operations as GSF2d/3d, so that every channel matches its theta alone
+    torch::Tensor out = filter_empty(mask, num_thetas);
+    for (int64_t t = 0; t < num_thetas; t++)
+    {
+        torch::Tensor De_Me = D_second.narrow(1, 4 * t + 2, 1).sub_(D_second.narrow(1, 4 * t + 3, 1));
+        out.narrow(1, t, 1).copy_(D_second.narrow(1, 4 * t, 1)).sub_(D_second.narrow(1, 4 * t + 1, 1)).neg_().add_(De_Me);
+    }
+    return out;
+}
+
+torch::Tensor GSF2d_multi(torch::Tensor &image, const torch::Tensor &mask, const std::vector<float> &thetas, const float &v, const float &lambda, const int &iterations)
+{
+    check_input_dimensions(image, mask, 4);
+
+    return GSF_multi(mask, thetas, [&](const torch::Tensor &masks)
+    {
+        return generalised_geodesic_multi2d(image, masks, v, lambda, 1 - lambda, iterations);
+    });
+}
+
+torch::Tensor GSF3d_multi(torch::Tensor &image, const torch::Tensor &mask, const std::vector<float> &thetas, const std::vector<float> &spacing, const float &v, const float &lambda, const int &iterations)
+{
+    check_input_dimensions(image, mask, 5);
+    if (spacing.size() != 3)
+    {
+        throw std::invalid_argument(
+            "function only supports 3D spacing inputs, received " + std::to_string(spacing.size()));
+    }
+
+    return GSF_multi(mask, thetas, [&](const torch::Tensor &masks)
+    {
+        return generalised_geodesic_multi3d(image, masks, spacing, v, lambda, 1 - lambda, iterations);
+    });
+}
+
+template <typename Transform>
+std::tuple<torch::Tensor, torch::Tensor> GeoS(const torch::Tensor &image, const torch::Tensor &fg, const torch::Tensor &bg, const std::vector<float> &thetas_d, const std::vector<float> &thetas_e, const std::vector<float> &spacing, const float &gamma, Transform transform)
+{
+    // Criminisi et al., GeoS: Geodesic image segmentation, ECCV 2008
+    // candidate segmentations filter the likelihood ratio with GSF for every pair of theta_d, theta_e,
+    // the one with the lowest energy of unary and contrast sensitive boundary terms is returned
+    if (thetas_d.empty() || thetas_e.empty())
+    {
+        throw std::invalid_argument("GeoS requires at least one theta_d and one theta_e");
+    }
+    if (gamma < 0)
+    {
+        throw std::invalid_argument("gamma must be non-negative, received " + std::to_string(gamma));
+    }
+
+    // the likelihood ratio is the softmask as it is, so that certain voxels are exact seeds of the distances
+    const float eps = 1e-6;
+    torch::Tensor sum = fg + bg;
+    torch::Tensor M = torch::where(sum > 0, fg / sum.clamp_min(eps), torch::full_like(sum, 0.5));
+
+    // signed distance of the likelihood ratio, then dilation and erosion distances of each theta in one batch
+    torch::Tensor D_first = transform(torch::cat({M, 1 - M}, 1));
+    torch::Tensor Ds_M = D_first.narrow(1, 0, 1) - D_first.narrow(1, 1, 1);
+
+    TraceSpan threshold("threshold");
+    std::vector<torch::Tensor> masks;
+    for (const float &theta_d : thetas_d)
+    {
+        torch::Tensor Md = (Ds_M > theta_d).type_as(Ds_M);
+        masks.push_back(1 - Md);
+        masks.push_back(Md);
+    }
+    for (const float &theta_e : thetas_e)
+    {
+        torch::Tensor Me = (Ds_M > -theta_e).type_as(Ds_M);
+        masks.push_back(Me);
+        masks.push_back(1 - Me);
+    }
+    threshold.end();
+    torch::Tensor D_second = transform(torch::cat(masks, 1));
+    const int64_t num_d = thetas_d.size();
+
+    // energies of all candidates in one pass over the voxels on cpu, keeping only the best segmentation
+    TraceSpan energy("energy");
+    torch::Tensor segmentation, energies;
+    std::tie(segmentation, energies) = geos_energy_cpu(
+        image.cpu().contiguous(), M.cpu().contiguous(), D_second.cpu().contiguous(),
+        num_d, thetas_e.size(), spacing, gamma);
+    energy.end();
+
+    return std::make_tuple(segmentation.to(image.device()), energies);
+}
+
+std::tuple<torch::Tensor, torch::Tensor> GeoS2d(torch::Tensor &image, const torch::Tensor &fg, const torch::Tensor &bg, const std::vector<float> &thetas_d, const std::vector<float> &thetas_e, const float &v, const float &lambda, const float &gamma, const int &iterations)
+{
+    check_input_dimensions(image, fg, 4);
+    check_input_dimensions(image, bg, 4);
+
+    return GeoS(image, fg, bg, thetas_d, thetas_e, {1.0, 1.0}, gamma, [&](const torch::Tensor &masks)
+    {
+        return generalised_geodesic_multi2d(image, masks, v, lambda, 1 - lambda, iterations);
+    });
+}
+
+std::tuple<torch::Tensor, torch::Tensor> GeoS3d(torch::Tensor &image, const torch::Tensor &fg, const torch::Tensor &bg, const std::vector<float> &thetas_d, const std::vector<float> &thetas_e, const std::vector<float> &spacing, const float &v, const float &lambda, const float &gamma, const int &iterations)
+{
+    check_input_dimensions(image, fg, 5);
+    check_input_dimensions(image, bg, 5);
+    if (spacing.size() != 3)
+    {
+        throw std::invalid_argument(
+            "function only supports 3D spacing inputs, received " + std::to_string(spacing.size()));
+    }
+
+    return GeoS(image, fg, bg, thetas_d, thetas_e, spacing, gamma, [&](const torch::Tensor &masks)
+    {
+        return generalised_geodesic_multi3d(image, masks, spacing, v, lambda, 1 - lambda, iterations);
+    });
+}
+
+
+std::tuple<torch::Tensor, torch::Tensor> generalised_geodesic_knn2d(torch::Tensor &image, const torch::Tensor &labels, const int &k, const float &l_grad, const float &l_eucl, const int &iterations)
+{
+    check_cpu_inputs(image, labels, 4, {});
+
+    if (k < 1)
+    {
+        throw std::invalid_argument("number of nearest seeds k must be at least 1, received " + std::to_string(k));
+    }
+
+    return generalised_geodesic_knn_cpu(image, labels, k, {1.0, 1.0}, l_grad, l_eucl, iterations);
+}
+
+std::tuple<torch::Tensor, torch::Tensor> generalised_geodesic_knn3d(torch::Tensor &image, const torch::Tensor &labels, const int &k, const std::vector<float> &spacing, const float &l_grad, const float &l_eucl, const int &iterations)
+{
+    check_cpu_inputs(image, labels, 5, spacing);
+
+    if (k < 1)
+    {
+        throw std::invalid_argument("number of nearest seeds k must be at least 1, received " + std::to_string(k));
+    }
+
+    return generalised_geodesic_knn_cpu(image, labels, k, spacing, l_grad, l_eucl, iterations);
+}
+
+
+void check_click_inputs(const torch::Tensor &image, const torch::Tensor &labels, const int &num_dims, const int &fg_clicks, const int &bg_clicks)
+{
+    // batches of samples, one label channel per sample
+    check_data_dim(image, num_dims);
+    check_data_dim(labels, num_dims);
+    check_spatial_shape_match(image, labels, num_dims - 2);
+    check_cpu(image);
+    check_cpu(labels);
+
+    if (labels.size(0) != image.size(0) || labels.size(1) != 1)
+    {
+        throw std::invalid_argument("labels must have the batch size of image and a single channel");
+    }
+    if (fg_clicks < 0 || bg_clicks < 0)
+    {
+        throw std::invalid_argument("number of clicks must be non-negative");
+    }
+}
+
+std::tuple<torch::Tensor, torch::Tensor> simulate_click_guidance2d(torch::Tensor &image, const torch::Tensor &labels, const int &fg_clicks, const int &bg_clicks, const float &v, const float &l_grad, const float &l_eucl, const int &iterations, const int64_t &seed)
+{
+    check_click_inputs(image, labels, 4, fg_clicks, bg_clicks);
+    return simulate_click_guidance_cpu(image, labels, fg_clicks, bg_clicks, {1.0, 1.0}, v, l_grad, l_eucl, iterations, seed);
+}
+
+std::tuple<torch::Tensor, torch::Tensor> simulate_click_guidance3d(torch::Tensor &image, const torch::Tensor &labels, const int &fg_clicks, const int &bg_clicks, const std::vector<float> &spacing, const float &v, const float &l_grad, const float &l_eucl, const int &iterations, const int64_t &seed)
+{
+    check_click_inputs(image, labels, 5, fg_clicks, bg_clicks);
+    if (spacing.size() != 3)
+    {
+        throw std::invalid_argument(
+            "function only supports 3D spacing inputs, received " + std::to_string(spacing.size()));
+    }
+    return simulate_click_guidance_cpu(image, labels, fg_clicks, bg_clicks, spacing, v, l_grad, l_eucl, iterations, seed);
+}
+
+
+std::tuple<torch::Tensor, torch::Tensor> generalised_geodesic_parent2d(torch::Tensor &image, const torch::Tensor &mask, const float &v, const float &l_grad, const float &l_eucl, const int &iterations)
+{
+    check_cpu_inputs(image, mask, 4, {});
+    return generalised_geodesic_parent_cpu(image, mask, {1.0, 1.0}, v, l_grad, l_eucl, iterations);
+}
+
+std::tuple<torch::Tensor, torch::Tensor> generalised_geodesic_parent3d(torch::Tensor &image, const torch::Tensor &mask, const std::vector<float> &spacing, const float &v, const float &l_grad, const float &l_eucl, const int &iterations)
+{
+    check_cpu_inputs(image, mask, 5, spacing);
+    return generalised_geodesic_parent_cpu(image, mask, spacing, v, l_grad, l_eucl, iterations);
+}
+
+std::tuple<torch::Tensor, torch::Tensor> generalised_geodesic_exact2d(torch::Tensor &image, const torch::Tensor &mask, const float &v, const float &l_grad, const float &l_eucl)
+{
+    check_cpu_inputs(image, mask, 4, {});
+    return generalised_geodesic_exact_cpu(image, mask, {1.0, 1.0}, v, l_grad, l_eucl);
+}
+
+std::tuple<torch::Tensor, torch::Tensor> generalised_geodesic_exact3d(torch::Tensor &image, const torch::Tensor &mask, const std::vector<float> &spacing, const float &v, const float &l_grad, const float &l_eucl)
+{
+    check_cpu_inputs(image, mask, 5, spacing);
+    return generalised_geodesic_exact_cpu(image, mask, spacing, v, l_grad, l_eucl);
+}
+
+void check_superpixel_args(const int &superpixel_size, const float &compactness)
+{
+    if (superpixel_size < 1)
+    {
+        throw std::invalid_argument("superpixel_size must be at least 1, received " + std::to_string(superpixel_size));
+    }
+    if (compactness <= 0)
+    {
+        throw std::invalid_argument("compactness must be positive");
+    }
+}
+
+torch::Tensor generalised_geodesic_superpixel2d(torch::Tensor &image, const torch::Tensor &mask, const float &v, const float &l_grad, const float &l_eucl, const int &superpixel_size, const float &compactness)
+{
+    check_cpu_inputs(image, mask, 4, {});
+    check_superpixel_args(superpixel_size, compactness);
+    return generalised_geodesic_superpixel_cpu(image, mask, {1.0, 1.0}, v, l_grad, l_eucl, superpixel_size, compactness);
+}
+
+torch::Tensor generalised_geodesic_superpixel3d(torch::Tensor &image, const torch::Tensor &mask, const std::vector<float> &spacing, const float &v, const float &l_grad, const float &l_eucl, const int &superpixel_size, const float &compactness)
+{
+    check_cpu_inputs(image, mask, 5, spacing);
+    check_superpixel_args(superpixel_size, compactness);
+    return generalised_geodesic_superpixel_cpu(image, mask, spacing, v, l_grad, l_eucl, superpixel_size, compactness);
+}
+
+void check_relax_distance(const torch::Tensor &distance)
+{
+    // the distance is updated in place, a copy would silently drop the result
+    if (distance.scalar_type() != torch::kFloat || !distance.is_contiguous())
+    {
+        throw std::invalid_argument("distance must be a contiguous float tensor as it is updated in place");
+    }
+    if (distance.size(1) != 1)
+    {
+        throw std::invalid_argument("distance must have a single channel");
+    }
+}
+
+int64_t generalised_geodesic_relax2d(torch::Tensor &image, torch::Tensor &distance, const float &l_grad, const float &l_eucl, const int &iterations)
+{
+    check_cpu_inputs(image, distance, 4, {});
+    check_relax_distance(distance);
+    return generalised_geodesic_relax_cpu(image, distance, {1.0, 1.0}, l_grad, l_eucl, iterations);
+}
+
+int64_t generalised_geodesic_relax3d(torch::Tensor &image, torch::Tensor &distance, const std::vector<float> &spacing, const float &l_grad, const float &l_eucl, const int &iterations)
+{
+    check_cpu_inputs(image, distance, 5, spacing);
+    check_relax_distance(distance);
+    return generalised_geodesic_relax_cpu(image, distance, spacing, l_grad, l_eucl, iterations);
+}
+
+int batch_schedule(const std::string &schedule)
+{
+    if (schedule == "nested")
+        return 0;
+    if (schedule == "batch")
+        return 1;
+    if (schedule == "image")
+        return 2;
+    throw std::invalid_argument("schedule must be one of nested, batch or image, received " + schedule);
+}
+
+std::vector<torch::Tensor> generalised_geodesic_batch(const std::vector<torch::Tensor> &images, const std::vector<torch::Tensor> &masks, const std::vector<float> &spacing, const float &v, const float &l_grad, const float &l_eucl, const int &iterations, const int &num_threads, const std::string &schedule, const int &num_dims)
+{
+    if (images.size() != masks.size())
+    {
+        throw std::invalid_argument("number of images and masks do not match");
+    }
+    const int mode = batch_schedule(schedule);
+
+    bool on_cuda = false;
+    for (size_t b = 0; b < images.size(); b++)
+    {
+        check_input_dimensions(images[b], masks[b], num_dims + 2);
+        on_cuda = on_cuda || images[b].is_cuda();
+    }
+    if (num_dims == 3 && spacing.size() != 3)
+    {
+        throw std::invalid_argument(
+            "function only supports 3D spacing inputs, received " + std::to_string(spacing.size()));
+    }
+
+    if (on_cuda)
+    {
+        // each transform fills the device, images run one after the other
+        std::vector<torch::Tensor> distances;
+        for (size_t b = 0; b < images.size(); b++)
+        {
+            torch::Tensor image = images[b];
+            distances.push_back(num_dims == 3 ? generalised_geodesic3d(image, masks[b], spacing, v, l_grad, l_eucl, iterations) : generalised_geodesic2d(image, masks[b], v, l_grad, l_eucl, iterations));
+        }
+        return distances;
+    }
+
+    for (size_t b = 0; b < images.size(); b++)
+    {
+        check_cpu(masks[b]);
+        // checked before the parallel region of the batch engine, like the single image engines would
+        if (images[b].scalar_type() != torch::kFloat)
+        {
+            throw std::invalid_argument("image " + std::to_string(b) + " of the batch is not float32, try using image.float()");
+        }
+    }
+    return generalised_geodesic_batch_cpu(images, masks, spacing, v, l_grad, l_eucl, iterations, num_threads, mode);
+}
+
+std::vector<torch::Tensor> generalised_geodesic2d_batch(const std::vector<torch::Tensor> &images, const std::vector<torch::Tensor> &masks, const float &v, const float &l_grad, const float &l_eucl, const int &iterations, const int &num_threads, const std::string &schedule)
+{
+    return generalised_geodesic_batch(images, masks, {1.0, 1.0}, v, l_grad, l_eucl, iterations, num_threads, schedule, 2);
+}
+
+std::vector<torch::Tensor> generalised_geodesic3d_batch(const std::vector<torch::Tensor> &images, const std::vector<torch::Tensor> &masks, const std::vector<float> &spacing, const float &v, const float &l_grad, const float &l_eucl, const int &iterations, const int &num_threads, const std::string &schedule)
+{
+    return generalised_geodesic_batch(images, masks, spacing, v, l_grad, l_eucl, iterations, num_threads, schedule, 3);
+}
+
+std::vector<torch::Tensor> geodesic_backtrack(const torch::Tensor &parent, const torch::Tensor &points)
+{
+    check_cpu(parent);
+    check_cpu(points);
+    check_single_batch(parent);
+
+    const int num_dims = parent.dim() - 2;
+    if (num_dims != 2 && num_dims != 3)
+    {
+        throw std::invalid_argument(
+            "function only supports 2D or 3D parent maps, received " + std::to_string(num_dims));
+    }
+    if (parent.scalar_type() != torch::kByte)
+    {
+        throw std::invalid_argument("parent map must be of type uint8");
+    }
+
+    return geodesic_backtrack_cpu(parent, points);
+}
+
+std::tuple<torch::Tensor, torch::Tensor, torch::Tensor, torch::Tensor> generalised_geodesic_backward(const torch::Tensor &image, const torch::Tensor &parent, const torch::Tensor &grad_distance, const std::vector<float> &spacing, const float &v, const float &l_grad, const float &l_eucl)
+{
+    check_cpu(image);
+    check_cpu(parent);
+    check_cpu(grad_distance);
+    check_single_batch(image);
+
+    const int num_dims = image.dim() - 2;
+    if (num_dims != 2 && num_dims != 3)
+    {
+        throw std::invalid_argument(
+            "function only supports 2D or 3D inputs, received " + std::to_string(num_dims));
+    }
+    if (spacing.size() != size_t(num_dims))
+    {
+        throw std::invalid_argument(
+            "spacing must have " + std::to_string(num_dims) + " elements, received " + std::to_string(spacing.size()));
+    }
+    if (parent.scalar_type() != torch::kByte)
+    {
+        throw std::invalid_argument("parent map must be of type uint8");
+    }
+    bool same_shape = parent.dim() == image.dim() && parent.size(0) == 1 && parent.size(1) == 1;
+    for (int i = 2; same_shape && i < image.dim(); i++)
+    {
+        same_shape = parent.size(i) == image.size(i);
+    }
+    if (!same_shape)
+    {
+        throw std::invalid_argument("parent map must have one channel and the spatial shape of image");
+    }
+    if (grad_distance.sizes() != parent.sizes())
+    {
+        throw std::invalid_argument("grad_distance must have the shape of the parent map");
+    }
+
+    return generalised_geodesic_backward_cpu(image, parent, grad_distance, spacing, v, l_grad, l_eucl);
+}
+
+std::tuple<torch::Tensor, torch::Tensor, std::vector<torch::Tensor>> geodesic_query2d(torch::Tensor &image, const torch::Tensor &mask, const torch::Tensor &points, const float &v, const float &l_grad, const float &l_eucl, const bool &return_path)
+{
+    check_cpu_inputs(image, mask, 4, {});
+    check_cpu(points);
+    return geodesic_query_cpu(image, mask, points, {1.0, 1.0}, v, l_grad, l_eucl, return_path);
+}
+
+std::tuple<torch::Tensor, torch::Tensor, std::vector<torch::Tensor>> geodesic_query3d(torch::Tensor &image, const torch::Tensor &mask, const torch::Tensor &points, const std::vector<float> &spacing, const float &v, const float &l_grad, const float &l_eucl, const bool &return_path)
+{
+    check_cpu_inputs(image, mask, 5, spacing);
+    check_cpu(points);
+    return geodesic_query_cpu(image, mask, points, spacing, v, l_grad, l_eucl, return_path);
 }
 
 
 PYBIND11_MODULE(TORCH_EXTENSION_NAME, m)
 {
     m.def("generalised_geodesic2d", &generalised_geodesic2d, "Generalised Geodesic distance 2d");
+    m.def("generalised_geodesic2d_transformed", &generalised_geodesic2d_transformed, "Generalised Geodesic distance 2d with pre-smoothing and output transform");
+    m.def("generalised_geodesic3d_transformed", &generalised_geodesic3d_transformed, "Generalised Geodesic distance 3d with pre-smoothing and output transform");
+    m.def("generalised_geodesic2d_approx", &generalised_geodesic2d_approx, "Approximate Generalised Geodesic distance 2d on a downsampled grid");
+    m.def("generalised_geodesic3d_approx", &generalised_geodesic3d_approx, "Approximate Generalised Geodesic distance 3d on a downsampled grid");
+    m.def("generalised_geodesic2d_stats", &generalised_geodesic2d_stats, "Generalised Geodesic distance 2d with per pass statistics");
+    m.def("generalised_geodesic3d_stats", &generalised_geodesic3d_stats, "Generalised Geodesic distance 3d with per pass statistics");
     m.def("GSF2d", &GSF2d, "Geodesic Symmetric Filtering 2d");
     m.def("signed_generalised_geodesic2d", &getDs2d, "Signed Generalised Geodesic distance 2d");
     m.def("generalised_geodesic3d", &generalised_geodesic3d, "Generalised Geodesic distance 3d");
     m.def("GSF3d", &GSF3d, "Geodesic Symmetric Filtering 3d");
+    m.def("GSF2d_multi", &GSF2d_multi, "Geodesic Symmetric Filtering 2d for multiple thetas");
+    m.def("GSF3d_multi", &GSF3d_multi, "Geodesic Symmetric Filtering 3d for multiple thetas");
+    m.def("GeoS2d", &GeoS2d, "Geodesic image segmentation 2d");
+    m.def("GeoS3d", &GeoS3d, "Geodesic image segmentation 3d");
     m.def("signed_generalised_geodesic3d", &getDs3d, "Signed Generalised Geodesic distance 3d");
+    m.def("generalised_geodesic_knn2d", &generalised_geodesic_knn2d, "Generalised Geodesic distance to k nearest seed labels 2d");
+    m.def("generalised_geodesic_knn3d", &generalised_geodesic_knn3d, "Generalised Geodesic distance to k nearest seed labels 3d");
+    m.def("simulate_click_guidance2d", &simulate_click_guidance2d, "Geodesic guidance maps of simulated clicks 2d");
+    m.def("simulate_click_guidance3d", &simulate_click_guidance3d, "Geodesic guidance maps of simulated clicks 3d");
+    m.def("generalised_geodesic_parent2d", &generalised_geodesic_parent2d, "Generalised Geodesic distance and parent map 2d");
+    m.def("generalised_geodesic_parent3d", &generalised_geodesic_parent3d, "Generalised Geodesic distance and parent map 3d");
+    m.def("generalised_geodesic_exact2d", &generalised_geodesic_exact2d, "Exact Generalised Geodesic distance and parent map 2d");
+    m.def("generalised_geodesic_exact3d", &generalised_geodesic_exact3d, "Exact Generalised Geodesic distance and parent map 3d");
+    m.def("generalised_geodesic_superpixel2d", &generalised_geodesic_superpixel2d, "Generalised Geodesic distance 2d over a superpixel graph");
+    m.def("generalised_geodesic_superpixel3d", &generalised_geodesic_superpixel3d, "Generalised Geodesic distance 3d over a superpixel graph");
+    m.def("generalised_geodesic_relax2d", &generalised_geodesic_relax2d, "In-place raster passes over an existing distance 2d");
+    m.def("generalised_geodesic_relax3d", &generalised_geodesic_relax3d, "In-place raster passes over an existing distance 3d");
+    m.def("generalised_geodesic2d_batch", &generalised_geodesic2d_batch, "Generalised Geodesic distance 2d of a batch of images with nested scheduling");
+    m.def("generalised_geodesic3d_batch", &generalised_geodesic3d_batch, "Generalised Geodesic distance 3d of a batch of images with nested scheduling");
+    m.def("geodesic_backtrack", &geodesic_backtrack, "Shortest paths from points to seeds using parent map");
+    m.def("generalised_geodesic_backward", &generalised_geodesic_backward, "Gradients of Generalised Geodesic distance through a parent map");
+    m.def("geodesic_query2d", &geodesic_query2d, "Generalised Geodesic distance at query points with A* 2d");
+    m.def("geodesic_query3d", &geodesic_query3d, "Generalised Geodesic distance at query points with A* 3d");
+    m.def("cpu_isa", &get_cpu_isa, "Instruction set of the cpu raster pass kernels in use");
+    m.def("set_cpu_isa", &set_cpu_isa, "Select the instruction set of the cpu raster pass kernels");
+    m.def("set_result_cache", &set_result_cache, "Set memory limit in bytes of the cpu result cache, 0 disables it");
+    m.def("result_cache_info", &result_cache_info, "Hit, miss and memory counters of the cpu result cache");
+    m.def("clear_result_cache", &clear_result_cache, "Drop all entries of the cpu result cache");
+    m.def("workspace_memory", &workspace_memory_info, "Current and peak bytes of the cpu raster engine workspace");
+    m.def("reset_workspace_peak", &reset_workspace_peak, "Reset the peak bytes of the cpu raster engine workspace");
+    m.def("start_trace", &start_trace, "Start recording execution spans of the cpu engines");
+    m.def("stop_trace", &stop_trace, "Stop recording execution spans and return them as chrome trace json");
+
+    py::class_<GeodesicStream3d>(m, "GeodesicStream3d")
+        .def(py::init<const std::vector<float> &, const float &, const float &, const float &, const int &>())
+        .def("append_slice", &GeodesicStream3d::append_slice, "Append slice and update Generalised Geodesic distance 3d")
+        .def("distance", &GeodesicStream3d::distance, "Generalised Geodesic distance 3d of streamed volume")
+        .def("depth", &GeodesicStream3d::depth, "Number of streamed slices")
+        .def("repaired_slices", &GeodesicStream3d::repaired_slices, "Number of slices repaired in last append")
+        .def("reset", &GeodesicStream3d::reset, "Clear streamed volume");
+
+    py::class_<GeodesicVideo2d>(m, "GeodesicVideo2d")
+        .def(py::init<const float &, const float &, const float &, const float &, const int &>())
+        .def("process_frame", &GeodesicVideo2d::process_frame, "Warm-started Generalised Geodesic distance 2d of next frame")
+        .def("iterations", &GeodesicVideo2d::iterations, "Number of iterations run for last frame")
+        .def("repaired_pixels", &GeodesicVideo2d::repaired_pixels, "Number of pixels repaired for last frame")
+        .def("reset", &GeodesicVideo2d::reset, "Clear previous frame");
 }
\ No newline at end of file
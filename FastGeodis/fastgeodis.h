@@ -31,6 +31,9 @@
 #pragma once
 
 #include <torch/extension.h>
+#include <functional>
+#include <map>
+#include <string>
 #include <vector>
 #include "common.h"
 
@@ -59,7 +62,9 @@ torch::Tensor generalised_geodesic2d_cpu(
     const float &v, 
     const float &l_grad, 
     const float &l_eucl, 
-    const int &iterations);
+    const int &iterations, 
+    const OutputTransform &transform = OutputTransform(), 
+    const Presmoothing &smoothing = Presmoothing());
 
 torch::Tensor generalised_geodesic3d_cpu(
     torch::Tensor &image, 
@@ -68,8 +73,189 @@ torch::Tensor generalised_geodesic3d_cpu(
     const float &v, 
     const float &l_grad, 
     const float &l_eucl, 
+    const int &iterations, 
+    const OutputTransform &transform = OutputTransform(), 
+    const Presmoothing &smoothing = Presmoothing());
+
+torch::Tensor smooth_image_cpu(
+    const torch::Tensor &image, 
+    const Presmoothing &smoothing, 
+    const std::vector<float> &spacing);
+
+PassResult geodesic_updown_pass_cpu(
+    const torch::Tensor &image, 
+    torch::Tensor &distance, 
+    const float &l_grad, 
+    const float &l_eucl, 
+    const OutputTransform *transform = nullptr);
+
+PassResult geodesic_frontback_pass_cpu(
+    const torch::Tensor &image, 
+    torch::Tensor &distance, 
+    const std::vector<float> &spacing, 
+    const float &l_grad, 
+    const float &l_eucl, 
+    const OutputTransform *transform = nullptr);
+
+int64_t geodesic_line_sweep_cpu(
+    const float *image, 
+    float *distance, 
+    const int &channel, 
+    const int64_t &plane, 
+    const int &num_lines, 
+    const int &line_len, 
+    const int64_t &line_stride, 
+    const int64_t &elem_stride, 
+    const float *local_dist, 
+    const int &direction, 
+    const float &l_grad, 
+    const float &l_eucl, 
+    int &line_begin, 
+    int &line_end, 
+    int &elem_begin, 
+    int &elem_end);
+
+std::tuple<torch::Tensor, torch::Tensor> generalised_geodesic_knn_cpu(
+    const torch::Tensor &image, 
+    const torch::Tensor &labels, 
+    const int &k, 
+    const std::vector<float> &spacing, 
+    const float &l_grad, 
+    const float &l_eucl, 
     const int &iterations);
 
+std::tuple<torch::Tensor, torch::Tensor> generalised_geodesic_parent_cpu(
+    const torch::Tensor &image, 
+    const torch::Tensor &mask, 
+    const std::vector<float> &spacing, 
+    const float &v, 
+    const float &l_grad, 
+    const float &l_eucl, 
+    const int &iterations);
+
+std::tuple<torch::Tensor, torch::Tensor> generalised_geodesic_exact_cpu(
+    const torch::Tensor &image, 
+    const torch::Tensor &mask, 
+    const std::vector<float> &spacing, 
+    const float &v, 
+    const float &l_grad, 
+    const float &l_eucl);
+
+std::tuple<torch::Tensor, torch::Tensor, std::vector<torch::Tensor>> geodesic_query_cpu(
+    const torch::Tensor &image, 
+    const torch::Tensor &mask, 
+    const torch::Tensor &points, 
+    const std::vector<float> &spacing, 
+    const float &v, 
+    const float &l_grad, 
+    const float &l_eucl, 
+    const bool &return_path);
+
+torch::Tensor generalised_geodesic_multi_cpu(
+    const torch::Tensor &image, 
+    const torch::Tensor &masks, 
+    const std::vector<float> &spacing, 
+    const float &v, 
+    const float &l_grad, 
+    const float &l_eucl, 
+    const int &iterations);
+
+std::tuple<torch::Tensor, torch::Tensor> geos_energy_cpu(
+    const torch::Tensor &image, 
+    const torch::Tensor &ratio, 
+    const torch::Tensor &distances, 
+    const int64_t &num_d, 
+    const int64_t &num_e, 
+    const std::vector<float> &spacing, 
+    const float &gamma);
+
+std::tuple<torch::Tensor, torch::Tensor> simulate_click_guidance_cpu(
+    const torch::Tensor &image, 
+    const torch::Tensor &labels, 
+    const int &fg_clicks, 
+    const int &bg_clicks, 
+    const std::vector<float> &spacing, 
+    const float &v, 
+    const float &l_grad, 
+    const float &l_eucl, 
+    const int &iterations, 
+    const int64_t &seed);
+
+std::tuple<torch::Tensor, torch::Tensor, torch::Tensor, torch::Tensor> generalised_geodesic_backward_cpu(
+    const torch::Tensor &image, 
+    const torch::Tensor &parent, 
+    const torch::Tensor &grad_distance, 
+    const std::vector<float> &spacing, 
+    const float &v, 
+    const float &l_grad, 
+    const float &l_eucl);
+
+torch::Tensor generalised_geodesic_superpixel_cpu(
+    const torch::Tensor &image, 
+    const torch::Tensor &mask, 
+    const std::vector<float> &spacing, 
+    const float &v, 
+    const float &l_grad, 
+    const float &l_eucl, 
+    const int &superpixel_size, 
+    const float &compactness);
+
+int64_t generalised_geodesic_relax_cpu(
+    const torch::Tensor &image, 
+    torch::Tensor &distance, 
+    const std::vector<float> &spacing, 
+    const float &l_grad, 
+    const float &l_eucl, 
+    const int &iterations);
+
+std::vector<torch::Tensor> generalised_geodesic_batch_cpu(
+    const std::vector<torch::Tensor> &images, 
+    const std::vector<torch::Tensor> &masks, 
+    const std::vector<float> &spacing, 
+    const float &v, 
+    const float &l_grad, 
+    const float &l_eucl, 
+    const int &iterations, 
+    const int &num_threads, 
+    const int &schedule);
+
+std::string get_cpu_isa();
+
+std::string set_cpu_isa(
+    const std::string &name);
+
+torch::Tensor cached_result(
+    const std::string &op, 
+    const std::vector<torch::Tensor> &inputs, 
+    const std::vector<float> &params, 
+    const std::function<torch::Tensor()> &compute);
+
+void set_result_cache(
+    const int64_t &max_bytes);
+
+std::map<std::string, int64_t> result_cache_info();
+
+void clear_result_cache();
+
+torch::Tensor workspace_empty(
+    const c10::IntArrayRef &sizes, 
+    const torch::ScalarType &dtype);
+
+torch::Tensor workspace_contiguous(
+    const torch::Tensor &tensor);
+
+std::map<std::string, int64_t> workspace_memory_info();
+
+void reset_workspace_peak();
+
+void start_trace();
+
+std::string stop_trace();
+
+std::vector<torch::Tensor> geodesic_backtrack_cpu(
+    const torch::Tensor &parent, 
+    const torch::Tensor &points);
+
 torch::Tensor generalised_geodesic2d(
     torch::Tensor &image, 
     const torch::Tensor &mask, 
@@ -90,3 +276,161 @@ torch::Tensor generalised_geodesic3d(
     );
 
 
+std::tuple<torch::Tensor, torch::Tensor> generalised_geodesic_knn2d(
+    torch::Tensor &image, 
+    const torch::Tensor &labels, 
+    const int &k, 
+    const float &l_grad, 
+    const float &l_eucl, 
+    const int &iterations
+    );
+
+std::tuple<torch::Tensor, torch::Tensor> generalised_geodesic_knn3d(
+    torch::Tensor &image, 
+    const torch::Tensor &labels, 
+    const int &k, 
+    const std::vector<float> &spacing, 
+    const float &l_grad, 
+    const float &l_eucl, 
+    const int &iterations
+    );
+
+std::tuple<torch::Tensor, torch::Tensor> generalised_geodesic_parent2d(
+    torch::Tensor &image, 
+    const torch::Tensor &mask, 
+    const float &v, 
+    const float &l_grad, 
+    const float &l_eucl, 
+    const int &iterations
+    );
+
+std::tuple<torch::Tensor, torch::Tensor> generalised_geodesic_parent3d(
+    torch::Tensor &image, 
+    const torch::Tensor &mask, 
+    const std::vector<float> &spacing, 
+    const float &v, 
+    const float &l_grad, 
+    const float &l_eucl, 
+    const int &iterations
+    );
+
+std::tuple<torch::Tensor, torch::Tensor> generalised_geodesic_exact2d(
+    torch::Tensor &image, 
+    const torch::Tensor &mask, 
+    const float &v, 
+    const float &l_grad, 
+    const float &l_eucl
+    );
+
+std::tuple<torch::Tensor, torch::Tensor> generalised_geodesic_exact3d(
+    torch::Tensor &image, 
+    const torch::Tensor &mask, 
+    const std::vector<float> &spacing, 
+    const float &v, 
+    const float &l_grad, 
+    const float &l_eucl
+    );
+
+std::vector<torch::Tensor> geodesic_backtrack(
+    const torch::Tensor &parent, 
+    const torch::Tensor &points
+    );
+
+std::tuple<torch::Tensor, torch::Tensor, torch::Tensor, torch::Tensor> generalised_geodesic_backward(
+    const torch::Tensor &image, 
+    const torch::Tensor &parent, 
+    const torch::Tensor &grad_distance, 
+    const std::vector<float> &spacing, 
+    const float &v, 
+    const float &l_grad, 
+    const float &l_eucl
+    );
+
+std::tuple<torch::Tensor, torch::Tensor, std::vector<torch::Tensor>> geodesic_query2d(
+    torch::Tensor &image, 
+    const torch::Tensor &mask, 
+    const torch::Tensor &points, 
+    const float &v, 
+    const float &l_grad, 
+    const float &l_eucl, 
+    const bool &return_path
+    );
+
+std::tuple<torch::Tensor, torch::Tensor, std::vector<torch::Tensor>> geodesic_query3d(
+    torch::Tensor &image, 
+    const torch::Tensor &mask, 
+    const torch::Tensor &points, 
+    const std::vector<float> &spacing, 
+    const float &v, 
+    const float &l_grad, 
+    const float &l_eucl, 
+    const bool &return_path
+    );
+
+class GeodesicStream3d
+{
+public:
+    GeodesicStream3d(
+        const std::vector<float> &spacing, 
+        const float &v, 
+        const float &l_grad, 
+        const float &l_eucl, 
+        const int &iterations);
+
+    // appends slice at the back of the volume and returns its distance
+    torch::Tensor append_slice(const torch::Tensor &image, const torch::Tensor &mask);
+    torch::Tensor distance() const;
+    int64_t depth() const;
+    // number of previous slices touched by repair sweep in last append
+    int64_t repaired_slices() const;
+    void reset();
+
+private:
+    int64_t relax_slice(const int64_t &z, const int64_t &z_n);
+    int64_t relax_inplane(const int64_t &z);
+
+    std::vector<float> spacing_;
+    float v_;
+    float l_grad_;
+    float l_eucl_;
+    int iterations_;
+    int64_t repaired_slices_;
+
+    // image slices of shape channel, height, width and distance slices of shape height, width
+    std::vector<torch::Tensor> image_slices_;
+    std::vector<torch::Tensor> distance_slices_;
+};
+
+class GeodesicVideo2d
+{
+public:
+    GeodesicVideo2d(
+        const float &v, 
+        const float &l_grad, 
+        const float &l_eucl, 
+        const float &threshold, 
+        const int &max_iterations);
+
+    // warm-starts from previous frame and returns distance of the new frame
+    torch::Tensor process_frame(const torch::Tensor &image, const torch::Tensor &mask);
+    // number of iterations run for last frame
+    int iterations() const;
+    // number of pixels reset to seed for last frame
+    int64_t repaired_pixels() const;
+    void reset();
+
+private:
+    float v_;
+    float l_grad_;
+    float l_eucl_;
+    float threshold_;
+    int max_iterations_;
+    int iterations_;
+    int64_t repaired_pixels_;
+
+    // previous frame image of shape channel, height, width, seed and distance of shape height, width
+    torch::Tensor image_;
+    torch::Tensor seed_;
+    torch::Tensor distance_;
+};
+
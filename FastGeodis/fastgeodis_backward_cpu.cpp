@@ -0,0 +1,163 @@
+// BSD 3-Clause License
+
+// Copyright (c) 2021, Muhammad Asad (masadcv@gmail.com)
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+
+#include <torch/extension.h>
+#include <vector>
+#include <algorithm>
+#include "fastgeodis.h"
+#include "fastgeodis_raster.h"
+
+std::tuple<torch::Tensor, torch::Tensor, torch::Tensor, torch::Tensor> generalised_geodesic_backward_cpu(
+    const torch::Tensor &image,
+    const torch::Tensor &parent,
+    const torch::Tensor &grad_distance,
+    const std::vector<float> &spacing,
+    const float &v,
+    const float &l_grad,
+    const float &l_eucl)
+{
+    // with the forest fixed, distance[p] = distance[q] + l_eucl * local_dist + l_grad * |image[p] - image[q]|_1
+    // for parent q of p, and distance[p] = v * mask[p] at roots, so the gradient reaching p adds to its parent
+    // and all gradients of distance end at roots
+    const RasterGrid grid = make_raster_grid(image);
+    const int channel = image.size(1);
+    const int64_t numel = grid.numel;
+    const int self_code = raster_self_code(grid);
+
+    float local_dist[27] = {0.0};
+    for (const RasterNeighbour &n : raster_neighbours(grid, spacing))
+    {
+        local_dist[n.code] = n.local_dist;
+    }
+
+    torch::Tensor image_c = image.contiguous();
+    torch::Tensor parent_c = parent.contiguous();
+    torch::Tensor adjoint = grad_distance.to(torch::kFloat).contiguous().clone();
+    torch::Tensor grad_image = torch::zeros_like(image_c);
+    torch::Tensor grad_mask = torch::zeros(parent.sizes(), torch::kFloat);
+
+    const float *image_ptr = image_c.data_ptr<float>();
+    const uint8_t *parent_ptr = parent_c.data_ptr<uint8_t>();
+    float *adjoint_ptr = adjoint.data_ptr<float>();
+    float *grad_image_ptr = grad_image.data_ptr<float>();
+    float *grad_mask_ptr = grad_mask.data_ptr<float>();
+
+    auto parent_of = [&](const int64_t &p) -> int64_t
+    {
+        int64_t z, h, w;
+        int dz, dh, dw;
+        raster_coordinates(grid, p, z, h, w);
+        raster_neighbour_offset(grid, parent_ptr[p], dz, dh, dw);
+        if (!raster_inside(grid, z + dz, h + dh, w + dw))
+        {
+            throw std::invalid_argument("parent map points outside of the input");
+        }
+        return p + dz * grid.stride[0] + dh * grid.stride[1] + dw;
+    };
+
+    // depth of each voxel in the forest, following parents until a voxel of known depth
+    std::vector<int64_t> depth(numel, -1);
+    std::vector<int64_t> chain;
+    int64_t max_depth = 0;
+    for (int64_t p = 0; p < numel; p++)
+    {
+        int64_t q = p;
+        while (depth[q] < 0 && parent_ptr[q] != self_code)
+        {
+            chain.push_back(q);
+            if (chain.size() > size_t(numel))
+            {
+                throw std::runtime_error("parent map contains a cycle, it was not produced by a geodesic distance transform");
+            }
+            q = parent_of(q);
+        }
+        if (depth[q] < 0)
+            depth[q] = 0;
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+        {
+            depth[*it] = depth[q] + 1;
+            q = *it;
+        }
+        chain.clear();
+        max_depth = std::max(max_depth, depth[p]);
+    }
+
+    // counting sort by depth so children are always visited before their parent
+    std::vector<int64_t> offset(max_depth + 2, 0);
+    for (int64_t p = 0; p < numel; p++)
+    {
+        offset[depth[p] + 1]++;
+    }
+    for (int64_t d = 0; d <= max_depth; d++)
+    {
+        offset[d + 1] += offset[d];
+    }
+    std::vector<int64_t> order(numel);
+    for (int64_t p = 0; p < numel; p++)
+    {
+        order[offset[depth[p]]++] = p;
+    }
+
+    double grad_l_grad = 0.0;
+    double grad_l_eucl = 0.0;
+    for (int64_t i = numel - 1; i >= 0; i--)
+    {
+        const int64_t p = order[i];
+        const float a = adjoint_ptr[p];
+        if (parent_ptr[p] == self_code)
+        {
+            grad_mask_ptr[p] = v * a;
+            continue;
+        }
+
+        const int64_t q = parent_of(p);
+        adjoint_ptr[q] += a;
+        grad_l_eucl += double(a) * local_dist[parent_ptr[p]];
+
+        float l_dist = 0.0;
+        for (int c_i = 0; c_i < channel; c_i++)
+        {
+            const float diff = image_ptr[c_i * numel + p] - image_ptr[c_i * numel + q];
+            l_dist += std::abs(diff);
+            const float g = l_grad * a * float((diff > 0) - (diff < 0));
+            grad_image_ptr[c_i * numel + p] += g;
+            grad_image_ptr[c_i * numel + q] -= g;
+        }
+        grad_l_grad += double(a) * l_dist;
+    }
+
+    return std::make_tuple(
+        grad_image,
+        grad_mask,
+        torch::full({}, float(grad_l_grad), torch::kFloat),
+        torch::full({}, float(grad_l_eucl), torch::kFloat));
+}
@@ -0,0 +1,130 @@
+// BSD 3-Clause License
+
+// Copyright (c) 2021, Muhammad Asad (masadcv@gmail.com)
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <torch/extension.h>
+#include <vector>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include "fastgeodis.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// allows the nested teams of the batch schedule and restores the previous setting on scope exit, also
+// when an image throws
+struct NestedParallelism
+{
+#ifdef _OPENMP
+    #if _OPENMP >= 200805
+        const int max_active_levels = omp_get_max_active_levels();
+        NestedParallelism() { omp_set_max_active_levels(2); }
+        ~NestedParallelism() { omp_set_max_active_levels(max_active_levels); }
+    #else
+        const int nested = omp_get_nested();
+        NestedParallelism() { omp_set_nested(1); }
+        ~NestedParallelism() { omp_set_nested(nested); }
+    #endif
+#endif
+};
+
+std::vector<torch::Tensor> generalised_geodesic_batch_cpu(
+    const std::vector<torch::Tensor> &images,
+    const std::vector<torch::Tensor> &masks,
+    const std::vector<float> &spacing,
+    const float &v,
+    const float &l_grad,
+    const float &l_eucl,
+    const int &iterations,
+    const int &num_threads,
+    const int &schedule)
+{
+    // two level schedule: outer threads take the next image of the batch, the raster passes of each
+    // image run with a nested team sized by the scheduler
+    // schedule 0 splits threads adaptively, 1 runs images in parallel with one thread each,
+    // 2 runs images one after the other with all threads
+    const int num_images = images.size();
+    std::vector<torch::Tensor> distances(num_images);
+
+    BatchScheduler scheduler;
+#ifdef _OPENMP
+    scheduler.total_threads = num_threads > 0 ? num_threads : omp_get_max_threads();
+#endif
+    scheduler.fixed_threads = schedule == 1 ? 1 : 0;
+    const int num_outer = schedule == 2 ? 1 : std::max(1, std::min(num_images, scheduler.total_threads));
+
+    // images still being worked on by an outer thread share the threads
+    scheduler.active = num_outer;
+
+    NestedParallelism nested;
+
+    std::atomic<int> next{0};
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    #ifdef _OPENMP
+        #pragma omp parallel num_threads(num_outer)
+    #endif
+    {
+        current_batch_scheduler() = &scheduler;
+        for (int b = next++; b < num_images; b = next++)
+        {
+            TraceSpan span("batch image");
+            try
+            {
+                torch::Tensor image = images[b];
+                if (images[b].dim() == 5)
+                {
+                    distances[b] = generalised_geodesic3d_cpu(image, masks[b], spacing, v, l_grad, l_eucl, iterations);
+                }
+                else
+                {
+                    distances[b] = generalised_geodesic2d_cpu(image, masks[b], v, l_grad, l_eucl, iterations);
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error)
+                    error = std::current_exception();
+                // images not started yet are skipped
+                next = num_images;
+            }
+        }
+        scheduler.active--;
+        current_batch_scheduler() = nullptr;
+    }
+
+    // an exception must not escape the parallel region, the first one is rethrown after the join
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+    return distances;
+}
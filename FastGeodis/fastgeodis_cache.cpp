@@ -0,0 +1,250 @@
+// BSD 3-Clause License
+
+// Copyright (c) 2021, Muhammad Asad (masadcv@gmail.com)
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <torch/extension.h>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "fastgeodis.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// opt-in cache of cpu results, entries are keyed on the operation, parameters, shapes and a 128 bit
+// content hash of the inputs, and evicted least recently used first once max_bytes is exceeded
+
+static const uint64_t HASH_P1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t HASH_P2 = 0xC2B2AE3D27D4EB4FULL;
+static const int64_t HASH_CHUNK = 1 << 20;
+
+inline uint64_t hash_rotl(const uint64_t &x, const int &r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t hash_mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+inline uint64_t hash_round(const uint64_t &acc, const uint64_t &word)
+{
+    return hash_rotl(acc + word * HASH_P2, 31) * HASH_P1;
+}
+
+static void hash_chunk(const unsigned char *data, const int64_t &size, const uint64_t &seed, uint64_t out[2])
+{
+    // four independent lanes keep the multiplies pipelined, both outputs depend on every lane
+    uint64_t lane[4] = {seed + HASH_P1 + HASH_P2, seed + HASH_P2, seed, seed - HASH_P1};
+    int64_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        for (int l = 0; l < 4; l++)
+        {
+            uint64_t word;
+            std::memcpy(&word, data + i + 8 * l, 8);
+            lane[l] = hash_round(lane[l], word);
+        }
+    }
+    for (int l = 0; i < size; i += 8, l++)
+    {
+        uint64_t word = 0;
+        std::memcpy(&word, data + i, std::min<int64_t>(8, size - i));
+        lane[l] = hash_round(lane[l], word);
+    }
+
+    out[0] = hash_mix(lane[0] ^ hash_rotl(lane[1], 7) ^ hash_rotl(lane[2], 12) ^ hash_rotl(lane[3], 18) ^ uint64_t(size));
+    out[1] = hash_mix(lane[0] * HASH_P1 + lane[1] + hash_rotl(lane[2], 29) * HASH_P2 + lane[3] + uint64_t(size));
+}
+
+static void hash_tensor(const torch::Tensor &tensor, std::string &key)
+{
+    // appends dtype, shape and content hash of tensor to key
+    torch::Tensor data = tensor.contiguous();
+    const unsigned char *ptr = static_cast<const unsigned char *>(data.data_ptr());
+    const int64_t size = data.nbytes();
+    const int64_t num_chunks = (size + HASH_CHUNK - 1) / HASH_CHUNK;
+
+    std::vector<uint64_t> chunk_hash(2 * num_chunks);
+    // use openmp to parallelise the loop over chunks
+    #ifdef _OPENMP
+        #pragma omp parallel for
+    #endif
+    for (int64_t c = 0; c < num_chunks; c++)
+    {
+        hash_chunk(ptr + c * HASH_CHUNK, std::min(HASH_CHUNK, size - c * HASH_CHUNK), uint64_t(c), &chunk_hash[2 * c]);
+    }
+
+    uint64_t h[2] = {HASH_P1, HASH_P2};
+    for (int64_t c = 0; c < num_chunks; c++)
+    {
+        h[0] = hash_mix(h[0] ^ chunk_hash[2 * c]);
+        h[1] = hash_mix(h[1] + chunk_hash[2 * c + 1]);
+    }
+
+    std::vector<int64_t> header = {int64_t(data.scalar_type()), data.dim()};
+    for (const int64_t &s : data.sizes())
+    {
+        header.push_back(s);
+    }
+    key.append(reinterpret_cast<const char *>(header.data()), header.size() * sizeof(int64_t));
+    key.append(reinterpret_cast<const char *>(h), sizeof(h));
+}
+
+struct CacheEntry
+{
+    std::string key;
+    torch::Tensor result;
+    int64_t bytes;
+};
+
+struct ResultCache
+{
+    std::mutex mutex;
+    int64_t max_bytes = 0;
+    int64_t bytes = 0;
+    int64_t hits = 0;
+    int64_t misses = 0;
+    int64_t evictions = 0;
+    // most recently used first
+    std::list<CacheEntry> entries;
+    std::unordered_map<std::string, std::list<CacheEntry>::iterator> index;
+
+    void evict(const int64_t &limit)
+    {
+        while (bytes > limit && !entries.empty())
+        {
+            bytes -= entries.back().bytes;
+            index.erase(entries.back().key);
+            entries.pop_back();
+            evictions++;
+        }
+    }
+};
+
+static ResultCache &result_cache()
+{
+    static ResultCache cache;
+    return cache;
+}
+
+torch::Tensor cached_result(
+    const std::string &op,
+    const std::vector<torch::Tensor> &inputs,
+    const std::vector<float> &params,
+    const std::function<torch::Tensor()> &compute)
+{
+    ResultCache &cache = result_cache();
+    {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        if (cache.max_bytes <= 0)
+            return compute();
+    }
+
+    std::string key(op);
+    key.push_back('\0');
+    key.append(reinterpret_cast<const char *>(params.data()), params.size() * sizeof(float));
+    for (const torch::Tensor &input : inputs)
+    {
+        hash_tensor(input, key);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        auto found = cache.index.find(key);
+        if (found != cache.index.end())
+        {
+            cache.hits++;
+            cache.entries.splice(cache.entries.begin(), cache.entries, found->second);
+            // callers own their result, the cached tensor is never handed out
+            return found->second->result.clone();
+        }
+        cache.misses++;
+    }
+
+    // computed without holding the lock, concurrent misses on the same key compute it twice
+    torch::Tensor result = compute();
+    const int64_t bytes = result.nbytes();
+
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    if (bytes > cache.max_bytes || cache.index.count(key) > 0)
+        return result;
+
+    cache.entries.push_front({key, result.clone(), bytes});
+    cache.index[key] = cache.entries.begin();
+    cache.bytes += bytes;
+    cache.evict(cache.max_bytes);
+    return result;
+}
+
+void set_result_cache(const int64_t &max_bytes)
+{
+    if (max_bytes < 0)
+    {
+        throw std::invalid_argument("max_bytes of result cache must not be negative, received " + std::to_string(max_bytes));
+    }
+    ResultCache &cache = result_cache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.max_bytes = max_bytes;
+    cache.evict(max_bytes);
+}
+
+std::map<std::string, int64_t> result_cache_info()
+{
+    ResultCache &cache = result_cache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    return {
+        {"hits", cache.hits},
+        {"misses", cache.misses},
+        {"evictions", cache.evictions},
+        {"entries", int64_t(cache.entries.size())},
+        {"bytes", cache.bytes},
+        {"max_bytes", cache.max_bytes}};
+}
+
+void clear_result_cache()
+{
+    // drops entries and resets counters, the memory limit is kept
+    ResultCache &cache = result_cache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.entries.clear();
+    cache.index.clear();
+    cache.bytes = 0;
+    cache.hits = 0;
+    cache.misses = 0;
+    cache.evictions = 0;
+}
@@ -0,0 +1,154 @@
+// BSD 3-Clause License
+
+// Copyright (c) 2021, Muhammad Asad (masadcv@gmail.com)
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+
+#include <torch/extension.h>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include "fastgeodis.h"
+#include "fastgeodis_raster.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+static std::vector<int64_t> sample_clicks(const std::vector<int64_t> &region, const int &num_clicks, std::mt19937_64 &rng)
+{
+    // partial fisher-yates shuffle for num_clicks distinct voxels of region
+    std::vector<int64_t> pool(region);
+    const int64_t count = std::min<int64_t>(num_clicks, pool.size());
+    for (int64_t i = 0; i < count; i++)
+    {
+        std::uniform_int_distribution<int64_t> pick(i, int64_t(pool.size()) - 1);
+        std::swap(pool[i], pool[pick(rng)]);
+    }
+    pool.resize(count);
+    return pool;
+}
+
+std::tuple<torch::Tensor, torch::Tensor> simulate_click_guidance_cpu(
+    const torch::Tensor &image,
+    const torch::Tensor &labels,
+    const int &fg_clicks,
+    const int &bg_clicks,
+    const std::vector<float> &spacing,
+    const float &v,
+    const float &l_grad,
+    const float &l_eucl,
+    const int &iterations,
+    const int64_t &seed)
+{
+    // for each sample, clicks are drawn from labels > 0 and labels == 0 and their geodesic distances
+    // are computed as two mask channels in the same sweeps, samples are processed in parallel
+    const int64_t batch = image.size(0);
+    const int num_dims = image.dim() - 2;
+    const int num_clicks = fg_clicks + bg_clicks;
+
+    std::vector<int64_t> guidance_shape = labels.sizes().vec();
+    guidance_shape[1] = 2;
+    torch::Tensor guidance = torch::empty(guidance_shape, torch::kFloat);
+    torch::Tensor clicks = torch::full({batch, num_clicks, num_dims}, -1, torch::kLong);
+
+    torch::Tensor image_c = image.to(torch::kFloat).contiguous();
+    torch::Tensor labels_c = labels.contiguous();
+    int64_t *clicks_ptr = clicks.data_ptr<int64_t>();
+
+    // use openmp to parallelise the loop over samples
+    #ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic)
+    #endif
+    for (int64_t b = 0; b < batch; b++)
+    {
+        const torch::Tensor sample_image = image_c.narrow(0, b, 1);
+        const torch::Tensor sample_labels = labels_c.narrow(0, b, 1).contiguous();
+        const RasterGrid grid = make_raster_grid(sample_labels);
+
+        std::vector<int64_t> fg_region;
+        std::vector<int64_t> bg_region;
+        const torch::Tensor foreground = (sample_labels > 0).to(torch::kByte).contiguous();
+        const uint8_t *foreground_ptr = foreground.data_ptr<uint8_t>();
+        for (int64_t p = 0; p < grid.numel; p++)
+        {
+            if (foreground_ptr[p])
+                fg_region.push_back(p);
+            else
+                bg_region.push_back(p);
+        }
+
+        // seeded per sample so that results do not depend on scheduling
+        std::mt19937_64 rng(uint64_t(seed) + uint64_t(b));
+        const std::vector<int64_t> fg_sample = sample_clicks(fg_region, fg_clicks, rng);
+        const std::vector<int64_t> bg_sample = sample_clicks(bg_region, bg_clicks, rng);
+
+        torch::Tensor masks = torch::ones({1, 2, grid.numel}, torch::kFloat);
+        float *masks_ptr = masks.data_ptr<float>();
+        for (size_t i = 0; i < fg_sample.size(); i++)
+        {
+            masks_ptr[fg_sample[i]] = 0.0;
+        }
+        for (size_t i = 0; i < bg_sample.size(); i++)
+        {
+            masks_ptr[grid.numel + bg_sample[i]] = 0.0;
+        }
+
+        // click coordinates, foreground first, -1 for clicks that did not fit in the region
+        for (int i = 0; i < num_clicks; i++)
+        {
+            int64_t p;
+            if (i < fg_clicks)
+            {
+                if (size_t(i) >= fg_sample.size())
+                    continue;
+                p = fg_sample[i];
+            }
+            else
+            {
+                if (size_t(i - fg_clicks) >= bg_sample.size())
+                    continue;
+                p = bg_sample[i - fg_clicks];
+            }
+
+            int64_t c[3];
+            raster_coordinates(grid, p, c[0], c[1], c[2]);
+            for (int d = 0; d < num_dims; d++)
+            {
+                clicks_ptr[(b * num_clicks + i) * num_dims + d] = c[3 - num_dims + d];
+            }
+        }
+
+        std::vector<int64_t> masks_shape = sample_labels.sizes().vec();
+        masks_shape[1] = 2;
+        torch::Tensor distance = generalised_geodesic_multi_cpu(sample_image, masks.view(masks_shape), spacing, v, l_grad, l_eucl, iterations);
+        guidance.narrow(0, b, 1).copy_(distance);
+    }
+
+    return std::make_tuple(guidance, clicks);
+}
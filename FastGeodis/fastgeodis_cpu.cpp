@@ -30,7 +30,14 @@
 
 #include <torch/extension.h>
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <string>
 // #include <iostream>
+#include "common.h"
+#include "fastgeodis.h"
 #ifdef _OPENMP
 #include <omp.h>
 #endif
@@ -90,144 +97,250 @@ float l1distance(const std::vector<float> &in1, const std::vector<float> &in2, i
 // }
 
 
-void geodesic_updown_pass_cpu(const torch::Tensor &image, torch::Tensor &distance, const float &l_grad,  const float &l_eucl)
+// the raster passes are built for several instruction sets and one is picked at import from cpuid, so a
+// wheel compiled with generic flags still runs wide kernels. the generic variant comes first so that
+// templates and inline functions used by the passes are instantiated without the wider target
+#if defined(__GNUC__) && !defined(__clang__) && (defined(__x86_64__) || defined(__i386__))
+#define FASTGEODIS_MULTIVERSION
+#endif
+
+namespace generic
 {
-    // batch, channel, height, width
-    const int channel = image.size(1);
-    const int height = image.size(2);
-    const int width = image.size(3);
+#include "fastgeodis_cpu_passes.h"
+}
 
-    auto image_ptr = image.accessor<float, 4>();
-    auto distance_ptr = distance.accessor<float, 4>();
-    // constexpr float local_dist[] = {sqrt(float(2.)), float(1.), sqrt(float(2.))};
-    const float local_dist[] = {sqrt(float(2.)), float(1.), sqrt(float(2.))};
+#ifdef FASTGEODIS_MULTIVERSION
+// fp contraction stays off so that every variant returns bit-identical distances
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#pragma GCC target("sse4.2")
+namespace sse42
+{
+#include "fastgeodis_cpu_passes.h"
+}
+#pragma GCC pop_options
 
-    std::vector<float> pval_v(channel);
-    std::vector<float> qval_v(channel);
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#pragma GCC target("avx2")
+namespace avx2
+{
+#include "fastgeodis_cpu_passes.h"
+}
+#pragma GCC pop_options
 
-    // top-down
-    for (int h = 1; h < height; h++)
-    {
-        // use openmp to parallelise the loop over width
-        #ifdef _OPENMP
-            #pragma omp parallel for
-        #endif
-        for (int w = 0; w < width; w++)
-        {
-            float pval;
-            if (channel == 1)
-            {
-                pval = image_ptr[0][0][h][w];
-            }
-            else
-            {
-                for (int c_i = 0; c_i < channel; c_i++)
-                {
-                    pval_v[c_i] = image_ptr[0][c_i][h][w];
-                }
-            }
-            float new_dist = distance_ptr[0][0][h][w];
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#pragma GCC target("avx512f")
+namespace avx512
+{
+#include "fastgeodis_cpu_passes.h"
+}
+#pragma GCC pop_options
+#endif
 
-            for (int w_i = 0; w_i < 3; w_i++)
-            {
-                const int w_ind = w + w_i - 1;
-                if (w_ind < 0 || w_ind >= width)
-                    continue;
+struct PassKernels
+{
+    const char *name;
+    PassResult (*updown)(const torch::Tensor &, torch::Tensor &, const float &, const float &, const OutputTransform *);
+    PassResult (*frontback)(const torch::Tensor &, torch::Tensor &, const std::vector<float> &, const float &, const float &, const OutputTransform *);
+};
+
+// ordered from the most portable variant to the widest one
+static const PassKernels pass_kernels[] = {
+    {"generic", &generic::geodesic_updown_pass_cpu, &generic::geodesic_frontback_pass_cpu},
+#ifdef FASTGEODIS_MULTIVERSION
+    {"sse4.2", &sse42::geodesic_updown_pass_cpu, &sse42::geodesic_frontback_pass_cpu},
+    {"avx2", &avx2::geodesic_updown_pass_cpu, &avx2::geodesic_frontback_pass_cpu},
+    {"avx512", &avx512::geodesic_updown_pass_cpu, &avx512::geodesic_frontback_pass_cpu},
+#endif
+};
+static const int num_pass_kernels = sizeof(pass_kernels) / sizeof(pass_kernels[0]);
 
-                float l_dist;
-                if (channel == 1)
-                {
-                    l_dist = l1distance(pval, image_ptr[0][0][h - 1][w_ind]);
-                }
-                else
-                {
-                    for (int c_i = 0; c_i < channel; c_i++)
-                    {
-                        qval_v[c_i] = image_ptr[0][c_i][h - 1][w_ind];
-                    }
-                    l_dist = l1distance(pval_v, qval_v, channel);
-                }
-                const float cur_dist = distance_ptr[0][0][h - 1][w_ind] + l_eucl * local_dist[w_i] + l_grad * l_dist;
-                new_dist = std::min(new_dist, cur_dist);
-            }
-            distance_ptr[0][0][h][w] = new_dist;
-        }
+static int supported_pass_kernel()
+{
+    // widest variant the host can run
+#ifdef FASTGEODIS_MULTIVERSION
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return 3;
+    if (__builtin_cpu_supports("avx2"))
+        return 2;
+    if (__builtin_cpu_supports("sse4.2"))
+        return 1;
+#endif
+    return 0;
+}
+
+static int find_pass_kernel(const std::string &name)
+{
+    if (name.empty() || name == "auto")
+        return supported_pass_kernel();
+    for (int k = 0; k < num_pass_kernels; k++)
+    {
+        if (name == pass_kernels[k].name)
+            // never select a variant the host cannot run
+            return std::min(k, supported_pass_kernel());
     }
+    return -1;
+}
+
+static int initial_pass_kernel()
+{
+    // FASTGEODIS_CPU_ISA overrides the detected variant, e.g. for testing the narrower kernels
+    const char *name = std::getenv("FASTGEODIS_CPU_ISA");
+    const int k = find_pass_kernel(name != nullptr ? name : "");
+    return k >= 0 ? k : supported_pass_kernel();
+}
+
+static std::atomic<int> active_pass_kernel{initial_pass_kernel()};
 
-    // bottom-up
-    for (int h = height - 2; h >= 0; h--)
+std::string get_cpu_isa()
+{
+    return pass_kernels[active_pass_kernel.load()].name;
+}
+
+std::string set_cpu_isa(const std::string &name)
+{
+    const int k = find_pass_kernel(name);
+    if (k < 0)
     {
-        // use openmp to parallelise the loop over width
-        #ifdef _OPENMP
-            #pragma omp parallel for
-        #endif
-        for (int w = 0; w < width; w++)
-        {
-            float pval;
-            if (channel == 1)
-            {
-                pval = image_ptr[0][0][h][w];
-            }
-            else
-            {
-                for (int c_i = 0; c_i < channel; c_i++)
-                {
-                    pval_v[c_i] = image_ptr[0][c_i][h][w];
-                }
-            }
-            float new_dist = distance_ptr[0][0][h][w];
+        throw std::invalid_argument("unknown cpu isa " + name + ", expected one of auto, generic, sse4.2, avx2 or avx512");
+    }
+    active_pass_kernel.store(k);
+    return get_cpu_isa();
+}
 
-            for (int w_i = 0; w_i < 3; w_i++)
-            {
-                const int w_ind = w + w_i - 1;
-                if (w_ind < 0 || w_ind >= width)
-                    continue;
+PassResult geodesic_updown_pass_cpu(const torch::Tensor &image, torch::Tensor &distance, const float &l_grad, const float &l_eucl, const OutputTransform *transform)
+{
+    return pass_kernels[active_pass_kernel.load()].updown(image, distance, l_grad, l_eucl, transform);
+}
 
-                float l_dist;
-                if (channel == 1)
-                {
-                    l_dist = l1distance(pval, image_ptr[0][0][h + 1][w_ind]);
-                }
-                else
-                {
-                    for (int c_i = 0; c_i < channel; c_i++)
-                    {
-                        qval_v[c_i] = image_ptr[0][c_i][h + 1][w_ind];
-                    }
-                    l_dist = l1distance(pval_v, qval_v, channel);
-                }
-                const float cur_dist = distance_ptr[0][0][h + 1][w_ind] + l_eucl * local_dist[w_i] + l_grad * l_dist;
-                new_dist = std::min(new_dist, cur_dist);
-            }
-            distance_ptr[0][0][h][w] = new_dist;
+PassResult geodesic_frontback_pass_cpu(const torch::Tensor &image, torch::Tensor &distance, const std::vector<float> &spacing, const float &l_grad, const float &l_eucl, const OutputTransform *transform)
+{
+    return pass_kernels[active_pass_kernel.load()].frontback(image, distance, spacing, l_grad, l_eucl, transform);
+}
+
+double elapsed_ms(const std::chrono::steady_clock::time_point &tic)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tic).count();
+}
+
+torch::Tensor contiguous_counted(const torch::Tensor &tensor, GeodesicStats *stats)
+{
+    // contiguous copy of a transposed tensor, counted as an allocation
+    if (tensor.is_contiguous())
+        return tensor;
+    if (stats != nullptr)
+        stats->bytes_allocated += tensor.nbytes();
+    TraceSpan span("transpose");
+    return workspace_contiguous(tensor);
+}
+
+template <typename Pass>
+float run_pass(const char *name, GeodesicStats *stats, Pass pass)
+{
+    TraceSpan span(name);
+    if (stats == nullptr)
+        return pass().max_dist;
+
+    const auto tic = std::chrono::steady_clock::now();
+    const PassResult result = pass();
+    stats->pass_ms.push_back(elapsed_ms(tic));
+    stats->pass_improved.push_back(double(result.improved));
+    stats->threads = std::max(stats->threads, geodesic_num_threads());
+    return result.max_dist;
+}
+
+void output_transform_cpu(torch::Tensor &distance, const OutputTransform &transform, const bool &local, float max_dist)
+{
+    // applies the transform to a contiguous distance, the local part only if it has not been fused into a pass
+    TraceSpan span("output transform");
+    float *distance_ptr = distance.data_ptr<float>();
+    const int64_t numel = distance.numel();
+    if (local)
+    {
+        max_dist = 0.0;
+        for (int64_t i = 0; i < numel; i++)
+        {
+            distance_ptr[i] = transform.apply_local(distance_ptr[i]);
+            max_dist = std::max(max_dist, distance_ptr[i]);
         }
     }
+    if (!transform.normalise)
+        return;
+
+    // use openmp to parallelise the loop over voxels
+    #ifdef _OPENMP
+        #pragma omp parallel for num_threads(geodesic_num_threads())
+    #endif
+    for (int64_t i = 0; i < numel; i++)
+    {
+        distance_ptr[i] = transform.apply_global(distance_ptr[i], max_dist);
+    }
 }
 
-torch::Tensor generalised_geodesic2d_cpu(torch::Tensor &image, const torch::Tensor &mask, const float &v, const float &l_grad, const float &l_eucl, const int &iterations)
+torch::Tensor generalised_geodesic2d_cpu(torch::Tensor &image, const torch::Tensor &mask, const float &v, const float &l_grad, const float &l_eucl, const int &iterations, const OutputTransform &transform, const Presmoothing &smoothing)
 {
-    torch::Tensor distance = v * mask.clone();
+    GeodesicStats *stats = current_geodesic_stats();
+
+    // the passes replace this handle with transposed copies, so that the copies are released on return
+    // instead of being left in the caller's image. a smoothed image becomes the working image
+    torch::Tensor working = image;
+    if (smoothing.enabled())
+    {
+        TraceSpan span("smooth");
+        working = smooth_image_cpu(image, smoothing, {1.0, 1.0});
+        if (stats != nullptr)
+            stats->bytes_allocated += working.nbytes();
+    }
+
+    TraceSpan allocation("allocate");
+    torch::Tensor distance = workspace_empty(mask.sizes(), torch::kFloat).copy_(mask).mul_(v);
+    allocation.end();
+    if (stats != nullptr)
+        stats->bytes_allocated += distance.nbytes();
+    const OutputTransform *final_transform = transform.enabled() ? &transform : nullptr;
+
+    if (iterations < 1 && final_transform != nullptr)
+    {
+        distance = distance.contiguous();
+        output_transform_cpu(distance, transform, true, 0.0);
+    }
 
     // iteratively run the distance transform
     for (int itr = 0; itr < iterations; itr++)
     {
-        image = image.contiguous();
-        distance = distance.contiguous();
+        TraceSpan iteration("iteration");
+        const auto tic = std::chrono::steady_clock::now();
+        working = contiguous_counted(working, stats);
+        distance = contiguous_counted(distance, stats);
 
         // top-bottom - width*, height
-        geodesic_updown_pass_cpu(image, distance, l_grad, l_eucl);
+        run_pass("pass height", stats, [&]() { return geodesic_updown_pass_cpu(working, distance, l_grad, l_eucl); });
 
         // left-right - height*, width
-        image = image.transpose(2, 3);
+        working = working.transpose(2, 3);
         distance = distance.transpose(2, 3);
 
-        image = image.contiguous();
-        distance = distance.contiguous();
-        geodesic_updown_pass_cpu(image, distance, l_grad, l_eucl);
+        working = contiguous_counted(working, stats);
+        distance = contiguous_counted(distance, stats);
+        if (itr == iterations - 1 && final_transform != nullptr)
+        {
+            // the last pass writes the transformed output, normalising needs its maximum
+            const float max_dist = run_pass("pass width", stats, [&]() { return geodesic_updown_pass_cpu(working, distance, l_grad, l_eucl, final_transform); });
+            output_transform_cpu(distance, transform, false, max_dist);
+        }
+        else
+        {
+            run_pass("pass width", stats, [&]() { return geodesic_updown_pass_cpu(working, distance, l_grad, l_eucl); });
+        }
         
         // tranpose back to original - width, height
-        image = image.transpose(2, 3);
+        working = working.transpose(2, 3);
         distance = distance.transpose(2, 3);
+        if (stats != nullptr)
+            stats->iteration_ms.push_back(elapsed_ms(tic));
 
         // * indicates the current direction of pass
     }
@@ -235,187 +348,170 @@ torch::Tensor generalised_geodesic2d_cpu(torch::Tensor &image, const torch::Tens
     return distance;
 }
 
-void geodesic_frontback_pass_cpu(const torch::Tensor &image, torch::Tensor &distance, const std::vector<float> &spacing, const float &l_grad, const float &l_eucl)
+torch::Tensor generalised_geodesic3d_cpu(torch::Tensor &image, const torch::Tensor &mask, const std::vector<float> &spacing, const float &v, const float &l_grad, const float &l_eucl, const int &iterations, const OutputTransform &transform, const Presmoothing &smoothing)
 {
-    // batch, channel, depth, height, width
-    const int channel = image.size(1);
-    const int depth = image.size(2);
-    const int height = image.size(3);
-    const int width = image.size(4);
+    GeodesicStats *stats = current_geodesic_stats();
 
-    auto image_ptr = image.accessor<float, 5>();
-    auto distance_ptr = distance.accessor<float, 5>();
-
-    float local_dist[3*3];
-    for (int h_i = 0; h_i < 3; h_i++)
+    // the passes replace this handle with transposed copies, so that the copies are released on return
+    // instead of being left in the caller's image. a smoothed image becomes the working image
+    torch::Tensor working = image;
+    if (smoothing.enabled())
     {
-        for (int w_i = 0; w_i < 3; w_i++)
-        {
-            float ld = spacing[0];
-            ld += float(std::abs(h_i-1)) * spacing[1];
-            ld += float(std::abs(w_i-1)) * spacing[2];
-
-            local_dist[h_i * 3 + w_i] = ld;
-        }
+        TraceSpan span("smooth");
+        working = smooth_image_cpu(image, smoothing, spacing);
+        if (stats != nullptr)
+            stats->bytes_allocated += working.nbytes();
     }
 
-    std::vector<float> pval_v(channel);
-    std::vector<float> qval_v(channel);
+    TraceSpan allocation("allocate");
+    torch::Tensor distance = workspace_empty(mask.sizes(), torch::kFloat).copy_(mask).mul_(v);
+    allocation.end();
+    if (stats != nullptr)
+        stats->bytes_allocated += distance.nbytes();
+    const OutputTransform *final_transform = transform.enabled() ? &transform : nullptr;
 
-    // front-back
-    for (int z = 1; z < depth; z++)
+    if (iterations < 1 && final_transform != nullptr)
     {
-        // use openmp to parallelise the loops over height and width
-        #ifdef _OPENMP
-            #pragma omp parallel for collapse(2)
-        #endif
-        for (int h = 0; h < height; h++)
-        {
-            for (int w = 0; w < width; w++)
-            {
-                float pval;
-                if (channel == 1)
-                {
-                    pval = image_ptr[0][0][z][h][w];
-                }
-                else
-                {
-                    for (int c_i = 0; c_i < channel; c_i++)
-                    {
-                        pval_v[c_i] = image_ptr[0][c_i][z][h][w];
-                    }
-                }
-                float new_dist = distance_ptr[0][0][z][h][w];
-
-                for (int h_i = 0; h_i < 3; h_i++)
-                {
-                    for (int w_i = 0; w_i < 3; w_i++)
-                    {
-                        const int h_ind = h + h_i - 1;
-                        const int w_ind = w + w_i - 1;
-
-                        if (w_ind < 0 || w_ind >= width || h_ind < 0 || h_ind >= height)
-                            continue;
-
-                        float l_dist;
-                        if (channel == 1)
-                        {
-                            l_dist = std::abs(pval - image_ptr[0][0][z - 1][h_ind][w_ind]);
-                        }
-                        else
-                        {
-                            for (int c_i = 0; c_i < channel; c_i++)
-                            {
-                                qval_v[c_i] = image_ptr[0][c_i][z - 1][h_ind][w_ind];
-                            }
-                            l_dist = l1distance(pval_v, qval_v, channel);
-                        }
-                        const float cur_dist = distance_ptr[0][0][z - 1][h_ind][w_ind] + l_eucl * local_dist[h_i * 3 + w_i]  + l_grad * l_dist;
-                        new_dist = std::min(new_dist, cur_dist);
-                    }
-                }
-                distance_ptr[0][0][z][h][w] = new_dist;
-            }
-        }
-    }
-
-    // back-front
-    for (int z = depth - 2; z >= 0; z--)
-    {
-        // use openmp to parallelise the loops over height and width
-        #ifdef _OPENMP
-            #pragma omp parallel for collapse(2)
-        #endif
-        for (int h = 0; h < height; h++)
-        {
-            for (int w = 0; w < width; w++)
-            {
-                float pval;
-                if (channel == 1)
-                {
-                    pval = image_ptr[0][0][z][h][w];
-                }
-                else
-                {
-                    for (int c_i = 0; c_i < channel; c_i++)
-                    {
-                        pval_v[c_i] = image_ptr[0][c_i][z][h][w];
-                    }
-                }
-                float new_dist = distance_ptr[0][0][z][h][w];
-
-                for (int h_i = 0; h_i < 3; h_i++)
-                {
-                    for (int w_i = 0; w_i < 3; w_i++)
-                    {
-                        const int h_ind = h + h_i - 1;
-                        const int w_ind = w + w_i - 1;
-
-                        if (w_ind < 0 || w_ind >= width || h_ind < 0 || h_ind >= height)
-                            continue;
-
-                        float l_dist;
-                        if (channel == 1)
-                        {
-                            l_dist = std::abs(pval - image_ptr[0][0][z + 1][h_ind][w_ind]);
-                        }
-                        else
-                        {
-                            for (int c_i = 0; c_i < channel; c_i++)
-                            {
-                                qval_v[c_i] = image_ptr[0][c_i][z + 1][h_ind][w_ind];
-                            }
-                            l_dist = l1distance(pval_v, qval_v, channel);
-                        }
-                        const float cur_dist = distance_ptr[0][0][z + 1][h_ind][w_ind] + l_eucl * local_dist[h_i * 3 + w_i] + l_grad * l_dist;
-                        new_dist = std::min(new_dist, cur_dist);
-                    }
-                }
-                distance_ptr[0][0][z][h][w] = new_dist;
-            }
-        }
+        distance = distance.contiguous();
+        output_transform_cpu(distance, transform, true, 0.0);
     }
-}
-
-torch::Tensor generalised_geodesic3d_cpu(torch::Tensor &image, const torch::Tensor &mask, const std::vector<float> &spacing, const float &v, const float &l_grad, const float &l_eucl, const int &iterations)
-{
-    torch::Tensor distance = v * mask.clone();
 
     // iteratively run the distance transform
     for (int itr = 0; itr < iterations; itr++)
     {
-        image = image.contiguous();
-        distance = distance.contiguous();
+        TraceSpan iteration("iteration");
+        const auto tic = std::chrono::steady_clock::now();
+        working = contiguous_counted(working, stats);
+        distance = contiguous_counted(distance, stats);
 
         // front-back - depth*, height, width
-        geodesic_frontback_pass_cpu(image, distance, spacing, l_grad, l_eucl);
+        run_pass("pass depth", stats, [&]() { return geodesic_frontback_pass_cpu(working, distance, spacing, l_grad, l_eucl); });
 
         // top-bottom - height*, depth, width
-        image = torch::transpose(image, 3, 2);
+        working = torch::transpose(working, 3, 2);
         distance = torch::transpose(distance, 3, 2);
         
-        image = image.contiguous();
-        distance = distance.contiguous();
-        geodesic_frontback_pass_cpu(image, distance, {spacing[1], spacing[0], spacing[2]}, l_grad, l_eucl);
+        working = contiguous_counted(working, stats);
+        distance = contiguous_counted(distance, stats);
+        run_pass("pass height", stats, [&]() { return geodesic_frontback_pass_cpu(working, distance, {spacing[1], spacing[0], spacing[2]}, l_grad, l_eucl); });
         
         // transpose back to original depth, height, width
-        image = torch::transpose(image, 3, 2);
+        working = torch::transpose(working, 3, 2);
         distance = torch::transpose(distance, 3, 2);
         
         // left-right - width*, height, depth
-        image = torch::transpose(image, 4, 2);
+        working = torch::transpose(working, 4, 2);
         distance = torch::transpose(distance, 4, 2);
         
-        image = image.contiguous();
-        distance = distance.contiguous();
-        geodesic_frontback_pass_cpu(image, distance, {spacing[2], spacing[1], spacing[0]}, l_grad, l_eucl);
+        working = contiguous_counted(working, stats);
+        distance = contiguous_counted(distance, stats);
+        if (itr == iterations - 1 && final_transform != nullptr)
+        {
+            // the last pass writes the transformed output, normalising needs its maximum
+            const float max_dist = run_pass("pass width", stats, [&]() { return geodesic_frontback_pass_cpu(working, distance, {spacing[2], spacing[1], spacing[0]}, l_grad, l_eucl, final_transform); });
+            output_transform_cpu(distance, transform, false, max_dist);
+        }
+        else
+        {
+            run_pass("pass width", stats, [&]() { return geodesic_frontback_pass_cpu(working, distance, {spacing[2], spacing[1], spacing[0]}, l_grad, l_eucl); });
+        }
         
         // transpose back to original depth, height, width
-        image = torch::transpose(image, 4, 2);
+        working = torch::transpose(working, 4, 2);
         distance = torch::transpose(distance, 4, 2);
+        if (stats != nullptr)
+            stats->iteration_ms.push_back(elapsed_ms(tic));
 
         // * indicates the current direction of pass
     }
 
     return distance;
-}
\ No newline at end of file
+}
+
+int64_t geodesic_line_sweep_cpu(
+    const float *image,
+    float *distance,
+    const int &channel,
+    const int64_t &plane,
+    const int &num_lines,
+    const int &line_len,
+    const int64_t &line_stride,
+    const int64_t &elem_stride,
+    const float *local_dist,
+    const int &direction,
+    const float &l_grad,
+    const float &l_eucl,
+    int &line_begin,
+    int &line_end,
+    int &elem_begin,
+    int &elem_end)
+{
+    // sweep lines of a single plane in direction, each line is relaxed from the previous one
+    // lines in [line_begin, line_end] are dirty and always relaxed, lines outside are only
+    // relaxed while the previous line keeps changing. on return the ranges hold changed lines/elements
+    std::vector<char> elem_changed(line_len, 0);
+    int changed_begin = num_lines;
+    int changed_end = -1;
+    int64_t changed = 0;
+
+    const int start = direction > 0 ? std::max(line_begin, 1) : std::min(line_end, num_lines - 2);
+    bool prev_changed = false;
+    for (int l = start; l >= 0 && l < num_lines; l += direction)
+    {
+        const int l_prev = l - direction;
+        if ((l_prev < line_begin || l_prev > line_end) && (l < line_begin || l > line_end) && !prev_changed)
+            break;
+
+        int64_t line_changed = 0;
+
+        // use openmp to parallelise the loop over line elements
+        #ifdef _OPENMP
+            #pragma omp parallel for reduction(+:line_changed)
+        #endif
+        for (int e = 0; e < line_len; e++)
+        {
+            const int64_t p = l * line_stride + e * elem_stride;
+            float new_dist = distance[p];
+
+            for (int e_i = 0; e_i < 3; e_i++)
+            {
+                const int e_ind = e + e_i - 1;
+                if (e_ind < 0 || e_ind >= line_len)
+                    continue;
+
+                const int64_t q = l_prev * line_stride + e_ind * elem_stride;
+                const float l_dist = l1distance_strided(image, image, p, q, channel, plane);
+                const float cur_dist = distance[q] + l_eucl * local_dist[e_i] + l_grad * l_dist;
+                new_dist = std::min(new_dist, cur_dist);
+            }
+            if (new_dist < distance[p])
+            {
+                distance[p] = new_dist;
+                elem_changed[e] = 1;
+                line_changed++;
+            }
+        }
+
+        prev_changed = line_changed > 0;
+        if (prev_changed)
+        {
+            changed_begin = std::min(changed_begin, l);
+            changed_end = std::max(changed_end, l);
+            changed += line_changed;
+        }
+    }
+
+    line_begin = changed_begin;
+    line_end = changed_end;
+    elem_begin = line_len;
+    elem_end = -1;
+    for (int e = 0; e < line_len; e++)
+    {
+        if (elem_changed[e])
+        {
+            elem_begin = std::min(elem_begin, e);
+            elem_end = e;
+        }
+    }
+    return changed;
+}
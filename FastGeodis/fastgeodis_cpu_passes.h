@@ -0,0 +1,365 @@
+// BSD 3-Clause License
+
+// Copyright (c) 2021, Muhammad Asad (masadcv@gmail.com)
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// raster passes compiled once per instruction set, see fastgeodis_cpu.cpp. this file has no include
+// guard on purpose, it is included inside a namespace for every kernel variant
+
+PassResult geodesic_updown_pass_cpu(const torch::Tensor &image, torch::Tensor &distance, const float &l_grad,  const float &l_eucl, const OutputTransform *transform = nullptr)
+{
+    // batch, channel, height, width
+    const int channel = image.size(1);
+    const int height = image.size(2);
+    const int width = image.size(3);
+
+    auto image_ptr = image.accessor<float, 4>();
+    auto distance_ptr = distance.accessor<float, 4>();
+    // constexpr float local_dist[] = {sqrt(float(2.)), float(1.), sqrt(float(2.))};
+    const float local_dist[] = {sqrt(float(2.)), float(1.), sqrt(float(2.))};
+
+    std::vector<float> pval_v(channel);
+    std::vector<float> qval_v(channel);
+
+    // distance updates of both sweeps, counted for the pass statistics
+    int64_t improved = 0;
+
+    TraceSpan forward_sweep("forward sweep");
+    // top-down
+    for (int h = 1; h < height; h++)
+    {
+        // use openmp to parallelise the loop over width
+        #ifdef _OPENMP
+            #pragma omp parallel for num_threads(geodesic_num_threads()) firstprivate(pval_v, qval_v) reduction(+:improved)
+        #endif
+        for (int w = 0; w < width; w++)
+        {
+            float pval;
+            if (channel == 1)
+            {
+                pval = image_ptr[0][0][h][w];
+            }
+            else
+            {
+                for (int c_i = 0; c_i < channel; c_i++)
+                {
+                    pval_v[c_i] = image_ptr[0][c_i][h][w];
+                }
+            }
+            const float old_dist = distance_ptr[0][0][h][w];
+            float new_dist = old_dist;
+
+            for (int w_i = 0; w_i < 3; w_i++)
+            {
+                const int w_ind = w + w_i - 1;
+                if (w_ind < 0 || w_ind >= width)
+                    continue;
+
+                float l_dist;
+                if (channel == 1)
+                {
+                    l_dist = l1distance(pval, image_ptr[0][0][h - 1][w_ind]);
+                }
+                else
+                {
+                    for (int c_i = 0; c_i < channel; c_i++)
+                    {
+                        qval_v[c_i] = image_ptr[0][c_i][h - 1][w_ind];
+                    }
+                    l_dist = l1distance(pval_v, qval_v, channel);
+                }
+                const float cur_dist = distance_ptr[0][0][h - 1][w_ind] + l_eucl * local_dist[w_i] + l_grad * l_dist;
+                new_dist = std::min(new_dist, cur_dist);
+            }
+            distance_ptr[0][0][h][w] = new_dist;
+            improved += new_dist < old_dist;
+        }
+    }
+
+    forward_sweep.end();
+
+    TraceSpan backward_sweep("backward sweep");
+    // bottom-up, with a transform each row is final and written back once the row above it has been relaxed
+    std::vector<float> max_dist(transform != nullptr ? width : 0, 0.0);
+    for (int h = height - 2; h >= 0; h--)
+    {
+        // use openmp to parallelise the loop over width
+        #ifdef _OPENMP
+            #pragma omp parallel for num_threads(geodesic_num_threads()) firstprivate(pval_v, qval_v) reduction(+:improved)
+        #endif
+        for (int w = 0; w < width; w++)
+        {
+            float pval;
+            if (channel == 1)
+            {
+                pval = image_ptr[0][0][h][w];
+            }
+            else
+            {
+                for (int c_i = 0; c_i < channel; c_i++)
+                {
+                    pval_v[c_i] = image_ptr[0][c_i][h][w];
+                }
+            }
+            const float old_dist = distance_ptr[0][0][h][w];
+            float new_dist = old_dist;
+
+            for (int w_i = 0; w_i < 3; w_i++)
+            {
+                const int w_ind = w + w_i - 1;
+                if (w_ind < 0 || w_ind >= width)
+                    continue;
+
+                float l_dist;
+                if (channel == 1)
+                {
+                    l_dist = l1distance(pval, image_ptr[0][0][h + 1][w_ind]);
+                }
+                else
+                {
+                    for (int c_i = 0; c_i < channel; c_i++)
+                    {
+                        qval_v[c_i] = image_ptr[0][c_i][h + 1][w_ind];
+                    }
+                    l_dist = l1distance(pval_v, qval_v, channel);
+                }
+                const float cur_dist = distance_ptr[0][0][h + 1][w_ind] + l_eucl * local_dist[w_i] + l_grad * l_dist;
+                new_dist = std::min(new_dist, cur_dist);
+            }
+            distance_ptr[0][0][h][w] = new_dist;
+            improved += new_dist < old_dist;
+
+            if (transform != nullptr && h + 2 < height)
+            {
+                const float out = transform->apply_local(distance_ptr[0][0][h + 2][w]);
+                distance_ptr[0][0][h + 2][w] = out;
+                max_dist[w] = std::max(max_dist[w], out);
+            }
+        }
+    }
+
+    PassResult result;
+    result.improved = improved;
+    if (transform == nullptr)
+        return result;
+
+    // last two rows are not read by any later row
+    for (int h = std::min(1, height - 1); h >= 0; h--)
+    {
+        for (int w = 0; w < width; w++)
+        {
+            const float out = transform->apply_local(distance_ptr[0][0][h][w]);
+            distance_ptr[0][0][h][w] = out;
+            max_dist[w] = std::max(max_dist[w], out);
+        }
+    }
+    result.max_dist = max_dist.empty() ? 0.0f : *std::max_element(max_dist.begin(), max_dist.end());
+    return result;
+}
+
+PassResult geodesic_frontback_pass_cpu(const torch::Tensor &image, torch::Tensor &distance, const std::vector<float> &spacing, const float &l_grad, const float &l_eucl, const OutputTransform *transform = nullptr)
+{
+    // batch, channel, depth, height, width
+    const int channel = image.size(1);
+    const int depth = image.size(2);
+    const int height = image.size(3);
+    const int width = image.size(4);
+
+    auto image_ptr = image.accessor<float, 5>();
+    auto distance_ptr = distance.accessor<float, 5>();
+
+    float local_dist[3*3];
+    for (int h_i = 0; h_i < 3; h_i++)
+    {
+        for (int w_i = 0; w_i < 3; w_i++)
+        {
+            float ld = spacing[0];
+            ld += float(std::abs(h_i-1)) * spacing[1];
+            ld += float(std::abs(w_i-1)) * spacing[2];
+
+            local_dist[h_i * 3 + w_i] = ld;
+        }
+    }
+
+    std::vector<float> pval_v(channel);
+    std::vector<float> qval_v(channel);
+
+    // distance updates of both sweeps, counted for the pass statistics
+    int64_t improved = 0;
+
+    TraceSpan forward_sweep("forward sweep");
+    // front-back
+    for (int z = 1; z < depth; z++)
+    {
+        // use openmp to parallelise the loops over height and width
+        #ifdef _OPENMP
+            #pragma omp parallel for collapse(2) num_threads(geodesic_num_threads()) firstprivate(pval_v, qval_v) reduction(+:improved)
+        #endif
+        for (int h = 0; h < height; h++)
+        {
+            for (int w = 0; w < width; w++)
+            {
+                float pval;
+                if (channel == 1)
+                {
+                    pval = image_ptr[0][0][z][h][w];
+                }
+                else
+                {
+                    for (int c_i = 0; c_i < channel; c_i++)
+                    {
+                        pval_v[c_i] = image_ptr[0][c_i][z][h][w];
+                    }
+                }
+                const float old_dist = distance_ptr[0][0][z][h][w];
+                float new_dist = old_dist;
+
+                for (int h_i = 0; h_i < 3; h_i++)
+                {
+                    for (int w_i = 0; w_i < 3; w_i++)
+                    {
+                        const int h_ind = h + h_i - 1;
+                        const int w_ind = w + w_i - 1;
+
+                        if (w_ind < 0 || w_ind >= width || h_ind < 0 || h_ind >= height)
+                            continue;
+
+                        float l_dist;
+                        if (channel == 1)
+                        {
+                            l_dist = std::abs(pval - image_ptr[0][0][z - 1][h_ind][w_ind]);
+                        }
+                        else
+                        {
+                            for (int c_i = 0; c_i < channel; c_i++)
+                            {
+                                qval_v[c_i] = image_ptr[0][c_i][z - 1][h_ind][w_ind];
+                            }
+                            l_dist = l1distance(pval_v, qval_v, channel);
+                        }
+                        const float cur_dist = distance_ptr[0][0][z - 1][h_ind][w_ind] + l_eucl * local_dist[h_i * 3 + w_i]  + l_grad * l_dist;
+                        new_dist = std::min(new_dist, cur_dist);
+                    }
+                }
+                distance_ptr[0][0][z][h][w] = new_dist;
+                improved += new_dist < old_dist;
+            }
+        }
+    }
+
+    forward_sweep.end();
+
+    TraceSpan backward_sweep("backward sweep");
+    // back-front, with a transform each plane is final and written back once the plane before it has been relaxed
+    std::vector<float> max_dist(transform != nullptr ? height * width : 0, 0.0);
+    for (int z = depth - 2; z >= 0; z--)
+    {
+        // use openmp to parallelise the loops over height and width
+        #ifdef _OPENMP
+            #pragma omp parallel for collapse(2) num_threads(geodesic_num_threads()) firstprivate(pval_v, qval_v) reduction(+:improved)
+        #endif
+        for (int h = 0; h < height; h++)
+        {
+            for (int w = 0; w < width; w++)
+            {
+                float pval;
+                if (channel == 1)
+                {
+                    pval = image_ptr[0][0][z][h][w];
+                }
+                else
+                {
+                    for (int c_i = 0; c_i < channel; c_i++)
+                    {
+                        pval_v[c_i] = image_ptr[0][c_i][z][h][w];
+                    }
+                }
+                const float old_dist = distance_ptr[0][0][z][h][w];
+                float new_dist = old_dist;
+
+                for (int h_i = 0; h_i < 3; h_i++)
+                {
+                    for (int w_i = 0; w_i < 3; w_i++)
+                    {
+                        const int h_ind = h + h_i - 1;
+                        const int w_ind = w + w_i - 1;
+
+                        if (w_ind < 0 || w_ind >= width || h_ind < 0 || h_ind >= height)
+                            continue;
+
+                        float l_dist;
+                        if (channel == 1)
+                        {
+                            l_dist = std::abs(pval - image_ptr[0][0][z + 1][h_ind][w_ind]);
+                        }
+                        else
+                        {
+                            for (int c_i = 0; c_i < channel; c_i++)
+                            {
+                                qval_v[c_i] = image_ptr[0][c_i][z + 1][h_ind][w_ind];
+                            }
+                            l_dist = l1distance(pval_v, qval_v, channel);
+                        }
+                        const float cur_dist = distance_ptr[0][0][z + 1][h_ind][w_ind] + l_eucl * local_dist[h_i * 3 + w_i] + l_grad * l_dist;
+                        new_dist = std::min(new_dist, cur_dist);
+                    }
+                }
+                distance_ptr[0][0][z][h][w] = new_dist;
+                improved += new_dist < old_dist;
+
+                if (transform != nullptr && z + 2 < depth)
+                {
+                    const float out = transform->apply_local(distance_ptr[0][0][z + 2][h][w]);
+                    distance_ptr[0][0][z + 2][h][w] = out;
+                    max_dist[h * width + w] = std::max(max_dist[h * width + w], out);
+                }
+            }
+        }
+    }
+
+    PassResult result;
+    result.improved = improved;
+    if (transform == nullptr)
+        return result;
+
+    // last two planes are not read by any later plane
+    for (int z = std::min(1, depth - 1); z >= 0; z--)
+    {
+        for (int h = 0; h < height; h++)
+        {
+            for (int w = 0; w < width; w++)
+            {
+                const float out = transform->apply_local(distance_ptr[0][0][z][h][w]);
+                distance_ptr[0][0][z][h][w] = out;
+                max_dist[h * width + w] = std::max(max_dist[h * width + w], out);
+            }
+        }
+    }
+    result.max_dist = max_dist.empty() ? 0.0f : *std::max_element(max_dist.begin(), max_dist.end());
+    return result;
+}
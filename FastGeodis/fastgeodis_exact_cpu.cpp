@@ -0,0 +1,104 @@
+// BSD 3-Clause License
+
+// Copyright (c) 2021, Muhammad Asad (masadcv@gmail.com)
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <torch/extension.h>
+#include <vector>
+#include <queue>
+#include <functional>
+#include "fastgeodis.h"
+#include "fastgeodis_raster.h"
+
+std::tuple<torch::Tensor, torch::Tensor> generalised_geodesic_exact_cpu(
+    const torch::Tensor &image,
+    const torch::Tensor &mask,
+    const std::vector<float> &spacing,
+    const float &v,
+    const float &l_grad,
+    const float &l_eucl)
+{
+    // dijkstra over the graph implied by the raster passes, every voxel starts at v * mask
+    const RasterGrid grid = make_raster_grid(image);
+    const int channel = image.size(1);
+    const int64_t numel = grid.numel;
+    const std::vector<RasterNeighbour> neighbours = raster_neighbours(grid, spacing);
+
+    torch::Tensor image_c = image.contiguous();
+    torch::Tensor distance = (v * mask).contiguous();
+    torch::Tensor parent = torch::full(mask.sizes(), raster_self_code(grid), torch::kByte);
+
+    const float *image_ptr = image_c.data_ptr<float>();
+    float *distance_ptr = distance.data_ptr<float>();
+    uint8_t *parent_ptr = parent.data_ptr<uint8_t>();
+
+    typedef std::pair<float, int64_t> HeapItem;
+    std::vector<HeapItem> items;
+    items.reserve(numel);
+    for (int64_t p = 0; p < numel; p++)
+    {
+        items.emplace_back(distance_ptr[p], p);
+    }
+    std::priority_queue<HeapItem, std::vector<HeapItem>, std::greater<HeapItem>> queue(std::greater<HeapItem>(), std::move(items));
+    std::vector<char> done(numel, 0);
+
+    while (!queue.empty())
+    {
+        const HeapItem item = queue.top();
+        queue.pop();
+
+        const int64_t p = item.second;
+        if (done[p] || item.first > distance_ptr[p])
+            continue;
+        done[p] = 1;
+
+        int64_t z, h, w;
+        raster_coordinates(grid, p, z, h, w);
+        for (const RasterNeighbour &n : neighbours)
+        {
+            if (!raster_inside(grid, z + n.dz, h + n.dh, w + n.dw))
+                continue;
+
+            const int64_t q = p + n.dz * grid.stride[0] + n.dh * grid.stride[1] + n.dw;
+            if (done[q])
+                continue;
+
+            const float l_dist = l1distance_strided(image_ptr, image_ptr, p, q, channel, numel);
+            const float cur_dist = distance_ptr[p] + l_eucl * n.local_dist + l_grad * l_dist;
+            if (cur_dist < distance_ptr[q])
+            {
+                distance_ptr[q] = cur_dist;
+                parent_ptr[q] = uint8_t(n.reverse_code);
+                queue.emplace(cur_dist, q);
+            }
+        }
+    }
+
+    return std::make_tuple(distance, parent);
+}
@@ -0,0 +1,203 @@
+// BSD 3-Clause License
+
+// Copyright (c) 2021, Muhammad Asad (masadcv@gmail.com)
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <torch/extension.h>
+#include <vector>
+#include <limits>
+#include <cmath>
+#include "fastgeodis.h"
+#include "fastgeodis_raster.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// dilation distance of theta_d i and erosion distance of theta_e j at voxel p, from the channel
+// pairs of the GeoS distances, a voxel is foreground in candidate i, j when their sum is positive
+static void geos_candidate_distances(const float *distance_ptr, const int64_t &p, const int64_t &numel, const int64_t &num_d, const int64_t &num_e, float *dd, float *de)
+{
+    for (int64_t i = 0; i < num_d; i++)
+    {
+        dd[i] = -(distance_ptr[2 * i * numel + p] - distance_ptr[(2 * i + 1) * numel + p]);
+    }
+    for (int64_t j = 0; j < num_e; j++)
+    {
+        de[j] = distance_ptr[2 * (num_d + j) * numel + p] - distance_ptr[(2 * (num_d + j) + 1) * numel + p];
+    }
+}
+
+std::tuple<torch::Tensor, torch::Tensor> geos_energy_cpu(
+    const torch::Tensor &image,
+    const torch::Tensor &ratio,
+    const torch::Tensor &distances,
+    const int64_t &num_d,
+    const int64_t &num_e,
+    const std::vector<float> &spacing,
+    const float &gamma)
+{
+    // energies of all num_d x num_e candidate segmentations in one pass over the voxels, the unary term
+    // and the contrast sensitive weight of each neighbour pair are computed once and shared by all candidates
+    const RasterGrid grid = make_raster_grid(image);
+    const std::vector<int> axes = raster_axes(grid);
+    const int channel = image.size(1);
+    const int64_t numel = grid.numel;
+    const int64_t num_rows = numel / grid.size[2];
+    const int64_t num_candidates = num_d * num_e;
+    const float eps = 1e-6;
+
+    torch::Tensor image_c = image.contiguous();
+    torch::Tensor ratio_c = ratio.contiguous();
+    torch::Tensor distances_c = distances.contiguous();
+    const float *image_ptr = image_c.data_ptr<float>();
+    const float *ratio_ptr = ratio_c.data_ptr<float>();
+    const float *distance_ptr = distances_c.data_ptr<float>();
+
+    auto squared_difference = [&](const int64_t &p, const int64_t &q) -> float
+    {
+        float sq = 0.0;
+        for (int c = 0; c < channel; c++)
+        {
+            const float diff = image_ptr[c * numel + q] - image_ptr[c * numel + p];
+            sq += diff * diff;
+        }
+        return sq;
+    };
+
+    // mean squared image difference between axis neighbours scales the contrast sensitive weights
+    double sq_sum = 0.0;
+    int64_t sq_count = 0;
+    for (const int &axis : axes)
+    {
+        sq_count += numel / grid.size[axis] * (grid.size[axis] - 1);
+    }
+    // use openmp to parallelise the loop over the rows
+    #ifdef _OPENMP
+        #pragma omp parallel for num_threads(geodesic_num_threads()) reduction(+:sq_sum)
+    #endif
+    for (int64_t row = 0; row < num_rows; row++)
+    {
+        const int64_t z = row / grid.size[1];
+        const int64_t h = row % grid.size[1];
+        for (int64_t w = 0; w < grid.size[2]; w++)
+        {
+            const int64_t coord[3] = {z, h, w};
+            const int64_t p = z * grid.stride[0] + h * grid.stride[1] + w;
+            for (const int &axis : axes)
+            {
+                if (coord[axis] + 1 < grid.size[axis])
+                    sq_sum += squared_difference(p, p + grid.stride[axis]);
+            }
+        }
+    }
+    const float eta = sq_count > 0 && sq_sum > 0 ? float(2.0 * sq_sum / sq_count) : 1.0f;
+
+    // energies summed per row and then over the rows in order, so that they do not depend on the threads
+    std::vector<double> row_energies(num_rows * num_candidates, 0.0);
+    // use openmp to parallelise the loop over the rows
+    #ifdef _OPENMP
+        #pragma omp parallel for num_threads(geodesic_num_threads())
+    #endif
+    for (int64_t row = 0; row < num_rows; row++)
+    {
+        const int64_t z = row / grid.size[1];
+        const int64_t h = row % grid.size[1];
+        double *energy = row_energies.data() + row * num_candidates;
+        std::vector<float> dd_p(num_d), de_p(num_e), dd_q(num_d), de_q(num_e);
+        for (int64_t w = 0; w < grid.size[2]; w++)
+        {
+            const int64_t coord[3] = {z, h, w};
+            const int64_t p = z * grid.stride[0] + h * grid.stride[1] + w;
+            geos_candidate_distances(distance_ptr, p, numel, num_d, num_e, dd_p.data(), de_p.data());
+
+            // unary costs of labelling foreground and background, clamped to stay finite
+            const float r = std::min(std::max(ratio_ptr[p], eps), 1 - eps);
+            const float u_fg = -std::log(r);
+            const float u_bg = -std::log(1 - r);
+            for (int64_t i = 0; i < num_d; i++)
+            {
+                for (int64_t j = 0; j < num_e; j++)
+                {
+                    energy[i * num_e + j] += dd_p[i] + de_p[j] > 0 ? u_fg : u_bg;
+                }
+            }
+
+            // boundary cost of each forward neighbour with a different label
+            for (const int &axis : axes)
+            {
+                if (coord[axis] + 1 >= grid.size[axis])
+                    continue;
+
+                const int64_t q = p + grid.stride[axis];
+                const float weight = std::exp(-squared_difference(p, q) / eta) / spacing[axis - (3 - grid.num_dims)];
+                geos_candidate_distances(distance_ptr, q, numel, num_d, num_e, dd_q.data(), de_q.data());
+                for (int64_t i = 0; i < num_d; i++)
+                {
+                    for (int64_t j = 0; j < num_e; j++)
+                    {
+                        if ((dd_p[i] + de_p[j] > 0) != (dd_q[i] + de_q[j] > 0))
+                            energy[i * num_e + j] += gamma * weight;
+                    }
+                }
+            }
+        }
+    }
+
+    torch::Tensor energies = torch::zeros({num_d, num_e}, torch::kFloat);
+    float *energies_ptr = energies.data_ptr<float>();
+    int64_t best = 0;
+    for (int64_t k = 0; k < num_candidates; k++)
+    {
+        double sum = 0.0;
+        for (int64_t row = 0; row < num_rows; row++)
+        {
+            sum += row_energies[row * num_candidates + k];
+        }
+        energies_ptr[k] = float(sum);
+        if (energies_ptr[k] < energies_ptr[best])
+            best = k;
+    }
+
+    // only the segmentation of the lowest energy is written out
+    const int64_t best_d = best / num_e;
+    const int64_t best_e = best % num_e;
+    torch::Tensor segmentation = torch::empty(ratio_c.sizes(), torch::kFloat);
+    float *segmentation_ptr = segmentation.data_ptr<float>();
+    // use openmp to parallelise the loop over the voxels
+    #ifdef _OPENMP
+        #pragma omp parallel for num_threads(geodesic_num_threads())
+    #endif
+    for (int64_t p = 0; p < numel; p++)
+    {
+        const float dd = -(distance_ptr[2 * best_d * numel + p] - distance_ptr[(2 * best_d + 1) * numel + p]);
+        const float de = distance_ptr[2 * (num_d + best_e) * numel + p] - distance_ptr[(2 * (num_d + best_e) + 1) * numel + p];
+        segmentation_ptr[p] = dd + de > 0 ? 1.0f : 0.0f;
+    }
+
+    return std::make_tuple(segmentation, energies);
+}
@@ -0,0 +1,147 @@
+// BSD 3-Clause License
+
+// Copyright (c) 2021, Muhammad Asad (masadcv@gmail.com)
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <torch/extension.h>
+#include <vector>
+#include <limits>
+#include "fastgeodis.h"
+#include "fastgeodis_raster.h"
+
+inline int64_t knn_insert(float *dist, int *label, const int &k, const float &cand, const int &cand_label)
+{
+    // insert candidate into ascending list of k distances with distinct labels,
+    // an existing entry of the same label is replaced only if candidate is smaller
+    int last = k - 1;
+    for (int j = 0; j < k; j++)
+    {
+        if (label[j] == cand_label)
+        {
+            last = j;
+            break;
+        }
+    }
+    if (cand >= dist[last])
+    {
+        return 0;
+    }
+
+    int pos = last;
+    while (pos > 0 && dist[pos - 1] > cand)
+    {
+        dist[pos] = dist[pos - 1];
+        label[pos] = label[pos - 1];
+        pos--;
+    }
+    dist[pos] = cand;
+    label[pos] = cand_label;
+    return 1;
+}
+
+std::tuple<torch::Tensor, torch::Tensor> generalised_geodesic_knn_cpu(
+    const torch::Tensor &image,
+    const torch::Tensor &labels,
+    const int &k,
+    const std::vector<float> &spacing,
+    const float &l_grad,
+    const float &l_eucl,
+    const int &iterations)
+{
+    const RasterGrid grid = make_raster_grid(image);
+    const int channel = image.size(1);
+    const int64_t numel = grid.numel;
+
+    torch::Tensor image_c = image.contiguous();
+    torch::Tensor labels_c = labels.to(torch::kInt).contiguous();
+    const float *image_ptr = image_c.data_ptr<float>();
+    const int *labels_ptr = labels_c.data_ptr<int>();
+
+    // k sorted entries stored contiguously for each voxel
+    torch::Tensor knn_dist = torch::full({numel, k}, std::numeric_limits<float>::infinity(), torch::kFloat);
+    torch::Tensor knn_label = torch::full({numel, k}, -1, torch::kInt);
+    float *dist_ptr = knn_dist.data_ptr<float>();
+    int *label_ptr = knn_label.data_ptr<int>();
+
+    for (int64_t p = 0; p < numel; p++)
+    {
+        if (labels_ptr[p] >= 0)
+        {
+            dist_ptr[p * k] = 0.0;
+            label_ptr[p * k] = labels_ptr[p];
+        }
+    }
+
+    auto relax = [&](const int64_t &p, const int64_t &q, const float &local_dist, const int &) -> int64_t
+    {
+        float *dist_p = dist_ptr + p * k;
+        int *label_p = label_ptr + p * k;
+        const float *dist_q = dist_ptr + q * k;
+        const int *label_q = label_ptr + q * k;
+
+        const float edge = l_eucl * local_dist + l_grad * l1distance_strided(image_ptr, image_ptr, p, q, channel, numel);
+        int64_t changed = 0;
+        for (int j = 0; j < k; j++)
+        {
+            // entries of q are sorted, none of the rest can enter the list of p
+            const float cand = dist_q[j] + edge;
+            if (label_q[j] < 0 || cand >= dist_p[k - 1])
+                break;
+
+            changed += knn_insert(dist_p, label_p, k, cand, label_q[j]);
+        }
+        return changed;
+    };
+
+    // iteratively run the distance transform
+    for (int itr = 0; itr < iterations; itr++)
+    {
+        for (const int &axis : raster_axes(grid))
+        {
+            float local_dist[3*3];
+            raster_local_dist(grid, spacing, axis, local_dist);
+
+            raster_sweep_cpu(grid, axis, 1, local_dist, relax);
+            raster_sweep_cpu(grid, axis, -1, local_dist, relax);
+        }
+    }
+
+    // batch, k, [depth], height, width
+    std::vector<int64_t> out_shape = {grid.size[0], grid.size[1], grid.size[2], k};
+    std::vector<int64_t> out_perm = {3, 0, 1, 2};
+    if (grid.num_dims == 2)
+    {
+        out_shape = {grid.size[1], grid.size[2], k};
+        out_perm = {2, 0, 1};
+    }
+    torch::Tensor out_dist = knn_dist.view(out_shape).permute(out_perm).unsqueeze(0).contiguous();
+    torch::Tensor out_label = knn_label.view(out_shape).permute(out_perm).unsqueeze(0).to(torch::kLong).contiguous();
+
+    return std::make_tuple(out_dist, out_label);
+}
@@ -0,0 +1,102 @@
+// BSD 3-Clause License
+
+// Copyright (c) 2021, Muhammad Asad (masadcv@gmail.com)
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <torch/extension.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <string>
+#include "fastgeodis.h"
+
+// workspace of the cpu raster engines, tensors own their memory through a deleter that keeps a count of
+// live bytes, so the high-water mark of a call can be compared with estimate_memory()
+
+struct WorkspaceCounters
+{
+    std::atomic<int64_t> current{0};
+    std::atomic<int64_t> peak{0};
+};
+
+static WorkspaceCounters &workspace_counters()
+{
+    static WorkspaceCounters counters;
+    return counters;
+}
+
+torch::Tensor workspace_empty(const c10::IntArrayRef &sizes, const torch::ScalarType &dtype)
+{
+    int64_t numel = 1;
+    for (const int64_t &s : sizes)
+    {
+        numel *= s;
+    }
+    const int64_t bytes = numel * int64_t(c10::elementSize(dtype));
+    void *data = std::malloc(std::max<int64_t>(bytes, 1));
+    if (data == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+
+    WorkspaceCounters &counters = workspace_counters();
+    const int64_t current = counters.current += bytes;
+    int64_t peak = counters.peak.load();
+    while (current > peak && !counters.peak.compare_exchange_weak(peak, current))
+    {
+    }
+
+    return torch::from_blob(data, sizes, [bytes](void *ptr)
+    {
+        std::free(ptr);
+        workspace_counters().current -= bytes;
+    }, torch::TensorOptions().dtype(dtype));
+}
+
+torch::Tensor workspace_contiguous(const torch::Tensor &tensor)
+{
+    if (tensor.is_contiguous())
+    {
+        return tensor;
+    }
+    return workspace_empty(tensor.sizes(), tensor.scalar_type()).copy_(tensor);
+}
+
+std::map<std::string, int64_t> workspace_memory_info()
+{
+    const WorkspaceCounters &counters = workspace_counters();
+    return {{"current_bytes", counters.current.load()}, {"peak_bytes", counters.peak.load()}};
+}
+
+void reset_workspace_peak()
+{
+    WorkspaceCounters &counters = workspace_counters();
+    counters.peak.store(counters.current.load());
+}
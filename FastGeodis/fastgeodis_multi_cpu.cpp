@@ -0,0 +1,92 @@
+// BSD 3-Clause License
+
+// Copyright (c) 2021, Muhammad Asad (masadcv@gmail.com)
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+
+#include <torch/extension.h>
+#include <vector>
+#include "fastgeodis.h"
+#include "fastgeodis_raster.h"
+
+torch::Tensor generalised_geodesic_multi_cpu(
+    const torch::Tensor &image,
+    const torch::Tensor &masks,
+    const std::vector<float> &spacing,
+    const float &v,
+    const float &l_grad,
+    const float &l_eucl,
+    const int &iterations)
+{
+    // one distance transform per mask channel in the same sweeps, the image term of each
+    // neighbour pair is computed once and shared by all masks
+    const RasterGrid grid = make_raster_grid(image);
+    const int channel = image.size(1);
+    const int num_masks = masks.size(1);
+    const int64_t numel = grid.numel;
+
+    torch::Tensor image_c = image.contiguous();
+    torch::Tensor distance = workspace_empty(masks.sizes(), torch::kFloat).copy_(masks).mul_(v);
+
+    const float *image_ptr = image_c.data_ptr<float>();
+    float *distance_ptr = distance.data_ptr<float>();
+
+    auto relax = [&](const int64_t &p, const int64_t &q, const float &local_dist, const int &code) -> int64_t
+    {
+        const float l_dist = l1distance_strided(image_ptr, image_ptr, p, q, channel, numel);
+        const float eucl_dist = l_eucl * local_dist;
+        const float grad_dist = l_grad * l_dist;
+        int64_t changed = 0;
+        for (int m = 0; m < num_masks; m++)
+        {
+            const float cur_dist = distance_ptr[m * numel + q] + eucl_dist + grad_dist;
+            if (cur_dist < distance_ptr[m * numel + p])
+            {
+                distance_ptr[m * numel + p] = cur_dist;
+                changed++;
+            }
+        }
+        return changed;
+    };
+
+    // iteratively run the distance transform
+    for (int itr = 0; itr < iterations; itr++)
+    {
+        for (const int &axis : raster_axes(grid))
+        {
+            float local_dist[3*3];
+            raster_local_dist(grid, spacing, axis, local_dist);
+
+            raster_sweep_cpu(grid, axis, 1, local_dist, relax);
+            raster_sweep_cpu(grid, axis, -1, local_dist, relax);
+        }
+    }
+
+    return distance;
+}
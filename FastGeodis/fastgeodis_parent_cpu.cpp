@@ -0,0 +1,162 @@
+// BSD 3-Clause License
+
+// Copyright (c) 2021, Muhammad Asad (masadcv@gmail.com)
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <torch/extension.h>
+#include <vector>
+#include <algorithm>
+#include "fastgeodis.h"
+#include "fastgeodis_raster.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+std::tuple<torch::Tensor, torch::Tensor> generalised_geodesic_parent_cpu(
+    const torch::Tensor &image,
+    const torch::Tensor &mask,
+    const std::vector<float> &spacing,
+    const float &v,
+    const float &l_grad,
+    const float &l_eucl,
+    const int &iterations)
+{
+    const RasterGrid grid = make_raster_grid(image);
+    const int channel = image.size(1);
+    const int64_t numel = grid.numel;
+
+    torch::Tensor image_c = image.contiguous();
+    torch::Tensor distance = (v * mask).contiguous();
+    torch::Tensor parent = torch::full(mask.sizes(), raster_self_code(grid), torch::kByte);
+
+    const float *image_ptr = image_c.data_ptr<float>();
+    float *distance_ptr = distance.data_ptr<float>();
+    uint8_t *parent_ptr = parent.data_ptr<uint8_t>();
+
+    // record the neighbour providing each strict improvement
+    auto relax = [&](const int64_t &p, const int64_t &q, const float &local_dist, const int &code) -> int64_t
+    {
+        const float l_dist = l1distance_strided(image_ptr, image_ptr, p, q, channel, numel);
+        const float cur_dist = distance_ptr[q] + l_eucl * local_dist + l_grad * l_dist;
+        if (cur_dist < distance_ptr[p])
+        {
+            distance_ptr[p] = cur_dist;
+            parent_ptr[p] = uint8_t(code);
+            return 1;
+        }
+        return 0;
+    };
+
+    // iteratively run the distance transform
+    for (int itr = 0; itr < iterations; itr++)
+    {
+        for (const int &axis : raster_axes(grid))
+        {
+            float local_dist[3*3];
+            raster_local_dist(grid, spacing, axis, local_dist);
+
+            raster_sweep_cpu(grid, axis, 1, local_dist, relax);
+            raster_sweep_cpu(grid, axis, -1, local_dist, relax);
+        }
+    }
+
+    return std::make_tuple(distance, parent);
+}
+
+std::vector<torch::Tensor> geodesic_backtrack_cpu(const torch::Tensor &parent, const torch::Tensor &points)
+{
+    const RasterGrid grid = make_raster_grid(parent);
+    const int num_dims = grid.num_dims;
+    const int self_code = raster_self_code(grid);
+    raster_check_points(grid, points);
+
+    torch::Tensor parent_c = parent.contiguous();
+    torch::Tensor points_c = points.to(torch::kLong).contiguous();
+    const uint8_t *parent_ptr = parent_c.data_ptr<uint8_t>();
+    const int64_t *points_ptr = points_c.data_ptr<int64_t>();
+    const int64_t num_points = points_c.size(0);
+
+    std::vector<std::vector<int64_t>> paths(num_points);
+    std::vector<char> has_cycle(num_points, 0);
+
+    // use openmp to parallelise the loop over points
+    #ifdef _OPENMP
+        #pragma omp parallel for
+    #endif
+    for (int64_t i = 0; i < num_points; i++)
+    {
+        int64_t z, h, w;
+        raster_coordinates(grid, raster_point_index(grid, points_ptr, i), z, h, w);
+
+        // each parent has a strictly smaller distance, so a path never revisits a voxel
+        std::vector<int64_t> &path = paths[i];
+        for (int64_t step = 0; step <= grid.numel; step++)
+        {
+            if (num_dims == 3)
+            {
+                path.push_back(z);
+            }
+            path.push_back(h);
+            path.push_back(w);
+
+            const int code = parent_ptr[z * grid.stride[0] + h * grid.stride[1] + w];
+            if (code == self_code)
+            {
+                break;
+            }
+            if (step == grid.numel)
+            {
+                has_cycle[i] = 1;
+                break;
+            }
+
+            int dz, dh, dw;
+            raster_neighbour_offset(grid, code, dz, dh, dw);
+            z += dz;
+            h += dh;
+            w += dw;
+        }
+    }
+
+    if (std::find(has_cycle.begin(), has_cycle.end(), 1) != has_cycle.end())
+    {
+        throw std::runtime_error("parent map contains a cycle, it was not produced by a geodesic distance transform");
+    }
+
+    // paths from point to seed, shape path_length, num_dims
+    std::vector<torch::Tensor> out;
+    for (int64_t i = 0; i < num_points; i++)
+    {
+        const int64_t length = int64_t(paths[i].size()) / num_dims;
+        torch::Tensor path = torch::empty({length, num_dims}, torch::kLong);
+        std::copy(paths[i].begin(), paths[i].end(), path.data_ptr<int64_t>());
+        out.push_back(path);
+    }
+    return out;
+}
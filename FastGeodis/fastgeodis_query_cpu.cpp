@@ -0,0 +1,277 @@
+// BSD 3-Clause License
+
+// Copyright (c) 2021, Muhammad Asad (masadcv@gmail.com)
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+
+#include <torch/extension.h>
+#include <vector>
+#include <queue>
+#include <unordered_map>
+#include <functional>
+#include <limits>
+#include <algorithm>
+#include "fastgeodis.h"
+#include "fastgeodis_raster.h"
+
+// side of the blocks grouping seeds for the heuristic, in voxels
+#define SEED_BLOCK_SIZE 8
+
+// bounding box of the seeds within one block, in voxel coordinates
+struct SeedBox
+{
+    int64_t lo[3];
+    int64_t hi[3];
+};
+
+static std::vector<SeedBox> seed_boxes(const RasterGrid &grid, const float *distance_ptr, const float &v, float &seed_min)
+{
+    // seeds are voxels starting below v, boxes are kept per block so a few clicks give exact euclidean bounds
+    const int64_t blocks_h = (grid.size[1] + SEED_BLOCK_SIZE - 1) / SEED_BLOCK_SIZE;
+    const int64_t blocks_w = (grid.size[2] + SEED_BLOCK_SIZE - 1) / SEED_BLOCK_SIZE;
+    std::unordered_map<int64_t, SeedBox> blocks;
+    seed_min = v;
+    for (int64_t p = 0; p < grid.numel; p++)
+    {
+        if (!(distance_ptr[p] < v))
+            continue;
+
+        seed_min = std::min(seed_min, distance_ptr[p]);
+        int64_t c[3];
+        raster_coordinates(grid, p, c[0], c[1], c[2]);
+        const int64_t block = ((c[0] / SEED_BLOCK_SIZE) * blocks_h + c[1] / SEED_BLOCK_SIZE) * blocks_w + c[2] / SEED_BLOCK_SIZE;
+
+        auto it = blocks.find(block);
+        if (it == blocks.end())
+        {
+            SeedBox box;
+            for (int a = 0; a < 3; a++)
+            {
+                box.lo[a] = c[a];
+                box.hi[a] = c[a];
+            }
+            blocks.emplace(block, box);
+        }
+        else
+        {
+            for (int a = 0; a < 3; a++)
+            {
+                it->second.lo[a] = std::min(it->second.lo[a], c[a]);
+                it->second.hi[a] = std::max(it->second.hi[a], c[a]);
+            }
+        }
+    }
+
+    std::vector<SeedBox> boxes;
+    boxes.reserve(blocks.size());
+    for (const auto &block : blocks)
+    {
+        boxes.push_back(block.second);
+    }
+    return boxes;
+}
+
+static float seed_heuristic(
+    const RasterGrid &grid,
+    const std::vector<SeedBox> &boxes,
+    const float *axis_spacing,
+    const float &seed_min,
+    const float &v,
+    const float &l_eucl,
+    const int64_t &p)
+{
+    // every step costs at least l_eucl times its euclidean length, so l_eucl times the euclidean
+    // distance to the nearest seed box plus the smallest seed value is a consistent lower bound,
+    // and no path costs more than v as every voxel starts at most at v
+    int64_t c[3];
+    raster_coordinates(grid, p, c[0], c[1], c[2]);
+    float nearest = std::numeric_limits<float>::infinity();
+    for (const SeedBox &box : boxes)
+    {
+        float sq = 0.0;
+        for (int a = 0; a < 3; a++)
+        {
+            const int64_t gap = std::max(std::max(box.lo[a] - c[a], c[a] - box.hi[a]), int64_t(0));
+            const float d = float(gap) * axis_spacing[a];
+            sq += d * d;
+        }
+        nearest = std::min(nearest, sq);
+    }
+    return std::min(l_eucl * std::sqrt(nearest) + seed_min, v);
+}
+
+std::tuple<torch::Tensor, torch::Tensor, std::vector<torch::Tensor>> geodesic_query_cpu(
+    const torch::Tensor &image,
+    const torch::Tensor &mask,
+    const torch::Tensor &points,
+    const std::vector<float> &spacing,
+    const float &v,
+    const float &l_grad,
+    const float &l_eucl,
+    const bool &return_path)
+{
+    // A* from each query point to the virtual target reached from any voxel p at cost v * mask[p],
+    // which gives the same distance as generalised_geodesic_exact at the query points
+    const RasterGrid grid = make_raster_grid(image);
+    const int num_dims = grid.num_dims;
+    const int channel = image.size(1);
+    const int64_t numel = grid.numel;
+    const std::vector<RasterNeighbour> neighbours = raster_neighbours(grid, spacing);
+    raster_check_points(grid, points);
+
+    torch::Tensor image_c = image.contiguous();
+    torch::Tensor seed = (v * mask).contiguous();
+    torch::Tensor points_c = points.to(torch::kLong).contiguous();
+    const float *image_ptr = image_c.data_ptr<float>();
+    const float *seed_ptr = seed.data_ptr<float>();
+    const int64_t *points_ptr = points_c.data_ptr<int64_t>();
+    const int64_t num_points = points_c.size(0);
+
+    const float axis_spacing[3] = {
+        num_dims == 3 ? spacing[0] : 1.0f,
+        spacing[num_dims - 2],
+        spacing[num_dims - 1]};
+    float seed_min;
+    const std::vector<SeedBox> boxes = seed_boxes(grid, seed_ptr, v, seed_min);
+
+    torch::Tensor distance = torch::zeros({num_points}, torch::kFloat);
+    torch::Tensor expanded = torch::zeros({num_points}, torch::kLong);
+    float *distance_out = distance.data_ptr<float>();
+    int64_t *expanded_out = expanded.data_ptr<int64_t>();
+    std::vector<std::vector<int64_t>> paths(num_points);
+
+    // use openmp to parallelise the loop over query points, each search only touches the voxels it expands
+    #ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic)
+    #endif
+    for (int64_t i = 0; i < num_points; i++)
+    {
+        struct Node
+        {
+            float g;
+            int64_t parent;
+            bool closed;
+        };
+        typedef std::pair<float, int64_t> HeapItem;
+        std::unordered_map<int64_t, Node> nodes;
+        std::priority_queue<HeapItem, std::vector<HeapItem>, std::greater<HeapItem>> queue;
+
+        const int64_t start = raster_point_index(grid, points_ptr, i);
+        nodes[start] = {0.0f, -1, false};
+        queue.emplace(seed_heuristic(grid, boxes, axis_spacing, seed_min, v, l_eucl, start), start);
+
+        float best = std::numeric_limits<float>::infinity();
+        int64_t best_node = start;
+        int64_t count = 0;
+        while (!queue.empty() && queue.top().first < best)
+        {
+            const int64_t p = queue.top().second;
+            queue.pop();
+
+            Node &node_p = nodes[p];
+            if (node_p.closed)
+                continue;
+            node_p.closed = true;
+            const float g_p = node_p.g;
+            count++;
+
+            // reaching the target through p ends the path at p
+            if (g_p + seed_ptr[p] < best)
+            {
+                best = g_p + seed_ptr[p];
+                best_node = p;
+            }
+
+            int64_t z, h, w;
+            raster_coordinates(grid, p, z, h, w);
+            for (const RasterNeighbour &n : neighbours)
+            {
+                if (!raster_inside(grid, z + n.dz, h + n.dh, w + n.dw))
+                    continue;
+
+                const int64_t q = p + n.dz * grid.stride[0] + n.dh * grid.stride[1] + n.dw;
+                const float l_dist = l1distance_strided(image_ptr, image_ptr, p, q, channel, numel);
+                const float cur_dist = g_p + l_eucl * n.local_dist + l_grad * l_dist;
+
+                auto it = nodes.find(q);
+                if (it == nodes.end())
+                {
+                    nodes[q] = {cur_dist, p, false};
+                }
+                else if (!it->second.closed && cur_dist < it->second.g)
+                {
+                    it->second.g = cur_dist;
+                    it->second.parent = p;
+                }
+                else
+                {
+                    continue;
+                }
+                queue.emplace(cur_dist + seed_heuristic(grid, boxes, axis_spacing, seed_min, v, l_eucl, q), q);
+            }
+        }
+
+        distance_out[i] = best;
+        expanded_out[i] = count;
+
+        if (return_path)
+        {
+            // walk back from the voxel reaching the target, then order the path from the query point
+            std::vector<int64_t> chain;
+            for (int64_t p = best_node; p != -1; p = nodes[p].parent)
+            {
+                chain.push_back(p);
+            }
+            std::vector<int64_t> &path = paths[i];
+            for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+            {
+                int64_t z, h, w;
+                raster_coordinates(grid, *it, z, h, w);
+                if (num_dims == 3)
+                    path.push_back(z);
+                path.push_back(h);
+                path.push_back(w);
+            }
+        }
+    }
+
+    std::vector<torch::Tensor> path_tensors;
+    if (return_path)
+    {
+        for (int64_t i = 0; i < num_points; i++)
+        {
+            const int64_t length = int64_t(paths[i].size()) / num_dims;
+            torch::Tensor path = torch::empty({length, num_dims}, torch::kLong);
+            std::copy(paths[i].begin(), paths[i].end(), path.data_ptr<int64_t>());
+            path_tensors.push_back(path);
+        }
+    }
+
+    return std::make_tuple(distance, expanded, path_tensors);
+}
@@ -0,0 +1,270 @@
+// BSD 3-Clause License
+
+// Copyright (c) 2021, Muhammad Asad (masadcv@gmail.com)
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <torch/extension.h>
+#include <vector>
+#include <cmath>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// depth, height, width of a contiguous volume, 2D inputs have depth 1
+struct RasterGrid
+{
+    int num_dims;
+    int64_t size[3];
+    int64_t stride[3];
+    int64_t numel;
+};
+
+inline RasterGrid make_raster_grid(const torch::Tensor &image)
+{
+    // image of shape batch, channel, [depth], height, width
+    RasterGrid grid;
+    grid.num_dims = image.dim() - 2;
+    grid.size[0] = grid.num_dims == 3 ? image.size(2) : 1;
+    grid.size[1] = image.size(image.dim() - 2);
+    grid.size[2] = image.size(image.dim() - 1);
+    grid.stride[2] = 1;
+    grid.stride[1] = grid.size[2];
+    grid.stride[0] = grid.size[1] * grid.size[2];
+    grid.numel = grid.size[0] * grid.stride[0];
+    return grid;
+}
+
+// axes swept by one iteration, in the same order as generalised_geodesic2d/3d
+inline std::vector<int> raster_axes(const RasterGrid &grid)
+{
+    if (grid.num_dims == 3)
+    {
+        return {0, 1, 2};
+    }
+    return {1, 2};
+}
+
+// neighbour code of offset dz, dh, dw in [-1, 1], 2D codes drop dz so that they fit in 4 bits
+inline int raster_neighbour_code(const RasterGrid &grid, const int &dz, const int &dh, const int &dw)
+{
+    if (grid.num_dims == 3)
+    {
+        return (dz + 1) * 9 + (dh + 1) * 3 + (dw + 1);
+    }
+    return (dh + 1) * 3 + (dw + 1);
+}
+
+// code of the voxel itself, used for seeds without a parent
+inline int raster_self_code(const RasterGrid &grid)
+{
+    return raster_neighbour_code(grid, 0, 0, 0);
+}
+
+inline void raster_neighbour_offset(const RasterGrid &grid, const int &code, int &dz, int &dh, int &dw)
+{
+    if (grid.num_dims == 3)
+    {
+        dz = code / 9 - 1;
+    }
+    else
+    {
+        dz = 0;
+    }
+    dh = (code / 3) % 3 - 1;
+    dw = code % 3 - 1;
+}
+
+inline void raster_local_dist(const RasterGrid &grid, const std::vector<float> &spacing, const int &axis, float *local_dist)
+{
+    // local distance to 3x3 neighbourhood in the previous plane along axis
+    // 2D uses euclidean steps as generalised_geodesic2d, 3D sums spacing steps as generalised_geodesic3d
+    const int b = axis == 0 ? 1 : 0;
+    const int c = axis == 2 ? 1 : 2;
+    for (int o_b = 0; o_b < 3; o_b++)
+    {
+        for (int o_c = 0; o_c < 3; o_c++)
+        {
+            float ld;
+            if (grid.num_dims == 3)
+            {
+                // sum in the order of generalised_geodesic3d, whose width pass swaps width with depth,
+                // so that rounding and thresholds of the distances match it exactly
+                const float step_b = float(std::abs(o_b - 1)) * spacing[b];
+                const float step_c = float(std::abs(o_c - 1)) * spacing[c];
+                ld = spacing[axis];
+                ld += axis == 2 ? step_c : step_b;
+                ld += axis == 2 ? step_b : step_c;
+            }
+            else
+            {
+                ld = std::sqrt(float(1 + (o_b - 1) * (o_b - 1) + (o_c - 1) * (o_c - 1)));
+            }
+            local_dist[o_b * 3 + o_c] = ld;
+        }
+    }
+}
+
+// full 8 (2D) or 26 (3D) neighbourhood with the local distances used by the raster passes
+struct RasterNeighbour
+{
+    int dz;
+    int dh;
+    int dw;
+    float local_dist;
+    // code of this offset and of the opposite offset, pointing back from the neighbour
+    int code;
+    int reverse_code;
+};
+
+inline std::vector<RasterNeighbour> raster_neighbours(const RasterGrid &grid, const std::vector<float> &spacing)
+{
+    std::vector<RasterNeighbour> neighbours;
+    const int z_range = grid.num_dims == 3 ? 1 : 0;
+    for (int dz = -z_range; dz <= z_range; dz++)
+    {
+        for (int dh = -1; dh <= 1; dh++)
+        {
+            for (int dw = -1; dw <= 1; dw++)
+            {
+                if (dz == 0 && dh == 0 && dw == 0)
+                    continue;
+
+                RasterNeighbour n;
+                n.dz = dz;
+                n.dh = dh;
+                n.dw = dw;
+                if (grid.num_dims == 3)
+                {
+                    n.local_dist = float(std::abs(dz)) * spacing[0] + float(std::abs(dh)) * spacing[1] + float(std::abs(dw)) * spacing[2];
+                }
+                else
+                {
+                    n.local_dist = std::sqrt(float(dh * dh + dw * dw));
+                }
+                n.code = raster_neighbour_code(grid, dz, dh, dw);
+                n.reverse_code = raster_neighbour_code(grid, -dz, -dh, -dw);
+                neighbours.push_back(n);
+            }
+        }
+    }
+    return neighbours;
+}
+
+inline void raster_coordinates(const RasterGrid &grid, const int64_t &p, int64_t &z, int64_t &h, int64_t &w)
+{
+    z = p / grid.stride[0];
+    h = (p / grid.stride[1]) % grid.size[1];
+    w = p % grid.size[2];
+}
+
+inline bool raster_inside(const RasterGrid &grid, const int64_t &z, const int64_t &h, const int64_t &w)
+{
+    return z >= 0 && z < grid.size[0] && h >= 0 && h < grid.size[1] && w >= 0 && w < grid.size[2];
+}
+
+inline void raster_check_points(const RasterGrid &grid, const torch::Tensor &points)
+{
+    // points of shape N, num_dims with spatial coordinates inside the grid
+    if (points.dim() != 2 || points.size(1) != grid.num_dims)
+    {
+        throw std::invalid_argument("points must have shape (N, " + std::to_string(grid.num_dims) + ")");
+    }
+    torch::Tensor points_c = points.to(torch::kLong).contiguous();
+    const int64_t *points_ptr = points_c.data_ptr<int64_t>();
+    for (int64_t i = 0; i < points_c.numel(); i++)
+    {
+        const int64_t size = grid.size[3 - grid.num_dims + i % grid.num_dims];
+        if (points_ptr[i] < 0 || points_ptr[i] >= size)
+        {
+            throw std::invalid_argument("point " + std::to_string(i / grid.num_dims) + " is outside of the input");
+        }
+    }
+}
+
+inline int64_t raster_point_index(const RasterGrid &grid, const int64_t *points_ptr, const int64_t &i)
+{
+    const int num_dims = grid.num_dims;
+    const int64_t z = num_dims == 3 ? points_ptr[i * num_dims] : 0;
+    const int64_t h = points_ptr[i * num_dims + num_dims - 2];
+    const int64_t w = points_ptr[i * num_dims + num_dims - 1];
+    return z * grid.stride[0] + h * grid.stride[1] + w;
+}
+
+// sweeps all planes along axis in direction, relaxing each voxel p from the 3x3 neighbourhood q in the
+// previous plane with relax(p, q, local_dist, neighbour_code) which returns the number of updated values
+template <typename Relax>
+int64_t raster_sweep_cpu(const RasterGrid &grid, const int &axis, const int &direction, const float *local_dist, Relax relax)
+{
+    const int b = axis == 0 ? 1 : 0;
+    const int c = axis == 2 ? 1 : 2;
+    const int64_t n_a = grid.size[axis];
+    const int64_t n_b = grid.size[b];
+    const int64_t n_c = grid.size[c];
+    const int64_t s_a = grid.stride[axis];
+    const int64_t s_b = grid.stride[b];
+    const int64_t s_c = grid.stride[c];
+
+    int64_t changed = 0;
+    const int64_t start = direction > 0 ? 1 : n_a - 2;
+    for (int64_t i = start; i >= 0 && i < n_a; i += direction)
+    {
+        // use openmp to parallelise the loops over the plane
+        #ifdef _OPENMP
+            #pragma omp parallel for collapse(2) reduction(+:changed)
+        #endif
+        for (int64_t j = 0; j < n_b; j++)
+        {
+            for (int64_t k = 0; k < n_c; k++)
+            {
+                const int64_t p = i * s_a + j * s_b + k * s_c;
+                for (int o_b = 0; o_b < 3; o_b++)
+                {
+                    for (int o_c = 0; o_c < 3; o_c++)
+                    {
+                        const int64_t j_ind = j + o_b - 1;
+                        const int64_t k_ind = k + o_c - 1;
+                        if (j_ind < 0 || j_ind >= n_b || k_ind < 0 || k_ind >= n_c)
+                            continue;
+
+                        int offset[3];
+                        offset[axis] = -direction;
+                        offset[b] = o_b - 1;
+                        offset[c] = o_c - 1;
+
+                        const int64_t q = (i - direction) * s_a + j_ind * s_b + k_ind * s_c;
+                        changed += relax(p, q, local_dist[o_b * 3 + o_c], raster_neighbour_code(grid, offset[0], offset[1], offset[2]));
+                    }
+                }
+            }
+        }
+    }
+    return changed;
+}
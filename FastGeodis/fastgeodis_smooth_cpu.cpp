@@ -0,0 +1,116 @@
+// BSD 3-Clause License
+
+// Copyright (c) 2021, Muhammad Asad (masadcv@gmail.com)
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <torch/extension.h>
+#include <vector>
+#include <algorithm>
+#include "common.h"
+#include "fastgeodis.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+void smooth_axis_cpu(const float *in, float *out, const int64_t &outer, const int64_t &len, const int64_t &inner, const std::vector<float> &weights)
+{
+    // convolves every line along an axis of length len, lines are inner-contiguous so each row of the
+    // output is accumulated from whole rows of the input, borders are replicated
+    const int radius = int(weights.size() / 2);
+
+    // use openmp to parallelise the loop over lines
+    #ifdef _OPENMP
+        #pragma omp parallel for num_threads(geodesic_num_threads())
+    #endif
+    for (int64_t ol = 0; ol < outer * len; ol++)
+    {
+        const int64_t o = ol / len;
+        const int64_t l = ol % len;
+        float *out_row = out + ol * inner;
+        std::fill(out_row, out_row + inner, 0.0f);
+        for (int k = -radius; k <= radius; k++)
+        {
+            const int64_t l_k = std::min(std::max(l + k, int64_t(0)), len - 1);
+            const float *in_row = in + (o * len + l_k) * inner;
+            const float w = weights[k + radius];
+            for (int64_t i = 0; i < inner; i++)
+            {
+                out_row[i] += w * in_row[i];
+            }
+        }
+    }
+}
+
+torch::Tensor smooth_image_cpu(const torch::Tensor &image, const Presmoothing &smoothing, const std::vector<float> &spacing)
+{
+    // image is [1, C, spatial...], each smoothed axis is one pass that ping-pongs between two buffers
+    // and the first pass reads the input directly, so at most one scratch tensor is needed
+    torch::Tensor input = image.contiguous();
+    const int num_spatial = input.dim() - 2;
+
+    std::vector<int> axes;
+    std::vector<std::vector<float>> axis_weights;
+    for (int a = 0; a < num_spatial; a++)
+    {
+        std::vector<float> w = smoothing.weights(a, spacing[a]);
+        if (w.size() > 1)
+        {
+            axes.push_back(a);
+            axis_weights.push_back(w);
+        }
+    }
+    if (axes.empty())
+    {
+        return input;
+    }
+
+    torch::Tensor output = workspace_empty(input.sizes(), torch::kFloat);
+    torch::Tensor scratch = axes.size() > 1 ? workspace_empty(input.sizes(), torch::kFloat) : output;
+
+    const float *src = input.data_ptr<float>();
+    for (size_t i = 0; i < axes.size(); i++)
+    {
+        // choose the buffer so that the last pass lands in output
+        float *dst = ((axes.size() - 1 - i) % 2 == 0) ? output.data_ptr<float>() : scratch.data_ptr<float>();
+
+        const int dim = axes[i] + 2;
+        int64_t outer = 1, inner = 1;
+        for (int d = 0; d < dim; d++)
+        {
+            outer *= input.size(d);
+        }
+        for (int d = dim + 1; d < input.dim(); d++)
+        {
+            inner *= input.size(d);
+        }
+        smooth_axis_cpu(src, dst, outer, input.size(dim), inner, axis_weights[i]);
+        src = dst;
+    }
+
+    return output;
+}
@@ -0,0 +1,259 @@
+// BSD 3-Clause License
+
+// Copyright (c) 2021, Muhammad Asad (masadcv@gmail.com)
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <torch/extension.h>
+#include <vector>
+#include "fastgeodis.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+int64_t geodesic_slice_pass_cpu(
+    const float *image_z,
+    float *distance_z,
+    const float *image_n,
+    const float *distance_n,
+    const int &channel,
+    const int &height,
+    const int &width,
+    const float *local_dist,
+    const float &l_grad,
+    const float &l_eucl)
+{
+    // relax slice z from the 3x3 neighbourhood of each pixel in adjacent slice n
+    const int64_t plane = int64_t(height) * width;
+    int64_t changed = 0;
+
+    // use openmp to parallelise the loops over height and width
+    #ifdef _OPENMP
+        #pragma omp parallel for collapse(2) reduction(+:changed)
+    #endif
+    for (int h = 0; h < height; h++)
+    {
+        for (int w = 0; w < width; w++)
+        {
+            const int64_t p = int64_t(h) * width + w;
+            float new_dist = distance_z[p];
+
+            for (int h_i = 0; h_i < 3; h_i++)
+            {
+                for (int w_i = 0; w_i < 3; w_i++)
+                {
+                    const int h_ind = h + h_i - 1;
+                    const int w_ind = w + w_i - 1;
+
+                    if (w_ind < 0 || w_ind >= width || h_ind < 0 || h_ind >= height)
+                        continue;
+
+                    const int64_t q = int64_t(h_ind) * width + w_ind;
+                    const float l_dist = l1distance_strided(image_z, image_n, p, q, channel, plane);
+                    const float cur_dist = distance_n[q] + l_eucl * local_dist[h_i * 3 + w_i] + l_grad * l_dist;
+                    new_dist = std::min(new_dist, cur_dist);
+                }
+            }
+            if (new_dist < distance_z[p])
+            {
+                distance_z[p] = new_dist;
+                changed++;
+            }
+        }
+    }
+    return changed;
+}
+
+GeodesicStream3d::GeodesicStream3d(const std::vector<float> &spacing, const float &v, const float &l_grad, const float &l_eucl, const int &iterations)
+    : spacing_(spacing), v_(v), l_grad_(l_grad), l_eucl_(l_eucl), iterations_(iterations), repaired_slices_(0)
+{
+    if (spacing.size() != 3)
+    {
+        throw std::invalid_argument(
+            "function only supports 3D spacing inputs, received " + std::to_string(spacing.size()));
+    }
+}
+
+torch::Tensor GeodesicStream3d::append_slice(const torch::Tensor &image, const torch::Tensor &mask)
+{
+    // each slice is a 2D input of shape batch, channel, height, width
+    check_input_dimensions(image, mask, 4);
+    check_cpu(image);
+    check_cpu(mask);
+
+    // reject before touching the stream, a stored slice is relaxed on every later append
+    if (image.scalar_type() != torch::kFloat || mask.scalar_type() != torch::kFloat)
+    {
+        throw std::invalid_argument("appended slice is not float32, try using image.float() and mask.float()");
+    }
+
+    if (!image_slices_.empty())
+    {
+        const torch::Tensor &first = image_slices_.front();
+        if (image.size(1) != first.size(0) || image.size(2) != first.size(1) || image.size(3) != first.size(2))
+        {
+            throw std::invalid_argument("shape of appended slice does not match the streamed volume");
+        }
+    }
+
+    image_slices_.push_back(image[0].contiguous());
+    distance_slices_.push_back((v_ * mask[0][0]).contiguous());
+
+    const int64_t z = depth() - 1;
+
+    // front-back into the new slice, then in-plane
+    if (z > 0)
+    {
+        relax_slice(z, z - 1);
+    }
+    relax_inplane(z);
+
+    // back-front repair, stops at the first slice that does not change
+    int64_t lowest = z;
+    for (int64_t z_r = z - 1; z_r >= 0; z_r--)
+    {
+        if (relax_slice(z_r, z_r + 1) == 0)
+        {
+            break;
+        }
+        relax_inplane(z_r);
+        lowest = z_r;
+    }
+
+    // front-back over the repaired slices only
+    for (int64_t z_r = lowest + 1; z_r <= z; z_r++)
+    {
+        if (relax_slice(z_r, z_r - 1) > 0)
+        {
+            relax_inplane(z_r);
+        }
+    }
+    repaired_slices_ = z - lowest;
+
+    return distance_slices_.back().clone().unsqueeze(0).unsqueeze(0);
+}
+
+torch::Tensor GeodesicStream3d::distance() const
+{
+    if (distance_slices_.empty())
+    {
+        return torch::empty({1, 1, 0, 0, 0});
+    }
+    return torch::stack(distance_slices_, 0).unsqueeze(0).unsqueeze(0);
+}
+
+int64_t GeodesicStream3d::depth() const
+{
+    return int64_t(distance_slices_.size());
+}
+
+int64_t GeodesicStream3d::repaired_slices() const
+{
+    return repaired_slices_;
+}
+
+void GeodesicStream3d::reset()
+{
+    image_slices_.clear();
+    distance_slices_.clear();
+    repaired_slices_ = 0;
+}
+
+int64_t GeodesicStream3d::relax_slice(const int64_t &z, const int64_t &z_n)
+{
+    const torch::Tensor &image_z = image_slices_[z];
+    const int channel = image_z.size(0);
+    const int height = image_z.size(1);
+    const int width = image_z.size(2);
+
+    float local_dist[3*3];
+    for (int h_i = 0; h_i < 3; h_i++)
+    {
+        for (int w_i = 0; w_i < 3; w_i++)
+        {
+            float ld = spacing_[0];
+            ld += float(std::abs(h_i-1)) * spacing_[1];
+            ld += float(std::abs(w_i-1)) * spacing_[2];
+
+            local_dist[h_i * 3 + w_i] = ld;
+        }
+    }
+
+    return geodesic_slice_pass_cpu(
+        image_z.data_ptr<float>(), distance_slices_[z].data_ptr<float>(),
+        image_slices_[z_n].data_ptr<float>(), distance_slices_[z_n].data_ptr<float>(),
+        channel, height, width, local_dist, l_grad_, l_eucl_);
+}
+
+int64_t GeodesicStream3d::relax_inplane(const int64_t &z)
+{
+    const torch::Tensor &image_z = image_slices_[z];
+    const int channel = image_z.size(0);
+    const int height = image_z.size(1);
+    const int width = image_z.size(2);
+    const int64_t plane = int64_t(height) * width;
+
+    const float *image_ptr = image_z.data_ptr<float>();
+    float *distance_ptr = distance_slices_[z].data_ptr<float>();
+
+    // step along the sweep direction plus step across it
+    const float local_dist_h[] = {spacing_[1] + spacing_[2], spacing_[1], spacing_[1] + spacing_[2]};
+    const float local_dist_w[] = {spacing_[2] + spacing_[1], spacing_[2], spacing_[2] + spacing_[1]};
+
+    int64_t changed = 0;
+    for (int itr = 0; itr < iterations_; itr++)
+    {
+        int64_t itr_changed = 0;
+
+        // top-bottom and bottom-top - height*, width
+        for (int direction : {1, -1})
+        {
+            int line_begin = 0, line_end = height - 1, elem_begin, elem_end;
+            itr_changed += geodesic_line_sweep_cpu(
+                image_ptr, distance_ptr, channel, plane, height, width, width, 1,
+                local_dist_h, direction, l_grad_, l_eucl_, line_begin, line_end, elem_begin, elem_end);
+        }
+
+        // left-right and right-left - width*, height
+        for (int direction : {1, -1})
+        {
+            int line_begin = 0, line_end = width - 1, elem_begin, elem_end;
+            itr_changed += geodesic_line_sweep_cpu(
+                image_ptr, distance_ptr, channel, plane, width, height, 1, width,
+                local_dist_w, direction, l_grad_, l_eucl_, line_begin, line_end, elem_begin, elem_end);
+        }
+
+        // * indicates the current direction of pass
+        changed += itr_changed;
+        if (itr_changed == 0)
+        {
+            break;
+        }
+    }
+    return changed;
+}
@@ -0,0 +1,441 @@
+// BSD 3-Clause License
+
+// Copyright (c) 2021, Muhammad Asad (masadcv@gmail.com)
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <torch/extension.h>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include "fastgeodis.h"
+#include "fastgeodis_raster.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// number of SLIC assignment and update rounds
+#define SUPERPIXEL_ITERATIONS 5
+
+// superpixels start as a regular grid of cells of step voxels, each superpixel only takes voxels from the
+// cells around its home cell, so all of its voxels can be visited through that window
+struct SuperpixelGrid
+{
+    RasterGrid grid;
+    int64_t step;
+    int64_t cells[3];
+    int64_t num_cells;
+};
+
+struct SuperpixelNode
+{
+    int64_t count;
+    float centroid[3];
+    float min_mask;
+};
+
+static SuperpixelGrid make_superpixel_grid(const RasterGrid &grid, const int64_t &step)
+{
+    SuperpixelGrid sp;
+    sp.grid = grid;
+    sp.step = step;
+    sp.num_cells = 1;
+    for (int a = 0; a < 3; a++)
+    {
+        sp.cells[a] = (grid.size[a] + step - 1) / step;
+        sp.num_cells *= sp.cells[a];
+    }
+    return sp;
+}
+
+static void superpixel_window(const SuperpixelGrid &sp, const int64_t &k, int64_t lo[3], int64_t hi[3])
+{
+    // voxel range of the cells next to the home cell of superpixel k
+    const int64_t cell[3] = {k / (sp.cells[1] * sp.cells[2]), (k / sp.cells[2]) % sp.cells[1], k % sp.cells[2]};
+    for (int a = 0; a < 3; a++)
+    {
+        lo[a] = std::max(int64_t(0), (cell[a] - 1) * sp.step);
+        hi[a] = std::min(sp.grid.size[a], (cell[a] + 2) * sp.step);
+    }
+}
+
+template <typename Visit>
+static void superpixel_visit(const SuperpixelGrid &sp, const int32_t *label_ptr, const int64_t &k, Visit visit)
+{
+    // calls visit(p, z, h, w) for every voxel p labelled k
+    int64_t lo[3], hi[3];
+    superpixel_window(sp, k, lo, hi);
+    for (int64_t z = lo[0]; z < hi[0]; z++)
+    {
+        for (int64_t h = lo[1]; h < hi[1]; h++)
+        {
+            for (int64_t w = lo[2]; w < hi[2]; w++)
+            {
+                const int64_t p = z * sp.grid.stride[0] + h * sp.grid.stride[1] + w;
+                if (label_ptr[p] == k)
+                {
+                    visit(p, z, h, w);
+                }
+            }
+        }
+    }
+}
+
+torch::Tensor generalised_geodesic_superpixel_cpu(
+    const torch::Tensor &image,
+    const torch::Tensor &mask,
+    const std::vector<float> &spacing,
+    const float &v,
+    const float &l_grad,
+    const float &l_eucl,
+    const int &superpixel_size,
+    const float &compactness)
+{
+    // coarse distance from dijkstra over the superpixel adjacency graph, refined at voxel level inside
+    // the superpixels that hold seeds and their neighbours
+    const RasterGrid grid = make_raster_grid(image);
+    const SuperpixelGrid sp = make_superpixel_grid(grid, superpixel_size);
+    const int channel = image.size(1);
+    const int64_t numel = grid.numel;
+    const int64_t num_cells = sp.num_cells;
+    const int z_range = grid.num_dims == 3 ? 1 : 0;
+
+    torch::Tensor image_c = image.contiguous();
+    torch::Tensor mask_c = mask.contiguous();
+    torch::Tensor label = torch::empty(mask.sizes(), torch::kInt);
+    torch::Tensor distance = torch::empty_like(mask_c);
+
+    const float *image_ptr = image_c.data_ptr<float>();
+    const float *mask_ptr = mask_c.data_ptr<float>();
+    int32_t *label_ptr = label.data_ptr<int32_t>();
+    float *distance_ptr = distance.data_ptr<float>();
+
+    // superpixel centres start at the middle of their cells
+    std::vector<SuperpixelNode> nodes(num_cells);
+    std::vector<float> colour(num_cells * channel);
+    #ifdef _OPENMP
+        #pragma omp parallel for
+    #endif
+    for (int64_t k = 0; k < num_cells; k++)
+    {
+        const int64_t cell[3] = {k / (sp.cells[1] * sp.cells[2]), (k / sp.cells[2]) % sp.cells[1], k % sp.cells[2]};
+        int64_t centre[3];
+        for (int a = 0; a < 3; a++)
+        {
+            centre[a] = std::min(cell[a] * sp.step + sp.step / 2, grid.size[a] - 1);
+            nodes[k].centroid[a] = float(centre[a]);
+        }
+        nodes[k].count = 1;
+        nodes[k].min_mask = 1.0;
+        const int64_t p = centre[0] * grid.stride[0] + centre[1] * grid.stride[1] + centre[2];
+        for (int c_i = 0; c_i < channel; c_i++)
+        {
+            colour[k * channel + c_i] = image_ptr[c_i * numel + p];
+        }
+    }
+
+    const float spatial_weight = (compactness / float(sp.step)) * (compactness / float(sp.step));
+    for (int itr = 0; itr < SUPERPIXEL_ITERATIONS; itr++)
+    {
+        // assign each voxel to the closest centre in colour and space among the neighbouring cells
+        #ifdef _OPENMP
+            #pragma omp parallel for
+        #endif
+        for (int64_t p = 0; p < numel; p++)
+        {
+            int64_t z, h, w;
+            raster_coordinates(grid, p, z, h, w);
+            const int64_t cell[3] = {z / sp.step, h / sp.step, w / sp.step};
+
+            float best = std::numeric_limits<float>::infinity();
+            int32_t best_k = 0;
+            for (int64_t dz = -z_range; dz <= z_range; dz++)
+            {
+                for (int64_t dh = -1; dh <= 1; dh++)
+                {
+                    for (int64_t dw = -1; dw <= 1; dw++)
+                    {
+                        const int64_t cz = cell[0] + dz, ch = cell[1] + dh, cw = cell[2] + dw;
+                        if (cz < 0 || cz >= sp.cells[0] || ch < 0 || ch >= sp.cells[1] || cw < 0 || cw >= sp.cells[2])
+                            continue;
+
+                        const int64_t k = (cz * sp.cells[1] + ch) * sp.cells[2] + cw;
+                        if (nodes[k].count == 0)
+                            continue;
+
+                        float colour_dist = 0.0;
+                        for (int c_i = 0; c_i < channel; c_i++)
+                        {
+                            const float diff = image_ptr[c_i * numel + p] - colour[k * channel + c_i];
+                            colour_dist += diff * diff;
+                        }
+                        const float oz = float(z) - nodes[k].centroid[0];
+                        const float oh = float(h) - nodes[k].centroid[1];
+                        const float ow = float(w) - nodes[k].centroid[2];
+                        const float dist = colour_dist + spatial_weight * (oz * oz + oh * oh + ow * ow);
+                        if (dist < best)
+                        {
+                            best = dist;
+                            best_k = int32_t(k);
+                        }
+                    }
+                }
+            }
+            label_ptr[p] = best_k;
+        }
+
+        // move centres to the mean colour and position of their voxels
+        #ifdef _OPENMP
+            #pragma omp parallel for
+        #endif
+        for (int64_t k = 0; k < num_cells; k++)
+        {
+            SuperpixelNode node = {0, {0.0, 0.0, 0.0}, 1.0};
+            std::vector<double> colour_sum(channel, 0.0);
+            double position_sum[3] = {0.0, 0.0, 0.0};
+            superpixel_visit(sp, label_ptr, k, [&](const int64_t &p, const int64_t &z, const int64_t &h, const int64_t &w) {
+                node.count++;
+                position_sum[0] += z;
+                position_sum[1] += h;
+                position_sum[2] += w;
+                node.min_mask = std::min(node.min_mask, mask_ptr[p]);
+                for (int c_i = 0; c_i < channel; c_i++)
+                {
+                    colour_sum[c_i] += image_ptr[c_i * numel + p];
+                }
+            });
+            if (node.count > 0)
+            {
+                for (int a = 0; a < 3; a++)
+                {
+                    node.centroid[a] = float(position_sum[a] / node.count);
+                }
+                for (int c_i = 0; c_i < channel; c_i++)
+                {
+                    colour[k * channel + c_i] = float(colour_sum[c_i] / node.count);
+                }
+            }
+            nodes[k] = node;
+        }
+    }
+
+    // region adjacency graph from face neighbours with different labels
+    std::vector<std::vector<int32_t>> adjacency(num_cells);
+    #ifdef _OPENMP
+        #pragma omp parallel for
+    #endif
+    for (int64_t k = 0; k < num_cells; k++)
+    {
+        std::vector<int32_t> &adj = adjacency[k];
+        superpixel_visit(sp, label_ptr, k, [&](const int64_t &p, const int64_t &z, const int64_t &h, const int64_t &w) {
+            const int64_t coord[3] = {z, h, w};
+            for (int a = 3 - grid.num_dims; a < 3; a++)
+            {
+                for (int d = -1; d <= 1; d += 2)
+                {
+                    if (coord[a] + d < 0 || coord[a] + d >= grid.size[a])
+                        continue;
+                    const int32_t l = label_ptr[p + d * grid.stride[a]];
+                    if (l != k && std::find(adj.begin(), adj.end(), l) == adj.end())
+                    {
+                        adj.push_back(l);
+                    }
+                }
+            }
+        });
+    }
+
+    // dijkstra between superpixel centroids, edges weighted by centroid distance and mean colour difference
+    std::vector<float> node_distance(num_cells, std::numeric_limits<float>::infinity());
+    typedef std::pair<float, int64_t> HeapItem;
+    std::priority_queue<HeapItem, std::vector<HeapItem>, std::greater<HeapItem>> node_queue;
+    for (int64_t k = 0; k < num_cells; k++)
+    {
+        if (nodes[k].count > 0)
+        {
+            node_distance[k] = v * nodes[k].min_mask;
+            node_queue.emplace(node_distance[k], k);
+        }
+    }
+    while (!node_queue.empty())
+    {
+        const HeapItem item = node_queue.top();
+        node_queue.pop();
+
+        const int64_t k = item.second;
+        if (item.first > node_distance[k])
+            continue;
+
+        for (const int32_t &l : adjacency[k])
+        {
+            float ld = 0.0;
+            if (grid.num_dims == 3)
+            {
+                // summed spacing steps as generalised_geodesic3d
+                for (int a = 0; a < 3; a++)
+                {
+                    ld += std::abs(nodes[l].centroid[a] - nodes[k].centroid[a]) * spacing[a];
+                }
+            }
+            else
+            {
+                const float oh = nodes[l].centroid[1] - nodes[k].centroid[1];
+                const float ow = nodes[l].centroid[2] - nodes[k].centroid[2];
+                ld = std::sqrt(oh * oh + ow * ow);
+            }
+            float l_dist = 0.0;
+            for (int c_i = 0; c_i < channel; c_i++)
+            {
+                l_dist += std::abs(colour[l * channel + c_i] - colour[k * channel + c_i]);
+            }
+            const float cur_dist = node_distance[k] + l_eucl * ld + l_grad * l_dist;
+            if (cur_dist < node_distance[l])
+            {
+                node_distance[l] = cur_dist;
+                node_queue.emplace(cur_dist, l);
+            }
+        }
+    }
+
+    // superpixels holding seeds and their neighbours are refined at voxel level
+    std::vector<char> refine(num_cells, 0);
+    for (int64_t k = 0; k < num_cells; k++)
+    {
+        if (nodes[k].count > 0 && nodes[k].min_mask < 1.0)
+        {
+            refine[k] = 1;
+            for (const int32_t &l : adjacency[k])
+            {
+                refine[l] = 1;
+            }
+        }
+    }
+
+    // 0 coarse, 1 refined and pending, 2 settled
+    std::vector<uint8_t> state(numel, 0);
+    #ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic)
+    #endif
+    for (int64_t k = 0; k < num_cells; k++)
+    {
+        superpixel_visit(sp, label_ptr, k, [&](const int64_t &p, const int64_t &z, const int64_t &h, const int64_t &w) {
+            if (refine[k])
+            {
+                state[p] = 1;
+                distance_ptr[p] = v * mask_ptr[p];
+                return;
+            }
+
+            // coarse voxels take one step from the centroid of their own or an adjacent superpixel
+            const float coord[3] = {float(z), float(h), float(w)};
+            float best = node_distance[k];
+            for (int64_t i = -1; i < int64_t(adjacency[k].size()); i++)
+            {
+                const int64_t l = i < 0 ? k : adjacency[k][i];
+                float ld = 0.0;
+                if (grid.num_dims == 3)
+                {
+                    for (int a = 0; a < 3; a++)
+                    {
+                        ld += std::abs(coord[a] - nodes[l].centroid[a]) * spacing[a];
+                    }
+                }
+                else
+                {
+                    const float oh = coord[1] - nodes[l].centroid[1];
+                    const float ow = coord[2] - nodes[l].centroid[2];
+                    ld = std::sqrt(oh * oh + ow * ow);
+                }
+                float l_dist = 0.0;
+                for (int c_i = 0; c_i < channel; c_i++)
+                {
+                    l_dist += std::abs(image_ptr[c_i * numel + p] - colour[l * channel + c_i]);
+                }
+                best = std::min(best, node_distance[l] + l_eucl * ld + l_grad * l_dist);
+            }
+            distance_ptr[p] = best;
+        });
+    }
+
+    // voxel dijkstra inside the refined region, coarse voxels next to it act as fixed sources
+    const std::vector<RasterNeighbour> neighbours = raster_neighbours(grid, spacing);
+    std::priority_queue<HeapItem, std::vector<HeapItem>, std::greater<HeapItem>> queue;
+    for (int64_t k = 0; k < num_cells; k++)
+    {
+        if (!refine[k])
+            continue;
+
+        superpixel_visit(sp, label_ptr, k, [&](const int64_t &p, const int64_t &z, const int64_t &h, const int64_t &w) {
+            queue.emplace(distance_ptr[p], p);
+            for (const RasterNeighbour &n : neighbours)
+            {
+                if (!raster_inside(grid, z + n.dz, h + n.dh, w + n.dw))
+                    continue;
+                const int64_t q = p + n.dz * grid.stride[0] + n.dh * grid.stride[1] + n.dw;
+                if (state[q] == 0)
+                {
+                    queue.emplace(distance_ptr[q], q);
+                }
+            }
+        });
+    }
+    while (!queue.empty())
+    {
+        const HeapItem item = queue.top();
+        queue.pop();
+
+        const int64_t p = item.second;
+        if (state[p] == 2 || item.first > distance_ptr[p])
+            continue;
+        state[p] = 2;
+
+        int64_t z, h, w;
+        raster_coordinates(grid, p, z, h, w);
+        for (const RasterNeighbour &n : neighbours)
+        {
+            if (!raster_inside(grid, z + n.dz, h + n.dh, w + n.dw))
+                continue;
+
+            const int64_t q = p + n.dz * grid.stride[0] + n.dh * grid.stride[1] + n.dw;
+            if (state[q] != 1)
+                continue;
+
+            const float l_dist = l1distance_strided(image_ptr, image_ptr, p, q, channel, numel);
+            const float cur_dist = distance_ptr[p] + l_eucl * n.local_dist + l_grad * l_dist;
+            if (cur_dist < distance_ptr[q])
+            {
+                distance_ptr[q] = cur_dist;
+                queue.emplace(cur_dist, q);
+            }
+        }
+    }
+
+    return distance;
+}
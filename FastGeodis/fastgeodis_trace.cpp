@@ -0,0 +1,126 @@
+// BSD 3-Clause License
+
+// Copyright (c) 2021, Muhammad Asad (masadcv@gmail.com)
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <torch/extension.h>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "common.h"
+#include "fastgeodis.h"
+
+// spans recorded by TraceSpan on any thread between start_trace() and stop_trace(), written out as
+// complete events of the chrome trace event format, which chrome://tracing and perfetto both load
+
+struct TraceEvent
+{
+    const char *name;
+    int tid;
+    int64_t begin_ns;
+    int64_t end_ns;
+};
+
+struct TraceBuffer
+{
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+    int64_t origin_ns = 0;
+    int64_t dropped = 0;
+};
+
+// bounds the memory of a trace left running, about 100 MB of events
+static const size_t MAX_TRACE_EVENTS = size_t(1) << 22;
+
+static TraceBuffer &trace_buffer()
+{
+    static TraceBuffer buffer;
+    return buffer;
+}
+
+static int trace_thread_id()
+{
+    // small stable ids, openmp thread numbers repeat across nested and concurrent teams
+    static std::atomic<int> next_id{0};
+    static thread_local int id = next_id++;
+    return id;
+}
+
+void record_trace_span(const char *name, const int64_t &begin_ns, const int64_t &end_ns)
+{
+    const int tid = trace_thread_id();
+    TraceBuffer &buffer = trace_buffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    if (buffer.events.size() >= MAX_TRACE_EVENTS)
+    {
+        buffer.dropped++;
+        return;
+    }
+    buffer.events.push_back({name, tid, begin_ns, end_ns});
+}
+
+void start_trace()
+{
+    TraceBuffer &buffer = trace_buffer();
+    {
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        buffer.events.clear();
+        buffer.dropped = 0;
+        buffer.origin_ns = trace_clock_ns();
+    }
+    geodesic_tracing().store(true);
+}
+
+std::string stop_trace()
+{
+    geodesic_tracing().store(false);
+
+    TraceBuffer &buffer = trace_buffer();
+    std::vector<TraceEvent> events;
+    int64_t origin_ns, dropped;
+    {
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        events.swap(buffer.events);
+        origin_ns = buffer.origin_ns;
+        dropped = buffer.dropped;
+    }
+
+    // timestamps are microseconds since start_trace(), span names are string literals without quotes
+    std::string json = "{\"displayTimeUnit\": \"ms\", \"otherData\": {\"dropped_events\": " + std::to_string(dropped) + "}, \"traceEvents\": [";
+    char line[256];
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        const TraceEvent &e = events[i];
+        std::snprintf(line, sizeof(line), "%s\n{\"name\": \"%s\", \"cat\": \"FastGeodis\", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+            i > 0 ? "," : "", e.name, e.tid, (e.begin_ns - origin_ns) / 1e3, (e.end_ns - e.begin_ns) / 1e3);
+        json += line;
+    }
+    json += "\n]}\n";
+    return json;
+}
@@ -0,0 +1,173 @@
+// BSD 3-Clause License
+
+// Copyright (c) 2021, Muhammad Asad (masadcv@gmail.com)
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <torch/extension.h>
+#include <vector>
+#include "fastgeodis.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+GeodesicVideo2d::GeodesicVideo2d(const float &v, const float &l_grad, const float &l_eucl, const float &threshold, const int &max_iterations)
+    : v_(v), l_grad_(l_grad), l_eucl_(l_eucl), threshold_(threshold), max_iterations_(max_iterations), iterations_(0), repaired_pixels_(0)
+{
+}
+
+torch::Tensor GeodesicVideo2d::process_frame(const torch::Tensor &image, const torch::Tensor &mask)
+{
+    // each frame is a 2D input of shape batch, channel, height, width
+    check_input_dimensions(image, mask, 4);
+    check_cpu(image);
+    check_cpu(mask);
+
+    torch::Tensor frame_image = image[0].contiguous();
+    torch::Tensor frame_seed = (v_ * mask[0][0]).contiguous();
+
+    const int channel = frame_image.size(0);
+    const int height = frame_image.size(1);
+    const int width = frame_image.size(2);
+    const int64_t plane = int64_t(height) * width;
+
+    // bounding box of pixels whose distance has to be recomputed
+    int h_begin = 0, h_end = height - 1;
+    int w_begin = 0, w_end = width - 1;
+
+    if (!distance_.defined() || image_.sizes() != frame_image.sizes())
+    {
+        // cold start from seeds
+        distance_ = frame_seed.clone();
+        repaired_pixels_ = plane;
+    }
+    else
+    {
+        // pixels with image change beyond threshold or with reduced seed weight
+        torch::Tensor changed = ((frame_image - image_).abs().sum(0) > threshold_) | (frame_seed > seed_);
+        torch::Tensor invalid = torch::zeros_like(changed);
+        if (changed.any().item<bool>())
+        {
+            // shortest paths only pass through pixels of lower distance, so pixels below
+            // the smallest previous distance of changed pixels keep a valid upper bound
+            const float d_min = distance_.masked_select(changed).min().item<float>();
+            invalid = distance_ >= d_min;
+        }
+
+        // new seeds can only lower the distance
+        torch::Tensor dirty = invalid | (frame_seed < distance_);
+        distance_ = torch::where(invalid, frame_seed, torch::min(distance_, frame_seed)).contiguous();
+        repaired_pixels_ = invalid.sum().item<int64_t>();
+
+        torch::Tensor dirty_idx = torch::nonzero(dirty);
+        if (dirty_idx.size(0) == 0)
+        {
+            h_begin = height;
+            h_end = -1;
+            w_begin = width;
+            w_end = -1;
+        }
+        else
+        {
+            h_begin = dirty_idx.select(1, 0).min().item<int>();
+            h_end = dirty_idx.select(1, 0).max().item<int>();
+            w_begin = dirty_idx.select(1, 1).min().item<int>();
+            w_end = dirty_idx.select(1, 1).max().item<int>();
+        }
+    }
+
+    const float local_dist[] = {sqrt(float(2.)), float(1.), sqrt(float(2.))};
+    const float *image_ptr = frame_image.data_ptr<float>();
+    float *distance_ptr = distance_.data_ptr<float>();
+
+    // sweep until no pixel changes, growing the box with every changed pixel
+    iterations_ = 0;
+    while (h_begin <= h_end && iterations_ < max_iterations_)
+    {
+        int64_t itr_changed = 0;
+
+        // top-bottom and bottom-top - height*, width
+        for (int direction : {1, -1})
+        {
+            int line_begin = h_begin, line_end = h_end, elem_begin, elem_end;
+            itr_changed += geodesic_line_sweep_cpu(
+                image_ptr, distance_ptr, channel, plane, height, width, width, 1,
+                local_dist, direction, l_grad_, l_eucl_, line_begin, line_end, elem_begin, elem_end);
+
+            h_begin = std::min(h_begin, line_begin);
+            h_end = std::max(h_end, line_end);
+            w_begin = std::min(w_begin, elem_begin);
+            w_end = std::max(w_end, elem_end);
+        }
+
+        // left-right and right-left - width*, height
+        for (int direction : {1, -1})
+        {
+            int line_begin = w_begin, line_end = w_end, elem_begin, elem_end;
+            itr_changed += geodesic_line_sweep_cpu(
+                image_ptr, distance_ptr, channel, plane, width, height, 1, width,
+                local_dist, direction, l_grad_, l_eucl_, line_begin, line_end, elem_begin, elem_end);
+
+            w_begin = std::min(w_begin, line_begin);
+            w_end = std::max(w_end, line_end);
+            h_begin = std::min(h_begin, elem_begin);
+            h_end = std::max(h_end, elem_end);
+        }
+
+        // * indicates the current direction of pass
+        iterations_++;
+        if (itr_changed == 0)
+        {
+            break;
+        }
+    }
+
+    image_ = frame_image;
+    seed_ = frame_seed;
+
+    return distance_.clone().unsqueeze(0).unsqueeze(0);
+}
+
+int GeodesicVideo2d::iterations() const
+{
+    return iterations_;
+}
+
+int64_t GeodesicVideo2d::repaired_pixels() const
+{
+    return repaired_pixels_;
+}
+
+void GeodesicVideo2d::reset()
+{
+    image_ = torch::Tensor();
+    seed_ = torch::Tensor();
+    distance_ = torch::Tensor();
+    iterations_ = 0;
+    repaired_pixels_ = 0;
+}
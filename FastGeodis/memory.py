@@ -0,0 +1,139 @@
+# BSD 3-Clause License
+
+# Copyright (c) 2021, Muhammad Asad (masadcv@gmail.com)
+# All rights reserved.
+
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+
+# 1. Redistributions of source code must retain the above copyright notice, this
+#    list of conditions and the following disclaimer.
+
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+#    this list of conditions and the following disclaimer in the documentation
+#    and/or other materials provided with the distribution.
+
+# 3. Neither the name of the copyright holder nor the names of its
+#    contributors may be used to endorse or promote products derived from
+#    this software without specific prior written permission.
+
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+# OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+r"""Predicted peak memory of FastGeodis CPU engines, so that engines or slab sizes can be chosen before
+running. Estimates follow the allocations of each engine, see workspace_memory() for the measured
+high-water mark of the raster engine workspace.
+"""
+
+import math
+from functools import reduce
+from typing import Dict, Optional, Sequence
+
+_FUNCTIONS = ["generalised_geodesic", "signed_generalised_geodesic", "GSF"]
+_OPTIONS = ["iter", "smooth_sigma", "approx_factor", "theta"]
+_FLOAT = 4
+
+
+def _numel(shape):
+    return reduce(lambda a, b: a * b, shape, 1)
+
+
+def _raster_voxels(channels: int, num_dims: int, iterations: int, smoothed_axes: int):
+    # live float tensors of the raster engine per voxel, counting the returned distance. each transpose
+    # copies image and distance while the previous copies are still referenced
+    smoothing = 0 if smoothed_axes == 0 else channels * (2 if smoothed_axes > 1 else 1)
+    owned_image = channels if smoothed_axes > 0 else 0
+    if iterations < 1:
+        return max(smoothing, owned_image + 1)
+    if num_dims == 2 and iterations == 1:
+        # the first transpose only copies the image once
+        return max(smoothing, owned_image + channels + 1, channels + 2)
+    return max(smoothing, 2 * channels + 1, channels + 2)
+
+
+def _smoothed_axes(smooth_sigma, num_dims: int):
+    if smooth_sigma is None:
+        return 0
+    if isinstance(smooth_sigma, (int, float)):
+        smooth_sigma = [smooth_sigma] * num_dims
+    if len(smooth_sigma) != num_dims:
+        raise ValueError("smooth_sigma needs one value or one per spatial axis, received {}".format(len(smooth_sigma)))
+    return sum(1 for s in smooth_sigma if s > 0)
+
+
+def estimate_memory(
+    shape: Sequence[int],
+    channels: int = 1,
+    function: str = "generalised_geodesic3d",
+    options: Optional[Dict] = None,
+):
+    r"""Predicts peak CPU memory of a FastGeodis call for each engine that can compute it.
+    Peaks count every tensor allocated during the call, including the output, but not the input
+    image and mask, and assume the result cache is disabled and inputs are contiguous float32.
+    The raster estimate matches the workspace high-water mark of generalised_geodesic2d/3d, signed
+    distances and GSF exactly, a list of thetas is filtered by the multi-mask engine without transposes.
+
+    Args:
+        shape: spatial shape, [H, W] for 2D functions or [D, H, W] for 3D functions
+        channels: number of image channels
+        function: "generalised_geodesic", "signed_generalised_geodesic" or "GSF", followed by "2d" or "3d"
+        options: dict with any of iter, smooth_sigma, approx_factor and theta, as passed to the function
+
+    Returns:
+        dict from engine to predicted peak bytes, "raster" for all functions, "exact" and with
+        approx_factor > 1 also "approx" for generalised_geodesic2d/3d
+    """
+    options = dict(options or {})
+    unknown = set(options) - set(_OPTIONS)
+    if unknown:
+        raise ValueError("unknown options {}, expected any of {}".format(sorted(unknown), _OPTIONS))
+    name, num_dims = function[:-2], function[-2:]
+    if name not in _FUNCTIONS or num_dims not in ("2d", "3d"):
+        raise ValueError("function must be one of {} followed by 2d or 3d, received {}".format(_FUNCTIONS, function))
+    num_dims = int(num_dims[0])
+    if len(shape) != num_dims:
+        raise ValueError("{} needs a {}D shape, received {}".format(function, num_dims, list(shape)))
+    if channels < 1 or any(s < 1 for s in shape):
+        raise ValueError("shape and channels must be positive")
+
+    iterations = options.get("iter", 2 if num_dims == 2 else 4)
+    smoothed_axes = _smoothed_axes(options.get("smooth_sigma"), num_dims)
+    factor = options.get("approx_factor", 1)
+    if factor < 1:
+        raise ValueError("approx_factor must be at least 1, received {}".format(factor))
+    theta = options.get("theta", 0.0)
+    if isinstance(theta, (list, tuple)) and len(theta) == 0:
+        raise ValueError("theta must not be an empty list")
+
+    voxels = _numel(shape)
+    raster = _raster_voxels(channels, num_dims, iterations, smoothed_axes) * voxels * _FLOAT
+    if name == "signed_generalised_geodesic":
+        # the first distance and the complement mask are alive while the second distance runs
+        return {"raster": 2 * voxels * _FLOAT + raster}
+    if name == "GSF":
+        if isinstance(theta, (list, tuple)):
+            # four masks per theta and their distances, the masks of stage one take at most half of that
+            return {"raster": 8 * len(theta) * voxels * _FLOAT}
+        # both thresholded masks, a complement or the first result, and the signed distance being computed
+        return {"raster": 5 * voxels * _FLOAT + raster}
+
+    estimate = {"raster": raster}
+    # distance, parent, visited flags and a heap of (distance, index) pairs, assumed to double once
+    estimate["exact"] = voxels * (_FLOAT + 1 + 1 + 3 * 16)
+    if factor > 1:
+        coarse = _numel([math.ceil(s / factor) for s in shape])
+        coarse_raster = _raster_voxels(channels, num_dims, iterations, smoothed_axes) * coarse
+        # pooled image and mask stay alive, the coarse distance is copied before upsampling
+        estimate["approx"] = max(
+            (channels + 1) * coarse + coarse_raster,
+            (channels + 3) * coarse + voxels,
+        ) * _FLOAT
+    return estimate
@@ -0,0 +1,439 @@
+// BSD 3-Clause License
+
+// Copyright (c) 2021, Muhammad Asad (masadcv@gmail.com)
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// micro-benchmark of the cpu kernels and engines, sweeps shape, channels, iterations, lamb, threads,
+// kernel instruction set and engine and reports ns/pixel, GB/s and speedup over the first thread
+// count and instruction set of the sweep. on linux hardware counters (cycles, instructions, last level
+// cache and dTLB misses) are collected around every timed run and reported per pixel, they are left
+// out when perf_event_open is not permitted. see CMakeLists.txt in this directory for building
+//
+// usage: benchmark_fastgeodis [--dims=2,3] [--sizes2d=256,512,1024] [--sizes3d=64,128] [--channels=1,3]
+//                             [--iterations=2,4] [--lambdas=0,1] [--threads=1,<max>] [--isas=all]
+//                             [--engines=raster,exact,superpixel] [--repeats=5] [--counters=1]
+//                             [--json=results.json]
+
+#include <torch/extension.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "fastgeodis.h"
+#include "perf_counters.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+struct Options
+{
+    std::vector<int> dims = {2, 3};
+    std::vector<int> sizes2d = {256, 512, 1024};
+    std::vector<int> sizes3d = {64, 128};
+    std::vector<int> channels = {1, 3};
+    std::vector<int> iterations = {2, 4};
+    std::vector<float> lambdas = {0.0, 1.0};
+    std::vector<int> threads;
+    std::vector<std::string> isas = {"generic", "sse4.2", "avx2", "avx512"};
+    std::vector<std::string> engines = {"raster", "exact", "superpixel"};
+    int repeats = 5;
+    bool counters = true;
+    std::string json;
+};
+
+struct Result
+{
+    std::string kernel;
+    std::string engine;
+    std::string isa;
+    int dims;
+    int size;
+    int channels;
+    int iterations;
+    float lamb;
+    int threads;
+    int64_t pixels;
+    double bytes;
+    double median_ns;
+    double min_ns;
+    // hardware counters per pixel of a run, empty when counters are unavailable
+    std::vector<double> counters;
+    double speedup = 1.0;
+};
+
+std::vector<std::string> split(const std::string &value)
+{
+    std::vector<std::string> out;
+    std::stringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ','))
+    {
+        if (!item.empty())
+            out.push_back(item);
+    }
+    return out;
+}
+
+template <typename T>
+std::vector<T> parse_list(const std::string &value)
+{
+    std::vector<T> out;
+    for (const std::string &item : split(value))
+    {
+        std::stringstream stream(item);
+        T v;
+        stream >> v;
+        out.push_back(v);
+    }
+    return out;
+}
+
+Options parse_options(int argc, char **argv)
+{
+    Options options;
+#ifdef _OPENMP
+    options.threads = {1, omp_get_max_threads()};
+#else
+    options.threads = {1};
+#endif
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg(argv[i]);
+        const size_t eq = arg.find('=');
+        if (arg.rfind("--", 0) != 0 || eq == std::string::npos)
+        {
+            throw std::invalid_argument("expected --name=value, received " + arg);
+        }
+        const std::string name = arg.substr(2, eq - 2);
+        const std::string value = arg.substr(eq + 1);
+        if (name == "dims")
+            options.dims = parse_list<int>(value);
+        else if (name == "sizes2d")
+            options.sizes2d = parse_list<int>(value);
+        else if (name == "sizes3d")
+            options.sizes3d = parse_list<int>(value);
+        else if (name == "channels")
+            options.channels = parse_list<int>(value);
+        else if (name == "iterations")
+            options.iterations = parse_list<int>(value);
+        else if (name == "lambdas")
+            options.lambdas = parse_list<float>(value);
+        else if (name == "threads")
+            options.threads = parse_list<int>(value);
+        else if (name == "isas" && value != "all")
+            options.isas = split(value);
+        else if (name == "engines")
+            options.engines = split(value);
+        else if (name == "repeats")
+            options.repeats = std::max(1, std::stoi(value));
+        else if (name == "counters")
+            options.counters = std::stoi(value) != 0;
+        else if (name == "json")
+            options.json = value;
+        else if (name != "isas")
+            throw std::invalid_argument("unknown option --" + name);
+    }
+    return options;
+}
+
+// opened in main before any parallel region, null if disabled
+static const PerfCounters *perf_counters = nullptr;
+
+template <typename Setup, typename Run>
+void time_ns(const int &repeats, Result &result, Setup setup, Run run)
+{
+    // one warmup run, then median and minimum of repeats, setup is neither timed nor counted
+    std::vector<double> times;
+    std::vector<double> counts(PerfCounters::NUM_COUNTERS, 0.0);
+    for (int r = 0; r <= repeats; r++)
+    {
+        setup();
+        const std::vector<double> before = perf_counters != nullptr ? perf_counters->read() : counts;
+        const auto tic = std::chrono::steady_clock::now();
+        run();
+        const auto toc = std::chrono::steady_clock::now();
+        const std::vector<double> after = perf_counters != nullptr ? perf_counters->read() : counts;
+        if (r == 0)
+            continue;
+        times.push_back(std::chrono::duration<double, std::nano>(toc - tic).count());
+        for (int c = 0; c < PerfCounters::NUM_COUNTERS; c++)
+        {
+            counts[c] += after[c] - before[c];
+        }
+    }
+    std::sort(times.begin(), times.end());
+    result.median_ns = times[times.size() / 2];
+    result.min_ns = times.front();
+
+    result.counters.clear();
+    if (perf_counters != nullptr && perf_counters->any_available())
+    {
+        for (const double &count : counts)
+        {
+            result.counters.push_back(count / (double(repeats) * double(result.pixels)));
+        }
+    }
+}
+
+// bytes an ideal sweep streams per pixel, the image is read once and the distance read and written once
+double sweep_bytes(const int64_t &pixels, const int &channels)
+{
+    return double(pixels) * (4.0 * channels + 8.0);
+}
+
+void run_benchmarks(const Options &options, std::vector<Result> &results)
+{
+    for (const int &dims : options.dims)
+    {
+        const std::vector<int> &sizes = dims == 2 ? options.sizes2d : options.sizes3d;
+        const std::vector<float> spacing = dims == 2 ? std::vector<float>{1.0, 1.0} : std::vector<float>{1.0, 1.0, 1.0};
+        for (const int &size : sizes)
+        {
+            for (const int &channels : options.channels)
+            {
+                torch::manual_seed(size * 16 + channels);
+                std::vector<int64_t> shape = {1, channels, size, size};
+                std::vector<int64_t> mask_shape = {1, 1, size, size};
+                if (dims == 3)
+                {
+                    shape.push_back(size);
+                    mask_shape.push_back(size);
+                }
+                const torch::Tensor image = torch::rand(shape);
+                torch::Tensor mask = torch::ones(mask_shape);
+                // seed at the centre
+                mask.data_ptr<float>()[mask.numel() / 2 + (dims == 2 ? size / 2 : size * size / 2 + size / 2)] = 0.0;
+                const int64_t pixels = mask.numel();
+
+                for (const float &lamb : options.lambdas)
+                {
+                    for (const int &threads : options.threads)
+                    {
+#ifdef _OPENMP
+                        omp_set_num_threads(threads);
+#endif
+                        Result base;
+                        base.dims = dims;
+                        base.size = size;
+                        base.channels = channels;
+                        base.lamb = lamb;
+                        base.threads = threads;
+                        base.pixels = pixels;
+                        base.iterations = 0;
+
+                        for (const std::string &isa : options.isas)
+                        {
+                            // skip variants the host cannot run, they fall back to a narrower one
+                            if (set_cpu_isa(isa) != isa)
+                                continue;
+                            base.isa = isa;
+                            base.engine = "raster";
+
+                            // single directional pass over contiguous tensors
+                            torch::Tensor distance;
+                            Result pass = base;
+                            pass.kernel = dims == 2 ? "geodesic_updown_pass_cpu" : "geodesic_frontback_pass_cpu";
+                            pass.bytes = 2.0 * sweep_bytes(pixels, channels);
+                            time_ns(options.repeats, pass,
+                                [&]() { distance = (1e10 * mask).contiguous(); },
+                                [&]()
+                                {
+                                    if (dims == 2)
+                                        geodesic_updown_pass_cpu(image, distance, lamb, 1 - lamb);
+                                    else
+                                        geodesic_frontback_pass_cpu(image, distance, spacing, lamb, 1 - lamb);
+                                });
+                            results.push_back(pass);
+
+                            if (std::find(options.engines.begin(), options.engines.end(), "raster") == options.engines.end())
+                                continue;
+                            for (const int &iterations : options.iterations)
+                            {
+                                Result full = base;
+                                full.kernel = dims == 2 ? "generalised_geodesic2d_cpu" : "generalised_geodesic3d_cpu";
+                                full.iterations = iterations;
+                                full.bytes = 2.0 * dims * iterations * sweep_bytes(pixels, channels);
+                                torch::Tensor image_w;
+                                time_ns(options.repeats, full,
+                                    [&]() { image_w = image; },
+                                    [&]()
+                                    {
+                                        if (dims == 2)
+                                            generalised_geodesic2d_cpu(image_w, mask, 1e10, lamb, 1 - lamb, iterations);
+                                        else
+                                            generalised_geodesic3d_cpu(image_w, mask, spacing, 1e10, lamb, 1 - lamb, iterations);
+                                    });
+                                results.push_back(full);
+                            }
+                        }
+                        set_cpu_isa("auto");
+                        base.isa = get_cpu_isa();
+
+                        // transpose of image and distance to the next pass direction, as done between passes
+                        Result transpose = base;
+                        transpose.kernel = "transpose";
+                        transpose.engine = "raster";
+                        transpose.bytes = 2.0 * double(pixels) * 4.0 * (channels + 1);
+                        torch::Tensor distance = 1e10 * mask;
+                        time_ns(options.repeats, transpose,
+                            []() {},
+                            [&]()
+                            {
+                                const int axis = dims == 2 ? 3 : 4;
+                                torch::Tensor image_t = image.transpose(2, axis).contiguous();
+                                torch::Tensor distance_t = distance.transpose(2, axis).contiguous();
+                            });
+                        results.push_back(transpose);
+
+                        for (const std::string &engine : options.engines)
+                        {
+                            if (engine == "raster")
+                                continue;
+                            Result other = base;
+                            other.kernel = "generalised_geodesic_" + engine + "_cpu";
+                            other.engine = engine;
+                            other.bytes = sweep_bytes(pixels, channels);
+                            time_ns(options.repeats, other,
+                                []() {},
+                                [&]()
+                                {
+                                    if (engine == "exact")
+                                        generalised_geodesic_exact_cpu(image, mask, spacing, 1e10, lamb, 1 - lamb);
+                                    else if (engine == "superpixel")
+                                        generalised_geodesic_superpixel_cpu(image, mask, spacing, 1e10, lamb, 1 - lamb, dims == 2 ? 16 : 8, 0.1);
+                                    else
+                                        throw std::invalid_argument("unknown engine " + engine);
+                                });
+                            results.push_back(other);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void compute_speedups(std::vector<Result> &results, const Options &options)
+{
+    // baseline of a result is the same kernel and problem with the first thread count and instruction set
+    std::map<std::string, double> baseline;
+    auto problem = [](const Result &r)
+    {
+        std::ostringstream key;
+        key << r.kernel << "|" << r.engine << "|" << r.dims << "|" << r.size << "|" << r.channels << "|" << r.iterations << "|" << r.lamb;
+        return key.str();
+    };
+    for (const Result &r : results)
+    {
+        if (r.threads == options.threads.front() && baseline.count(problem(r)) == 0)
+            baseline[problem(r)] = r.median_ns;
+    }
+    for (Result &r : results)
+    {
+        auto found = baseline.find(problem(r));
+        r.speedup = found != baseline.end() ? found->second / r.median_ns : 1.0;
+    }
+}
+
+void write_json(std::ostream &out, const std::vector<Result> &results)
+{
+    out.precision(9);
+    out << "{\n  \"benchmark\": \"fastgeodis_cpu\",\n  \"detected_isa\": \"" << get_cpu_isa() << "\",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result &r = results[i];
+        out << "    {\"kernel\": \"" << r.kernel << "\", \"engine\": \"" << r.engine << "\", \"isa\": \"" << r.isa
+            << "\", \"dims\": " << r.dims << ", \"size\": " << r.size << ", \"channels\": " << r.channels
+            << ", \"iterations\": " << r.iterations << ", \"lamb\": " << r.lamb << ", \"threads\": " << r.threads
+            << ", \"pixels\": " << r.pixels << ", \"median_ns\": " << r.median_ns << ", \"min_ns\": " << r.min_ns
+            << ", \"ns_per_pixel\": " << r.median_ns / r.pixels << ", \"gb_per_s\": " << r.bytes / r.median_ns
+            << ", \"speedup\": " << r.speedup;
+        for (int c = 0; c < PerfCounters::NUM_COUNTERS; c++)
+        {
+            out << ", \"" << PerfCounters::name(c) << "_per_pixel\": ";
+            if (r.counters.empty() || !perf_counters->available(c))
+                out << "null";
+            else
+                out << r.counters[c];
+        }
+        out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        const Options options = parse_options(argc, argv);
+        PerfCounters counters;
+        if (options.counters)
+        {
+            perf_counters = &counters;
+            if (!counters.any_available())
+                std::cerr << "hardware counters unavailable, check /proc/sys/kernel/perf_event_paranoid" << std::endl;
+        }
+        std::vector<Result> results;
+        run_benchmarks(options, results);
+        compute_speedups(results, options);
+
+        std::cout << "kernel                               engine      isa      dims  size  ch  iter  lamb  thr   ns/pixel    GB/s  speedup  cyc/pixel    IPC  LLC/pixel  TLB/pixel" << std::endl;
+        for (const Result &r : results)
+        {
+            char line[256];
+            std::snprintf(line, sizeof(line), "%-36s %-11s %-8s %4d %5d %3d %5d %5.2f %4d %10.3f %7.2f %8.2f",
+                r.kernel.c_str(), r.engine.c_str(), r.isa.c_str(), r.dims, r.size, r.channels, r.iterations, r.lamb,
+                r.threads, r.median_ns / r.pixels, r.bytes / r.median_ns, r.speedup);
+            std::cout << line;
+            if (r.counters.empty())
+            {
+                std::cout << "          -      -          -          -" << std::endl;
+                continue;
+            }
+            const double ipc = r.counters[0] > 0 ? r.counters[1] / r.counters[0] : 0.0;
+            std::snprintf(line, sizeof(line), " %10.2f %6.2f %10.4f %10.4f", r.counters[0], ipc, r.counters[2], r.counters[3]);
+            std::cout << line << std::endl;
+        }
+
+        if (!options.json.empty())
+        {
+            std::ofstream out(options.json);
+            write_json(out, results);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
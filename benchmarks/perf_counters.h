@@ -0,0 +1,130 @@
+// BSD 3-Clause License
+
+// Copyright (c) 2021, Muhammad Asad (masadcv@gmail.com)
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+// hardware counters of the process read with perf_event_open. counters are opened with inherit so that
+// threads created later, e.g. the OpenMP pool, are counted too, which requires opening them before the
+// first parallel region. counters that cannot be opened, e.g. in containers or with a restrictive
+// perf_event_paranoid, are reported as unavailable and read as zero
+class PerfCounters
+{
+public:
+    static const int NUM_COUNTERS = 4;
+
+    PerfCounters()
+    {
+#ifdef __linux__
+        const uint64_t dtlb_read_miss = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        const uint32_t types[NUM_COUNTERS] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE};
+        const uint64_t configs[NUM_COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, dtlb_read_miss};
+        for (int c = 0; c < NUM_COUNTERS; c++)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = types[c];
+            attr.config = configs[c];
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            // scaled by enabled over running time when the pmu multiplexes counters
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fd_[c] = int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+#endif
+    }
+
+    ~PerfCounters()
+    {
+#ifdef __linux__
+        for (const int &fd : fd_)
+        {
+            if (fd >= 0)
+                close(fd);
+        }
+#endif
+    }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    static const char *name(const int &c)
+    {
+        static const char *names[NUM_COUNTERS] = {"cycles", "instructions", "llc_misses", "dtlb_misses"};
+        return names[c];
+    }
+
+    bool available(const int &c) const
+    {
+        return fd_[c] >= 0;
+    }
+
+    bool any_available() const
+    {
+        for (int c = 0; c < NUM_COUNTERS; c++)
+        {
+            if (available(c))
+                return true;
+        }
+        return false;
+    }
+
+    // current values, counters keep running and are used through differences of two reads
+    std::vector<double> read() const
+    {
+        std::vector<double> values(NUM_COUNTERS, 0.0);
+#ifdef __linux__
+        for (int c = 0; c < NUM_COUNTERS; c++)
+        {
+            uint64_t data[3] = {0, 0, 0};
+            if (fd_[c] < 0 || ::read(fd_[c], data, sizeof(data)) != sizeof(data))
+                continue;
+            values[c] = data[2] > 0 ? double(data[0]) * double(data[1]) / double(data[2]) : 0.0;
+        }
+#endif
+        return values;
+    }
+
+private:
+    int fd_[NUM_COUNTERS] = {-1, -1, -1, -1};
+};
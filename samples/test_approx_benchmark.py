@@ -0,0 +1,85 @@
+import numpy as np
+import torch
+import matplotlib.pyplot as plt
+import FastGeodis
+import time
+import os
+
+factors_to_test = [1, 2, 4, 8]
+
+
+def run2d(image, seed, v, lamb, iter, factor):
+    return FastGeodis.generalised_geodesic2d(image, seed, v, lamb, iter, approx_factor=factor)
+
+
+def run3d(image, seed, spacing, v, lamb, iter, factor):
+    return FastGeodis.generalised_geodesic3d(image, seed, spacing, v, lamb, iter, approx_factor=factor)
+
+
+def test2d(size=1024, lamb=1.0, num_runs=5):
+    image = torch.rand((1, 1, size, size))
+    seed = torch.ones((1, 1, size, size))
+    seed[:, :, size // 2, size // 2] = 0.0
+
+    reference = run2d(image, seed, 10000, lamb, 2, 1)
+    time_taken, mean_err, max_err = [], [], []
+    for factor in factors_to_test:
+        tic = time.time()
+        for i in range(num_runs):
+            approx = run2d(image, seed, 10000, lamb, 2, factor)
+        time_taken.append((time.time() - tic) / num_runs)
+        err = torch.abs(approx - reference)
+        mean_err.append(err.mean().item())
+        max_err.append(err.max().item())
+        print(
+            "2d factor %d: %2.4f sec, mean error %2.4f, max error %2.4f"
+            % (factor, time_taken[-1], mean_err[-1], max_err[-1])
+        )
+
+    return time_taken, mean_err, max_err
+
+
+def test3d(size=128, lamb=1.0, num_runs=2):
+    spacing = [1.0, 1.0, 1.0]
+    image = torch.rand((1, 1, size, size, size))
+    seed = torch.ones((1, 1, size, size, size))
+    seed[:, :, size // 2, size // 2, size // 2] = 0.0
+
+    reference = run3d(image, seed, spacing, 10000, lamb, 4, 1)
+    time_taken, mean_err, max_err = [], [], []
+    for factor in factors_to_test:
+        tic = time.time()
+        for i in range(num_runs):
+            approx = run3d(image, seed, spacing, 10000, lamb, 4, factor)
+        time_taken.append((time.time() - tic) / num_runs)
+        err = torch.abs(approx - reference)
+        mean_err.append(err.mean().item())
+        max_err.append(err.max().item())
+        print(
+            "3d factor %d: %2.4f sec, mean error %2.4f, max error %2.4f"
+            % (factor, time_taken[-1], mean_err[-1], max_err[-1])
+        )
+
+    return time_taken, mean_err, max_err
+
+
+def save_plot(time_taken, mean_err, max_err, figname):
+    fig, ax_time = plt.subplots()
+    ax_time.grid()
+    ax_time.plot(factors_to_test, time_taken, "m-o", label="execution time")
+    ax_time.set_xlabel("approx_factor")
+    ax_time.set_ylabel("Execution time (seconds)")
+    ax_err = ax_time.twinx()
+    ax_err.plot(factors_to_test, mean_err, "g-o", label="mean error")
+    ax_err.plot(factors_to_test, max_err, "r-o", label="max error")
+    ax_err.set_ylabel("Absolute error")
+    fig.legend()
+    plt.xticks(factors_to_test, [str(f) for f in factors_to_test])
+    plt.title(figname)
+    plt.tight_layout()
+    plt.savefig(os.path.join("figures", figname + ".png"))
+
+
+if __name__ == "__main__":
+    save_plot(*test2d(), "experiment_approx_2d")
+    save_plot(*test3d(), "experiment_approx_3d")
@@ -0,0 +1,57 @@
+import torch
+import matplotlib.pyplot as plt
+import FastGeodis
+import time
+import os
+
+schedules_to_test = ["image", "batch", "nested"]
+
+
+def make_batch(batch_size, base_size):
+    # mixed sizes so that images finish at different times
+    images, masks = [], []
+    for b in range(batch_size):
+        size = base_size // 2 + (b * base_size) // max(batch_size - 1, 1)
+        image = torch.rand((1, 1, size, size))
+        mask = torch.ones((1, 1, size, size))
+        mask[:, :, size // 2, size // 2] = 0.0
+        images.append(image)
+        masks.append(mask)
+    return images, masks
+
+
+def test2d(base_size=512, num_runs=3):
+    batch_sizes = [1, 2, 3, 5, 8, 13, 32]
+    print(batch_sizes)
+    time_taken_dict = dict()
+    for schedule in schedules_to_test:
+        time_taken_dict[schedule] = []
+        for batch_size in batch_sizes:
+            images, masks = make_batch(batch_size, base_size)
+
+            tic = time.time()
+            for i in range(num_runs):
+                FastGeodis.generalised_geodesic2d_batch(images, masks, 10000, 1.0, 2, schedule=schedule)
+            time_taken_dict[schedule].append((time.time() - tic) / num_runs)
+            print("schedule %s batch %d: %2.4f sec" % (schedule, batch_size, time_taken_dict[schedule][-1]))
+
+    return batch_sizes, time_taken_dict
+
+
+def save_plot(batch_sizes, time_taken_dict, figname):
+    plt.figure()
+    plt.grid()
+    for key, colour in zip(schedules_to_test, ["r-o", "g-o", "m-o"]):
+        plt.plot(batch_sizes, time_taken_dict[key], colour, label=key)
+    plt.legend()
+    plt.xticks(batch_sizes, [str(s) for s in batch_sizes])
+    plt.title(figname)
+    plt.xlabel("Batch size")
+    plt.ylabel("Execution time (seconds)")
+    plt.tight_layout()
+    plt.savefig(os.path.join("figures", figname + ".png"))
+
+
+if __name__ == "__main__":
+    batch_sizes, ttdict = test2d()
+    save_plot(batch_sizes, ttdict, "experiment_batch_2d")
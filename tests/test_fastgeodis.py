@@ -28,7 +28,10 @@
 # OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+import json
 import math
+import os
+import tempfile
 import unittest
 from functools import partial, wraps
 
@@ -42,6 +45,7 @@ np.random.seed(15)
 
 try:
     import FastGeodis
+    import FastGeodis.benchmark
 except:
     print(
         "Unable to load FastGeodis for unittests\nMake sure to install using: python setup.py install"
@@ -325,6 +329,106 @@ class TestFastGeodis(unittest.TestCase):
                 mask = torch.rand(mask_shape_mod, dtype=torch.float32).to(device)
                 geodesic_dist = geodis_func(image, mask, 1e10, 1.0, 2)
 
+    @parameterized.expand(CONF_2D[:2] + CONF_3D[:1] + CONF_2D[3:5] + CONF_3D[3:4])
+    @run_cuda_if_available
+    def test_output_transform(self, device, num_dims, base_dim):
+        image_shape = get_simple_shape(base_dim=base_dim, num_dims=num_dims)
+        image = torch.rand(image_shape, dtype=torch.float32).to(device)
+        mask = torch.ones(image_shape, dtype=torch.float32)
+        mask[(0, 0) + (base_dim // 2,) * num_dims] = 0
+        mask = mask.to(device)
+
+        if num_dims == 2:
+            geodis_func = partial(FastGeodis.generalised_geodesic2d, iter=2)
+        else:
+            geodis_func = partial(FastGeodis.generalised_geodesic3d, spacing=[1.0, 1.0, 1.0], iter=4)
+        distance = geodis_func(image, mask, v=1e10, lamb=0.5)
+
+        clipped = distance.clamp(0, 5.0)
+        expected = [
+            ({"clip": 5.0}, clipped),
+            ({"normalise": True}, distance / distance.max()),
+            ({"decay": 2.0}, torch.exp(-distance / 2.0)),
+            ({"clip": 5.0, "normalise": True, "decay": 0.5}, torch.exp(-clipped / clipped.max() / 0.5)),
+        ]
+        for kwargs, target in expected:
+            output = geodis_func(image, mask, v=1e10, lamb=0.5, **kwargs)
+            np.testing.assert_allclose(output.cpu().numpy(), target.cpu().numpy(), rtol=1e-5, atol=1e-6)
+
+        with self.assertRaises(ValueError):
+            geodis_func(image, mask, v=1e10, lamb=0.5, clip=-1.0)
+
+    @parameterized.expand(CONF_2D[:2] + CONF_3D[:1] + CONF_2D[3:5] + CONF_3D[3:4])
+    @run_cuda_if_available
+    def test_approx_factor(self, device, num_dims, base_dim):
+        image_shape = get_simple_shape(base_dim=base_dim, num_dims=num_dims)
+        image = torch.rand(image_shape, dtype=torch.float32).to(device)
+        mask = torch.ones(image_shape, dtype=torch.float32)
+        mask[(0, 0) + (base_dim // 3,) * num_dims] = 0
+        mask = mask.to(device)
+
+        if num_dims == 2:
+            geodis_func = partial(FastGeodis.generalised_geodesic2d, iter=2)
+        else:
+            geodis_func = partial(FastGeodis.generalised_geodesic3d, spacing=[1.0, 1.0, 1.0], iter=4)
+        distance = geodis_func(image, mask, v=1e10, lamb=0.0)
+
+        output = geodis_func(image, mask, v=1e10, lamb=0.0, approx_factor=1)
+        np.testing.assert_allclose(output.cpu().numpy(), distance.cpu().numpy())
+
+        # euclidean error is bounded by snapping seed and queries to the coarse grid
+        for factor in [2, 4]:
+            output = geodis_func(image, mask, v=1e10, lamb=0.0, approx_factor=factor)
+            self.assertEqual(output.shape, distance.shape)
+            self.assertLessEqual(torch.max(torch.abs(output - distance)).item(), factor * num_dims)
+
+        with self.assertRaises(ValueError):
+            geodis_func(image, mask, v=1e10, lamb=0.0, approx_factor=0)
+
+    @parameterized.expand(CONF_2D[:2] + CONF_3D[:1] + CONF_2D[3:5] + CONF_3D[3:4])
+    @run_cuda_if_available
+    def test_presmoothing(self, device, num_dims, base_dim):
+        image_shape = get_simple_shape(base_dim=base_dim, num_dims=num_dims)
+        image = torch.rand(image_shape, dtype=torch.float32).to(device)
+        mask = torch.ones(image_shape, dtype=torch.float32)
+        mask[(0, 0) + (base_dim // 2,) * num_dims] = 0
+        mask = mask.to(device)
+
+        if num_dims == 2:
+            spacing = [1.0, 1.0]
+            geodis_func = partial(FastGeodis.generalised_geodesic2d, iter=2)
+        else:
+            spacing = [2.0, 1.0, 0.5]
+            geodis_func = partial(FastGeodis.generalised_geodesic3d, spacing=spacing, iter=4)
+        sigma = [1.0, 2.0, 0.5][:num_dims]
+
+        for kernel in ["gaussian", "box"]:
+            # reference separable filter with replicated borders
+            smoothed = image
+            for axis in range(num_dims):
+                s = sigma[axis] / spacing[axis]
+                radius = int(round(s)) if kernel == "box" else int(math.ceil(3 * s))
+                if radius < 1:
+                    continue
+                offsets = torch.arange(-radius, radius + 1, dtype=torch.float32)
+                weights = torch.ones_like(offsets) if kernel == "box" else torch.exp(-0.5 * offsets ** 2 / s ** 2)
+                weights = weights / weights.sum()
+                length = image.shape[axis + 2]
+                index = torch.arange(length).to(device)
+                smoothed = sum(
+                    w * smoothed.index_select(axis + 2, (index + k).clamp(0, length - 1))
+                    for w, k in zip(weights.tolist(), range(-radius, radius + 1))
+                )
+
+            expected = geodis_func(smoothed.contiguous(), mask, v=1e10, lamb=1.0)
+            output = geodis_func(image, mask, v=1e10, lamb=1.0, smooth_sigma=sigma, smooth_kernel=kernel)
+            np.testing.assert_allclose(output.cpu().numpy(), expected.cpu().numpy(), rtol=1e-4, atol=1e-4)
+
+        with self.assertRaises(ValueError):
+            geodis_func(image, mask, v=1e10, lamb=1.0, smooth_sigma=1.0, smooth_kernel="median")
+        with self.assertRaises(ValueError):
+            geodis_func(image, mask, v=1e10, lamb=1.0, smooth_sigma=-1.0)
+
 class TestFastGeodisSigned(unittest.TestCase):
     @parameterized.expand(CONF_ALL)
     @run_cuda_if_available
@@ -506,6 +610,938 @@ class TestGSF(unittest.TestCase):
         # should work without any errors
         geodesic_dist = geodis_func(image, mask, 0.0, 1e10, 1.0, 2)
 
+    @parameterized.expand(CONF_2D[:2] + CONF_3D[:1] + CONF_2D[3:5] + CONF_3D[3:4])
+    @run_cuda_if_available
+    def test_multi_theta(self, device, num_dims, base_dim):
+        image_shape = get_simple_shape(base_dim=base_dim, num_dims=num_dims)
+        image = torch.rand([1, 3] + image_shape[2:], dtype=torch.float32).to(device)
+        mask = torch.ones(image_shape, dtype=torch.float32)
+        mask[(0, 0) + (slice(base_dim // 4, base_dim // 2),) * num_dims] = 0
+        mask = mask.to(device)
+
+        # anisotropic spacing, corner steps of the 3D passes round differently if summed in another order
+        geodis_func = get_GSF_func(num_dims=num_dims, spacing=[0.3, 0.6, 0.9])
+        thetas = [0.0, 1.0, 4.0]
+        geodesic_dist = geodis_func(image, mask, thetas, 1e10, 0.5, 2)
+        self.assertEqual(geodesic_dist.shape[1], len(thetas))
+
+        # every channel matches filtering with its theta alone
+        for i, theta in enumerate(thetas):
+            expected = geodis_func(image, mask, theta, 1e10, 0.5, 2)
+            np.testing.assert_array_equal(geodesic_dist[:, i : i + 1].cpu().numpy(), expected.cpu().numpy())
+
+
+
+class TestGeoS(unittest.TestCase):
+    @parameterized.expand(CONF_2D[:2] + CONF_3D[:1] + CONF_2D[3:5] + CONF_3D[3:4])
+    @run_cuda_if_available
+    def test_segments_object(self, device, num_dims, base_dim):
+        image_shape = get_simple_shape(base_dim=base_dim, num_dims=num_dims)
+        inside = torch.zeros(image_shape, dtype=torch.bool)
+        inside[(0, 0) + (slice(base_dim // 4, 3 * base_dim // 4),) * num_dims] = True
+
+        image = 0.1 * torch.rand(image_shape, dtype=torch.float32) + 0.8 * inside
+        noise = torch.rand(image_shape, dtype=torch.float32)
+        fg = torch.where(inside, 0.6 + 0.3 * noise, 0.1 + 0.35 * noise)
+        bg = 1 - fg
+
+        geos_func = FastGeodis.GeoS2d if num_dims == 2 else partial(FastGeodis.GeoS3d, spacing=[1.0, 1.0, 1.0])
+        thetas = [0.0, 2.0, 5.0]
+        segmentation, energies = geos_func(
+            image.to(device), fg.to(device), bg.to(device), thetas, thetas, v=10.0, lamb=0.9, gamma=5.0
+        )
+        self.assertEqual(energies.shape, (len(thetas), len(thetas)))
+        self.assertTrue(torch.equal(segmentation.cpu() > 0.5, inside))
+
+        # the lowest energy is the one of the returned segmentation
+        z = segmentation.cpu()[0, 0].numpy().astype(np.float64)
+        ratio = (fg / (fg + bg)).clamp(1e-6, 1 - 1e-6)[0, 0].numpy().astype(np.float64)
+        intensity = image[0].numpy().astype(np.float64)
+        sq = [np.sum(np.diff(intensity, axis=a + 1) ** 2, axis=0) for a in range(num_dims)]
+        eta = 2 * sum(s.sum() for s in sq) / sum(s.size for s in sq)
+        energy = np.sum(-z * np.log(ratio) - (1 - z) * np.log(1 - ratio))
+        for a in range(num_dims):
+            energy += 5.0 * np.sum(np.exp(-sq[a] / eta) * (np.diff(z, axis=a) != 0))
+        np.testing.assert_allclose(energies.min().item(), energy, rtol=1e-4)
+
+        # a single candidate is the GSF of the likelihood ratio
+        gsf_func = get_GSF_func(num_dims=num_dims)
+        segmentation, _ = geos_func(
+            image.to(device), fg.to(device), bg.to(device), [2.0], [2.0], v=10.0, lamb=0.9, gamma=5.0
+        )
+        iter = 2 if num_dims == 2 else 4
+        gsf = gsf_func(image.to(device), (fg / (fg + bg)).to(device), 2.0, 10.0, 0.9, iter)
+        self.assertTrue(torch.equal(segmentation.cpu() > 0.5, gsf.cpu() > 0))
+
+    def test_ill_thetas(self):
+        image = torch.rand([1, 1, 32, 32], dtype=torch.float32)
+        fg = torch.rand([1, 1, 32, 32], dtype=torch.float32)
+
+        with self.assertRaises(ValueError):
+            FastGeodis.GeoS2d(image, fg, 1 - fg, [], [0.0], 10.0, 0.9, 1.0)
+
+        with self.assertRaises(ValueError):
+            FastGeodis.GeoS2d(image, fg, 1 - fg, [0.0], [0.0], 10.0, 0.9, -1.0)
+
+
+class TestGeodesicBatch(unittest.TestCase):
+    @parameterized.expand([("nested",), ("batch",), ("image",)])
+    def test_matches_single(self, schedule):
+        # mixed sizes as a list, and a batch tensor
+        sizes = [[1, 1, 64, 71], [1, 3, 32, 32], [1, 1, 128, 40]]
+        images = [torch.rand(size, dtype=torch.float32) for size in sizes]
+        masks = [torch.ones([1, 1] + size[2:], dtype=torch.float32) for size in sizes]
+        for mask in masks:
+            mask[0, 0, 5, 7] = 0
+
+        distances = FastGeodis.generalised_geodesic2d_batch(images, masks, 1e10, 0.7, num_threads=4, schedule=schedule)
+        for image, mask, distance in zip(images, masks, distances):
+            expected = FastGeodis.generalised_geodesic2d(image, mask, 1e10, 0.7, 2)
+            np.testing.assert_allclose(distance.numpy(), expected.numpy())
+
+        images = torch.rand([3, 2, 12, 16, 14], dtype=torch.float32)
+        masks = torch.ones([3, 1, 12, 16, 14], dtype=torch.float32)
+        masks[:, 0, 6, 8, 7] = 0
+        spacing = [1.0, 2.0, 1.0]
+        distances = FastGeodis.generalised_geodesic3d_batch(images, masks, spacing, 1e10, 0.5, schedule=schedule)
+        self.assertEqual(distances.shape, masks.shape)
+        for b in range(3):
+            expected = FastGeodis.generalised_geodesic3d(images[b : b + 1], masks[b : b + 1], spacing, 1e10, 0.5, 4)
+            np.testing.assert_allclose(distances[b : b + 1].numpy(), expected.numpy())
+
+    def test_ill_schedule(self):
+        images = torch.rand([2, 1, 16, 16], dtype=torch.float32)
+        masks = torch.ones([2, 1, 16, 16], dtype=torch.float32)
+
+        with self.assertRaises(ValueError):
+            FastGeodis.generalised_geodesic2d_batch(images, masks, 1e10, 0.7, schedule="static")
+
+        with self.assertRaises(ValueError):
+            FastGeodis.generalised_geodesic2d_batch([images[:1]], [masks[:1], masks[1:]], 1e10, 0.7)
+
+        # raised as an error before the parallel region instead of terminating the process
+        with self.assertRaises(ValueError):
+            FastGeodis.generalised_geodesic2d_batch([images[:1], images[1:].double()], [masks[:1], masks[1:]], 1e10, 0.7)
+
+
+class TestCpuIsa(unittest.TestCase):
+    def test_kernels_identical(self):
+        image = torch.rand([1, 3, 47, 53], dtype=torch.float32)
+        mask = torch.ones([1, 1, 47, 53], dtype=torch.float32)
+        mask[0, 0, 20, 11] = 0
+        image3d = torch.rand([1, 1, 15, 18, 21], dtype=torch.float32)
+        mask3d = torch.ones([1, 1, 15, 18, 21], dtype=torch.float32)
+        mask3d[0, 0, 7, 3, 12] = 0
+
+        detected = FastGeodis.cpu_isa()
+        try:
+            expected = None
+            for name in ["generic", "sse4.2", "avx2", "avx512"]:
+                FastGeodis.set_cpu_isa(name)
+                distances = [
+                    FastGeodis.generalised_geodesic2d(image, mask, 1e10, 0.7, 2, clip=20.0),
+                    FastGeodis.generalised_geodesic3d(image3d, mask3d, [1.0, 2.0, 0.5], 1e10, 0.5, 4, normalise=True),
+                ]
+                if expected is None:
+                    expected = distances
+                for distance, exp in zip(distances, expected):
+                    np.testing.assert_array_equal(distance.numpy(), exp.numpy())
+        finally:
+            self.assertEqual(FastGeodis.set_cpu_isa("auto"), detected)
+
+    def test_ill_isa(self):
+        self.assertEqual(FastGeodis.set_cpu_isa("generic"), "generic")
+        FastGeodis.set_cpu_isa("auto")
+        with self.assertRaises(ValueError):
+            FastGeodis.set_cpu_isa("neon")
+
+
+class TestResultCache(unittest.TestCase):
+    def tearDown(self):
+        FastGeodis.set_result_cache(0)
+        FastGeodis.clear_result_cache()
+
+    def test_hits_and_eviction(self):
+        image = torch.rand([1, 1, 64, 48], dtype=torch.float32)
+        mask = torch.ones([1, 1, 64, 48], dtype=torch.float32)
+        mask[0, 0, 10, 20] = 0
+        expected = FastGeodis.generalised_geodesic2d(image, mask, 1e10, 0.7, 2)
+
+        entry_bytes = 64 * 48 * 4
+        FastGeodis.set_result_cache(2 * entry_bytes)
+        FastGeodis.clear_result_cache()
+        first = FastGeodis.generalised_geodesic2d(image, mask, 1e10, 0.7, 2)
+        second = FastGeodis.generalised_geodesic2d(image, mask, 1e10, 0.7, 2)
+        np.testing.assert_array_equal(first.numpy(), expected.numpy())
+        np.testing.assert_array_equal(second.numpy(), expected.numpy())
+        info = FastGeodis.result_cache_info()
+        self.assertEqual((info["hits"], info["misses"], info["bytes"]), (1, 1, entry_bytes))
+
+        # results are owned by the caller, changing them leaves the cache intact
+        second.zero_()
+        third = FastGeodis.generalised_geodesic2d(image, mask, 1e10, 0.7, 2)
+        np.testing.assert_array_equal(third.numpy(), expected.numpy())
+
+        # a different parameter or input content misses, the oldest entry is evicted
+        FastGeodis.generalised_geodesic2d(image, mask, 1e10, 0.5, 2)
+        image[0, 0, 63, 47] += 0.25
+        FastGeodis.generalised_geodesic2d(image, mask, 1e10, 0.7, 2)
+        info = FastGeodis.result_cache_info()
+        self.assertEqual((info["misses"], info["entries"], info["evictions"]), (3, 2, 1))
+
+    def test_ill_limit(self):
+        with self.assertRaises(ValueError):
+            FastGeodis.set_result_cache(-1)
+
+
+class TestGeodesicDiskCache(unittest.TestCase):
+    def test_reload(self):
+        image = torch.rand([1, 1, 40, 36], dtype=torch.float32)
+        mask = torch.ones([1, 1, 40, 36], dtype=torch.float32)
+        mask[0, 0, 10, 20] = 0
+        expected = FastGeodis.generalised_geodesic2d(image, mask, 1e10, 0.7, 2)
+        expected_gsf = FastGeodis.GSF2d(image, mask, 1.0, 1e10, 0.7, 2)
+
+        with tempfile.TemporaryDirectory() as directory:
+            cache = FastGeodis.GeodesicDiskCache(directory)
+            for _ in range(2):
+                distance = cache.generalised_geodesic2d(image, mask, 1e10, 0.7, 2)
+                np.testing.assert_array_equal(distance.numpy(), expected.numpy())
+                gsf = cache.GSF2d(image, mask, 1.0, 1e10, 0.7, 2)
+                np.testing.assert_array_equal(gsf.numpy(), expected_gsf.numpy())
+
+            # a new cache object on the same directory, e.g. in a later epoch, loads the files
+            cache = FastGeodis.GeodesicDiskCache(directory)
+            distance = cache.generalised_geodesic2d(image, mask, 1e10, 0.7, 2)
+            np.testing.assert_array_equal(distance.numpy(), expected.numpy())
+            self.assertEqual(cache.info()["hits"], 1)
+            self.assertEqual(cache.info()["entries"], 2)
+
+            cache.generalised_geodesic2d(image, mask, 1e10, 0.7, 3)
+            self.assertEqual(cache.info()["misses"], 1)
+
+    def test_fp16_and_limit(self):
+        image = torch.rand([1, 1, 12, 16, 14], dtype=torch.float32)
+        mask = torch.ones([1, 1, 12, 16, 14], dtype=torch.float32)
+        mask[0, 0, 6, 8, 7] = 0
+        spacing = [1.0, 1.0, 1.0]
+        expected = FastGeodis.generalised_geodesic3d(image, mask, spacing, 1e10, 0.5, 4)
+
+        with tempfile.TemporaryDirectory() as directory:
+            # room for a single fp16 map with its header
+            cache = FastGeodis.GeodesicDiskCache(directory, max_bytes=12 * 16 * 14 * 2 + 1024, fp16=True)
+            distances = []
+            for _ in range(2):
+                distance = cache.generalised_geodesic3d(image, mask, spacing, 1e10, 0.5, 4)
+                self.assertEqual(distance.dtype, torch.float32)
+                np.testing.assert_allclose(distance.numpy(), expected.numpy(), rtol=1e-3)
+                distances.append(distance.numpy())
+            self.assertEqual(cache.info()["hits"], 1)
+
+            # a miss returns the same rounded map as later hits
+            np.testing.assert_array_equal(distances[0], distances[1])
+
+            cache.generalised_geodesic3d(image, mask, spacing, 1e10, 0.5, 2)
+            self.assertEqual(cache.info()["entries"], 1)
+
+            cache.clear()
+            self.assertEqual(cache.info()["entries"], 0)
+
+    def test_auto_iterations(self):
+        image = torch.rand([1, 1, 24, 24], dtype=torch.float32)
+        mask = torch.ones([1, 1, 24, 24], dtype=torch.float32)
+        mask[0, 0, 12, 12] = 0
+
+        with tempfile.TemporaryDirectory() as directory:
+            cache = FastGeodis.GeodesicDiskCache(directory)
+            distance = cache.generalised_geodesic2d(image, mask, 1e10, 0.7, "auto")
+
+            # stored under the resolved iteration count, not under "auto"
+            iterations = FastGeodis.auto_iterations(image, mask, 1e10, 0.7)
+            np.testing.assert_array_equal(
+                cache.generalised_geodesic2d(image, mask, 1e10, 0.7, iterations).numpy(), distance.numpy()
+            )
+            self.assertEqual(cache.info()["hits"], 1)
+
+    def test_ill_args(self):
+        image = torch.rand([1, 1, 8, 8], dtype=torch.float32)
+        mask = torch.ones([1, 1, 8, 8], dtype=torch.float32)
+        with tempfile.TemporaryDirectory() as directory:
+            with self.assertRaises(ValueError):
+                FastGeodis.GeodesicDiskCache(directory, max_bytes=-1)
+            with self.assertRaises(ValueError):
+                FastGeodis.GeodesicDiskCache(directory).generalised_geodesic2d(image, mask, 1e10, 0.7, return_parent=True)
+            with self.assertRaises(ValueError):
+                FastGeodis.GeodesicDiskCache(directory).generalised_geodesic2d(image, mask, 1e10, 0.7, return_stats=True)
+
+
+class TestBenchmark(unittest.TestCase):
+    def test_workloads(self):
+        for workload in ["noise", "spiral", "flat", "multichannel"]:
+            for dims in [2, 3]:
+                image, mask = FastGeodis.benchmark.make_workload(workload, dims, 24)
+                self.assertEqual(image.shape[2:], mask.shape[2:])
+                self.assertEqual(mask.sum().item(), mask.numel() - 1)
+                again, _ = FastGeodis.benchmark.make_workload(workload, dims, 24)
+                np.testing.assert_array_equal(image.numpy(), again.numpy())
+
+        with self.assertRaises(ValueError):
+            FastGeodis.benchmark.make_workload("checkerboard", 2, 24)
+
+    def test_run(self):
+        with tempfile.TemporaryDirectory() as directory:
+            path = directory + "/results.json"
+            report = FastGeodis.benchmark.main(
+                "--dims 2 --size2d 48 --workloads spiral --functions generalised_geodesic exact "
+                "--iters 1 16 --warmup 0 --repeats 1 --json {}".format(path).split()
+            )
+            self.assertTrue(os.path.exists(path))
+
+        results = {(r["function"], r["iter"]): r for r in report["results"]}
+        self.assertEqual(len(results), 3)
+        # the spiral needs many iterations, more passes get closer to the exact distance
+        few, many = results[("generalised_geodesic", 1)], results[("generalised_geodesic", 16)]
+        self.assertGreater(few["accuracy"]["max_abs_error"], 0)
+        self.assertLess(many["accuracy"]["max_abs_error"], 1e-3)
+        self.assertEqual(results[("exact", None)]["accuracy"]["max_abs_error"], 0)
+
+
+class TestCalibration(unittest.TestCase):
+    def tearDown(self):
+        FastGeodis.set_auto_iterations()
+
+    def test_calibrate(self):
+        image, mask = FastGeodis.benchmark.make_workload("spiral", 2, 48)
+        report = FastGeodis.calibrate_iterations(image, mask, 1e10, 1.0, max_iter=16)
+        # errors never grow with more iterations and calibration stops once the exact distance is reached
+        errors = [entry["max_rel_error"] for entry in report]
+        self.assertGreater(errors[0], 0)
+        self.assertEqual(errors, sorted(errors, reverse=True))
+        self.assertEqual(report[-1]["max_abs_error"], 0)
+        self.assertLess(len(report), 16)
+
+        FastGeodis.set_auto_iterations(tolerance=0.0)
+        selected = FastGeodis.auto_iterations(image, mask, 1e10, 1.0)
+        self.assertEqual(selected, report[-1]["iter"])
+        expected = FastGeodis.generalised_geodesic2d(image, mask, 1e10, 1.0, selected)
+        distance = FastGeodis.generalised_geodesic2d(image, mask, 1e10, 1.0, "auto")
+        np.testing.assert_array_equal(distance.numpy(), expected.numpy())
+
+        # the count is cached per profile, an image of the same size and parameters reuses it
+        noise, noise_mask = FastGeodis.benchmark.make_workload("noise", 2, 48)
+        self.assertEqual(FastGeodis.auto_iterations(noise, noise_mask, 1e10, 1.0), selected)
+        noise_report = FastGeodis.calibrate_iterations([noise], [noise_mask], 1e10, 1.0)
+        self.assertEqual(
+            FastGeodis.auto_iterations(noise, noise_mask, 1e10, 1.0, profile="noise"),
+            FastGeodis.calibration.select_iterations(noise_report, 0.0),
+        )
+
+    def test_ill_calibrate(self):
+        image, mask = FastGeodis.benchmark.make_workload("noise", 2, 24)
+        with self.assertRaises(ValueError):
+            FastGeodis.calibrate_iterations([image], [], 1e10, 1.0)
+        with self.assertRaises(ValueError):
+            FastGeodis.calibrate_iterations(image, mask, 1e10, 1.0, max_iter=0)
+
+
+class TestMemory(unittest.TestCase):
+    @parameterized.expand([[[64, 48], 1, 1], [[64, 48], 3, 2], [[10, 12, 14], 1, 4], [[10, 12, 14], 2, 2]])
+    def test_raster_peak(self, shape, channels, iterations):
+        image = torch.rand([1, channels] + shape, dtype=torch.float32)
+        mask = torch.ones([1, 1] + shape, dtype=torch.float32)
+        mask[(0, 0) + tuple(s // 2 for s in shape)] = 0
+        function = "generalised_geodesic{}d".format(len(shape))
+        estimate = FastGeodis.estimate_memory(shape, channels, function, {"iter": iterations})
+
+        FastGeodis.reset_workspace_peak()
+        before = FastGeodis.workspace_memory()["current_bytes"]
+        if len(shape) == 2:
+            distance = FastGeodis.generalised_geodesic2d(image, mask, 1e10, 0.5, iterations)
+        else:
+            distance = FastGeodis.generalised_geodesic3d(image, mask, [1.0, 1.0, 1.0], 1e10, 0.5, iterations)
+        memory = FastGeodis.workspace_memory()
+        self.assertEqual(memory["peak_bytes"] - before, estimate["raster"])
+        self.assertEqual(memory["current_bytes"] - before, distance.numel() * 4)
+
+        # released with the distance
+        del distance
+        self.assertEqual(FastGeodis.workspace_memory()["current_bytes"], before)
+
+        # GSF holds the temporaries of its signed distances, a list of thetas their stacked masks
+        for theta in [0.1, [0.1], [0.0, 0.1, 0.5]]:
+            FastGeodis.reset_workspace_peak()
+            if len(shape) == 2:
+                FastGeodis.GSF2d(image, mask, theta, 1e10, 0.5, iterations)
+            else:
+                FastGeodis.GSF3d(image, mask, theta, [1.0, 1.0, 1.0], 1e10, 0.5, iterations)
+            gsf = FastGeodis.estimate_memory(
+                shape, channels, "GSF{}d".format(len(shape)), {"iter": iterations, "theta": theta}
+            )
+            self.assertEqual(FastGeodis.workspace_memory()["peak_bytes"] - before, gsf["raster"])
+            self.assertEqual(FastGeodis.workspace_memory()["current_bytes"], before)
+
+    def test_ill_estimate(self):
+        with self.assertRaises(ValueError):
+            FastGeodis.estimate_memory([64, 48], 1, "generalised_geodesic3d")
+        with self.assertRaises(ValueError):
+            FastGeodis.estimate_memory([64, 48], 1, "GSF2d", {"iterations": 2})
+        with self.assertRaises(ValueError):
+            FastGeodis.estimate_memory([64, 48], 1, "GSF2d", {"theta": []})
+        estimate = FastGeodis.estimate_memory([64, 48], 1, "generalised_geodesic2d", {"approx_factor": 2})
+        self.assertEqual(sorted(estimate), ["approx", "exact", "raster"])
+        self.assertLess(estimate["approx"], estimate["raster"])
+
+
+class TestTrace(unittest.TestCase):
+    def test_trace(self):
+        image = torch.rand([1, 1, 10, 12, 14], dtype=torch.float32)
+        mask = torch.ones([1, 1, 10, 12, 14], dtype=torch.float32)
+        mask[0, 0, 5, 6, 7] = 0
+        expected = FastGeodis.GSF3d(image, mask, 0.1, [1.0, 1.0, 1.0], 1e10, 0.5, 2)
+
+        with tempfile.TemporaryDirectory() as directory:
+            path = os.path.join(directory, "trace.json")
+            with FastGeodis.trace(path):
+                output = FastGeodis.GSF3d(image, mask, 0.1, [1.0, 1.0, 1.0], 1e10, 0.5, 2)
+            with open(path) as f:
+                events = json.load(f)["traceEvents"]
+        np.testing.assert_allclose(output.numpy(), expected.numpy())
+
+        names = [e["name"] for e in events]
+        # six distance transforms of two iterations with three passes of two sweeps each
+        self.assertEqual(names.count("pass depth"), 12)
+        self.assertEqual(names.count("forward sweep"), 36)
+        self.assertEqual(names.count("backward sweep"), 36)
+        self.assertEqual(names.count("threshold"), 1)
+        self.assertIn("allocate", names)
+        self.assertIn("transpose", names)
+        for e in events:
+            self.assertEqual(e["ph"], "X")
+            self.assertGreaterEqual(e["dur"], 0)
+
+        # spans of calls after the trace has stopped are not recorded, a new trace starts empty
+        FastGeodis.generalised_geodesic3d(image, mask, [1.0, 1.0, 1.0], 1e10, 0.5, 2)
+        FastGeodis.start_trace()
+        self.assertEqual(FastGeodis.stop_trace()["traceEvents"], [])
+
+
+class TestGeodesicStats(unittest.TestCase):
+    def test_stats(self):
+        image = torch.rand([1, 1, 64, 48], dtype=torch.float32)
+        mask = torch.ones([1, 1, 64, 48], dtype=torch.float32)
+        mask[0, 0, 10, 20] = 0
+        expected = FastGeodis.generalised_geodesic2d(image, mask, 1e10, 0.7, 6)
+
+        distance, stats = FastGeodis.generalised_geodesic2d(image, mask, 1e10, 0.7, 6, return_stats=True)
+        np.testing.assert_array_equal(distance.numpy(), expected.numpy())
+        self.assertEqual(len(stats["pass_ms"]), 6)
+        self.assertEqual(len(stats["pass_improved"][0]), 2)
+        self.assertEqual(len(stats["iteration_ms"]), 6)
+        # the first pass improves most pixels and later iterations converge
+        self.assertGreater(stats["pass_improved"][0][0], stats["pass_improved"][-1][-1])
+        self.assertGreater(stats["bytes_allocated"], 0)
+        self.assertGreaterEqual(stats["threads"], 1)
+
+        image3d = torch.rand([1, 1, 10, 12, 14], dtype=torch.float32)
+        mask3d = torch.ones([1, 1, 10, 12, 14], dtype=torch.float32)
+        mask3d[0, 0, 5, 6, 7] = 0
+        _, stats = FastGeodis.generalised_geodesic3d(image3d, mask3d, [1.0, 1.0, 1.0], 1e10, 0.5, 2, return_stats=True)
+        _, stats_clip = FastGeodis.generalised_geodesic3d(image3d, mask3d, [1.0, 1.0, 1.0], 1e10, 0.5, 2, clip=5.0, return_stats=True)
+        self.assertEqual(len(stats_clip["pass_improved"]), 2)
+        # the final pass with a fused output transform is counted as well
+        self.assertEqual(stats_clip["pass_improved"], stats["pass_improved"])
+
+    def test_ill_stats(self):
+        image = torch.rand([1, 1, 16, 16], dtype=torch.float32)
+        mask = torch.ones([1, 1, 16, 16], dtype=torch.float32)
+        with self.assertRaises(ValueError):
+            FastGeodis.generalised_geodesic2d(image, mask, 1e10, 0.7, return_stats=True, approx_factor=2)
+
+
+class TestGeodesicDecomposed(unittest.TestCase):
+    @parameterized.expand([(1, 1), (2, 1), (3, 2)])
+    def test_matches_exact(self, num_workers, num_channels):
+        image = torch.rand([1, num_channels, 23, 17, 19], dtype=torch.float32)
+        mask = torch.ones([1, 1, 23, 17, 19], dtype=torch.float32)
+        mask[0, 0, 3, 5, 7] = 0
+        mask[0, 0, 20, 2, 15] = 0
+        spacing = [1.5, 1.0, 0.7]
+
+        exact = FastGeodis.generalised_geodesic_exact3d(image, mask, spacing, 1e10, 0.6)
+        distance = FastGeodis.generalised_geodesic3d_decomposed(
+            image, mask, spacing, 1e10, 0.6, num_workers=num_workers, num_threads=1
+        )
+        np.testing.assert_allclose(distance.numpy(), exact.numpy(), rtol=1e-5, atol=1e-5)
+
+    def test_relax_in_place(self):
+        image = torch.rand([1, 1, 8, 9, 9], dtype=torch.float32)
+        mask = torch.ones([1, 1, 8, 9, 9], dtype=torch.float32)
+        mask[0, 0, 4, 4, 4] = 0
+        distance = 1e10 * mask
+
+        # repeated passes reach the fixed point, which is the exact distance
+        for _ in range(100):
+            if FastGeodis.FastGeodisCpp.generalised_geodesic_relax3d(image, distance, [1.0, 1.0, 1.0], 0.5, 0.5, 1) == 0:
+                break
+        exact = FastGeodis.generalised_geodesic_exact3d(image, mask, [1.0, 1.0, 1.0], 1e10, 0.5)
+        np.testing.assert_allclose(distance.numpy(), exact.numpy(), rtol=1e-5, atol=1e-5)
+
+        with self.assertRaises(ValueError):
+            FastGeodis.FastGeodisCpp.generalised_geodesic_relax3d(image, distance.transpose(3, 4), [1.0, 1.0, 1.0], 0.5, 0.5, 1)
+
+
+class TestGeodesicSuperpixel(unittest.TestCase):
+    @parameterized.expand([(2, 128, 8, 0.1), (2, 128, 16, 0.1), (3, 32, 4, 0.2)])
+    def test_close_to_exact(self, num_dims, base_dim, superpixel_size, tolerance):
+        image_shape = get_simple_shape(base_dim=base_dim, num_dims=num_dims)
+        # two flat regions with mild noise
+        image = 0.05 * torch.rand(image_shape, dtype=torch.float32)
+        image[..., base_dim // 2 :] += 1.0
+        mask = torch.ones(image_shape, dtype=torch.float32)
+        seed = (0, 0) + (base_dim // 3,) * num_dims
+        mask[seed] = 0
+
+        if num_dims == 2:
+            exact = FastGeodis.generalised_geodesic_exact2d(image, mask, 1e10, 0.5)
+            distance = FastGeodis.generalised_geodesic_superpixel2d(image, mask, 1e10, 0.5, superpixel_size)
+        else:
+            spacing = [2.0, 1.0, 1.0]
+            exact = FastGeodis.generalised_geodesic_exact3d(image, mask, spacing, 1e10, 0.5)
+            distance = FastGeodis.generalised_geodesic_superpixel3d(image, mask, spacing, 1e10, 0.5, superpixel_size)
+
+        self.assertEqual(distance.shape, mask.shape)
+        self.assertEqual(distance[seed].item(), 0.0)
+        relative_error = torch.abs(distance - exact).mean() / exact.mean()
+        self.assertLess(relative_error.item(), tolerance)
+
+    def test_ill_args(self):
+        image = torch.rand([1, 1, 32, 32], dtype=torch.float32)
+        mask = torch.ones([1, 1, 32, 32], dtype=torch.float32)
+        mask[0, 0, 0, 0] = 0
+
+        with self.assertRaises(ValueError):
+            FastGeodis.generalised_geodesic_superpixel2d(image, mask, 1e10, 0.5, superpixel_size=0)
+
+        with self.assertRaises(ValueError):
+            FastGeodis.generalised_geodesic_superpixel2d(image, mask, 1e10, 0.5, compactness=0.0)
+
+
+class TestClickGuidance(unittest.TestCase):
+    @parameterized.expand([(2, 32), (3, 16)])
+    def test_matches_clicks(self, num_dims, base_dim):
+        batch = 3
+        image_shape = get_simple_shape(base_dim=base_dim, num_dims=num_dims)
+        image = torch.rand([batch, 2] + image_shape[2:], dtype=torch.float32)
+        labels = torch.zeros([batch, 1] + image_shape[2:], dtype=torch.float32)
+        labels[(slice(None), 0) + (slice(base_dim // 4, base_dim // 2),) * num_dims] = 1
+
+        if num_dims == 2:
+            guidance_func = FastGeodis.simulate_click_guidance2d
+            geodis_func = partial(FastGeodis.generalised_geodesic2d, iter=2)
+        else:
+            spacing = [1.0, 1.0, 1.0]
+            guidance_func = partial(FastGeodis.simulate_click_guidance3d, spacing=spacing, iter=4)
+            geodis_func = partial(FastGeodis.generalised_geodesic3d, spacing=spacing, iter=4)
+
+        guidance, clicks = guidance_func(image, labels, 3, 2, v=1e10, lamb=0.5, seed=5)
+        self.assertEqual(guidance.shape, (batch, 2) + tuple(image_shape[2:]))
+        self.assertEqual(clicks.shape, (batch, 5, num_dims))
+
+        # same seed gives the same clicks
+        _, clicks_again = guidance_func(image, labels, 3, 2, v=1e10, lamb=0.5, seed=5)
+        self.assertTrue(torch.equal(clicks, clicks_again))
+
+        for b in range(batch):
+            for channel, rows, label in [(0, slice(0, 3), 1), (1, slice(3, 5), 0)]:
+                mask = torch.ones(image_shape, dtype=torch.float32)
+                for click in clicks[b, rows]:
+                    self.assertEqual(labels[(b, 0) + tuple(click)].item(), label)
+                    mask[(0, 0) + tuple(click)] = 0
+                expected = geodis_func(image[b : b + 1], mask, v=1e10, lamb=0.5)
+                np.testing.assert_allclose(
+                    guidance[b : b + 1, channel : channel + 1].numpy(), expected.numpy(), rtol=1e-5
+                )
+
+    def test_ill_labels(self):
+        image = torch.rand([2, 1, 32, 32], dtype=torch.float32)
+
+        with self.assertRaises(ValueError):
+            FastGeodis.simulate_click_guidance2d(image, torch.zeros([1, 1, 32, 32]), 1, 1, 1e10, 1.0)
+
+        with self.assertRaises(ValueError):
+            FastGeodis.simulate_click_guidance2d(image, torch.zeros([2, 1, 32, 32]), -1, 1, 1e10, 1.0)
+
+class TestGeodesicStream3d(unittest.TestCase):
+    @parameterized.expand([(16,), (64,)])
+    def test_zeros_input(self, base_dim):
+        stream = FastGeodis.GeodesicStream3d([1.0, 1.0, 1.0], 1e10, 1.0)
+        slice_shape = get_simple_shape(base_dim=base_dim, num_dims=2)
+        for _ in range(4):
+            image = torch.zeros(slice_shape, dtype=torch.float32)
+            mask = torch.zeros(slice_shape, dtype=torch.float32)
+            slice_dist = stream.append_slice(image, mask)
+            self.assertEqual(list(slice_dist.shape), slice_shape)
+
+        self.assertEqual(stream.depth, 4)
+        self.assertEqual(list(stream.distance.shape), [1, 1, 4, base_dim, base_dim])
+        np.testing.assert_allclose(
+            np.zeros([1, 1, 4, base_dim, base_dim], dtype=np.float32),
+            stream.distance.numpy(),
+        )
+
+    @parameterized.expand([(16,), (64,)])
+    def test_front_propagation(self, base_dim):
+        depth = 8
+        spacing = [2.0, 1.0, 1.0]
+        stream = FastGeodis.GeodesicStream3d(spacing, 1e10, 0.0)
+        slice_shape = get_simple_shape(base_dim=base_dim, num_dims=2)
+        for z in range(depth):
+            image = torch.rand(slice_shape, dtype=torch.float32)
+            mask = torch.zeros(slice_shape) if z == 0 else torch.ones(slice_shape)
+            slice_dist = stream.append_slice(image, mask)
+
+            # euclidean distance to the first slice, available as soon as slice arrives
+            np.testing.assert_allclose(
+                slice_dist.numpy(), np.full(slice_shape, z * spacing[0], dtype=np.float32)
+            )
+            self.assertEqual(stream.repaired_slices, 0)
+
+    @parameterized.expand([(16,), (64,)])
+    def test_repair_previous_slices(self, base_dim):
+        depth = 8
+        spacing = [2.0, 1.0, 1.0]
+        stream = FastGeodis.GeodesicStream3d(spacing, 1e10, 0.0)
+        slice_shape = get_simple_shape(base_dim=base_dim, num_dims=2)
+        for z in range(depth):
+            image = torch.rand(slice_shape, dtype=torch.float32)
+            mask = torch.zeros(slice_shape) if z == depth - 1 else torch.ones(slice_shape)
+            stream.append_slice(image, mask)
+
+        # seed in last slice must be propagated back through the whole volume
+        self.assertEqual(stream.repaired_slices, depth - 1)
+        expected = np.arange(depth - 1, -1, -1, dtype=np.float32) * spacing[0]
+        np.testing.assert_allclose(
+            stream.distance.numpy()[0, 0, :, 0, 0], expected
+        )
+
+    def test_ill_shape(self):
+        stream = FastGeodis.GeodesicStream3d([1.0, 1.0, 1.0], 1e10, 1.0)
+        stream.append_slice(torch.rand([1, 1, 16, 16]), torch.rand([1, 1, 16, 16]))
+
+        # appended slice must match the streamed volume
+        with self.assertRaises(ValueError):
+            stream.append_slice(torch.rand([1, 1, 16, 12]), torch.rand([1, 1, 16, 12]))
+
+        # rejected slices must leave the stream usable
+        with self.assertRaises(ValueError):
+            stream.append_slice(torch.rand([1, 1, 16, 16]).double(), torch.rand([1, 1, 16, 16]))
+        with self.assertRaises(ValueError):
+            stream.append_slice(torch.rand([1, 1, 16, 16]), torch.rand([1, 1, 16, 16]).half())
+        self.assertEqual(stream.depth, 1)
+        stream.append_slice(torch.rand([1, 1, 16, 16]), torch.rand([1, 1, 16, 16]))
+        self.assertEqual(stream.depth, 2)
+
+        # spacing must be 3D
+        with self.assertRaises(ValueError):
+            FastGeodis.GeodesicStream3d([1.0, 1.0], 1e10, 1.0)
+
+
+class TestGeodesicVideo2d(unittest.TestCase):
+    @parameterized.expand([(32,), (128,)])
+    def test_first_frame(self, base_dim):
+        image_shape = get_simple_shape(base_dim=base_dim, num_dims=2)
+        image = torch.rand(image_shape, dtype=torch.float32)
+        mask = torch.ones(image_shape, dtype=torch.float32)
+        mask[..., base_dim // 2, base_dim // 2] = 0
+
+        video = FastGeodis.GeodesicVideo2d(1e10, 1.0, max_iter=8)
+        video_dist = video.process_frame(image, mask)
+
+        # same raster scanning as generalised_geodesic2d from a cold start
+        geodesic_dist = FastGeodis.generalised_geodesic2d(image, mask, 1e10, 1.0, 8)
+        np.testing.assert_allclose(video_dist.numpy(), geodesic_dist.numpy(), rtol=1e-5)
+
+    @parameterized.expand([(32,), (128,)])
+    def test_static_frames(self, base_dim):
+        image_shape = get_simple_shape(base_dim=base_dim, num_dims=2)
+        image = torch.rand(image_shape, dtype=torch.float32)
+        mask = torch.ones(image_shape, dtype=torch.float32)
+        mask[..., 0, 0] = 0
+
+        video = FastGeodis.GeodesicVideo2d(1e10, 1.0)
+        first_dist = video.process_frame(image, mask)
+        second_dist = video.process_frame(image.clone(), mask.clone())
+
+        # nothing to repair for an unchanged frame
+        self.assertEqual(video.repaired_pixels, 0)
+        self.assertEqual(video.iterations, 0)
+        np.testing.assert_allclose(first_dist.numpy(), second_dist.numpy())
+
+    @parameterized.expand([(32,), (128,)])
+    def test_changed_frame(self, base_dim):
+        image_shape = get_simple_shape(base_dim=base_dim, num_dims=2)
+        image = torch.rand(image_shape, dtype=torch.float32)
+        mask = torch.ones(image_shape, dtype=torch.float32)
+        mask[..., base_dim // 4, base_dim // 4] = 0
+
+        video = FastGeodis.GeodesicVideo2d(1e10, 1.0, max_iter=64)
+        video.process_frame(image, mask)
+
+        # change a patch away from the seed and add another seed
+        next_image = image.clone()
+        next_image[..., -base_dim // 4 :, -base_dim // 4 :] = torch.rand(
+            [1, 1, base_dim // 4, base_dim // 4]
+        )
+        next_mask = mask.clone()
+        next_mask[..., base_dim // 2, base_dim // 4] = 0
+        video_dist = video.process_frame(next_image, next_mask)
+        self.assertLess(video.repaired_pixels, base_dim * base_dim)
+
+        # warm-started result matches a cold start on the same frame
+        cold_video = FastGeodis.GeodesicVideo2d(1e10, 1.0, max_iter=64)
+        cold_dist = cold_video.process_frame(next_image, next_mask)
+        np.testing.assert_allclose(video_dist.numpy(), cold_dist.numpy(), rtol=1e-5)
+
+
+class TestGeodesicKNN(unittest.TestCase):
+    @parameterized.expand([(2, 32), (2, 64), (3, 16)])
+    def test_matches_single_label_transforms(self, num_dims, base_dim):
+        image_shape = get_simple_shape(base_dim=base_dim, num_dims=num_dims)
+        image = torch.rand(image_shape, dtype=torch.float32)
+        labels = -torch.ones(image_shape, dtype=torch.int64)
+        num_labels = 4
+        seeds = torch.randperm(labels.numel())[:num_labels]
+        labels.view(-1)[seeds] = torch.arange(num_labels)
+
+        iterations = 2
+        spacing = [1.0, 1.0, 1.0]
+        if num_dims == 2:
+            knn_dist, knn_label = FastGeodis.generalised_geodesic_knn2d(
+                image, labels, num_labels, 1.0, iterations
+            )
+        else:
+            knn_dist, knn_label = FastGeodis.generalised_geodesic_knn3d(
+                image, labels, num_labels, spacing, 1.0, iterations
+            )
+        self.assertEqual(list(knn_dist.shape), [1, num_labels] + image_shape[2:])
+        self.assertEqual(knn_label.dtype, torch.int64)
+
+        # distances are sorted and each label appears once
+        self.assertTrue(torch.all(knn_dist[:, 1:] >= knn_dist[:, :-1]))
+        sorted_labels, _ = torch.sort(knn_label, dim=1)
+        np.testing.assert_array_equal(
+            sorted_labels.numpy(),
+            np.broadcast_to(
+                np.arange(num_labels).reshape([1, num_labels] + [1] * num_dims),
+                sorted_labels.shape,
+            ),
+        )
+
+        # nearest label matches the minimum over per-label transforms
+        geodis_func = get_fastgeodis_func(num_dims=num_dims, spacing=spacing)
+        per_label = torch.cat(
+            [
+                geodis_func(image, (labels != label).float(), 1e10, 1.0, iterations)
+                for label in range(num_labels)
+            ],
+            dim=1,
+        )
+        np.testing.assert_allclose(
+            knn_dist[:, 0].numpy(), per_label.min(dim=1)[0].numpy(), rtol=1e-4
+        )
+
+    def test_fewer_labels_than_k(self):
+        image = torch.rand([1, 1, 32, 32], dtype=torch.float32)
+        labels = -torch.ones([1, 1, 32, 32], dtype=torch.int64)
+        labels[0, 0, 4, 4] = 7
+
+        knn_dist, knn_label = FastGeodis.generalised_geodesic_knn2d(image, labels, 3, 1.0)
+        self.assertTrue(torch.all(knn_label[:, 0] == 7))
+        self.assertTrue(torch.all(knn_label[:, 1:] == -1))
+        self.assertTrue(torch.all(torch.isinf(knn_dist[:, 1:])))
+
+    def test_ill_k(self):
+        image = torch.rand([1, 1, 32, 32], dtype=torch.float32)
+        labels = torch.zeros([1, 1, 32, 32], dtype=torch.int64)
+        with self.assertRaises(ValueError):
+            FastGeodis.generalised_geodesic_knn2d(image, labels, 0, 1.0)
+
+
+class TestGeodesicParent(unittest.TestCase):
+    @parameterized.expand(
+        [(2, 32, "raster"), (2, 64, "exact"), (3, 16, "raster"), (3, 16, "exact")]
+    )
+    def test_backtrack_to_seed(self, num_dims, base_dim, engine):
+        image_shape = get_simple_shape(base_dim=base_dim, num_dims=num_dims)
+        image = torch.rand(image_shape, dtype=torch.float32)
+        mask = torch.ones(image_shape, dtype=torch.float32)
+        seed = (0, 0) + (base_dim // 2,) * num_dims
+        mask[seed] = 0
+
+        spacing = [1.0, 1.0, 1.0]
+        if engine == "raster" and num_dims == 2:
+            distance, parent = FastGeodis.generalised_geodesic2d(
+                image, mask, 1e10, 1.0, 2, return_parent=True
+            )
+            expected = FastGeodis.generalised_geodesic2d(image, mask, 1e10, 1.0, 2)
+        elif engine == "raster":
+            distance, parent = FastGeodis.generalised_geodesic3d(
+                image, mask, spacing, 1e10, 1.0, 4, return_parent=True
+            )
+            expected = FastGeodis.generalised_geodesic3d(image, mask, spacing, 1e10, 1.0, 4)
+        elif num_dims == 2:
+            distance, parent = FastGeodis.generalised_geodesic_exact2d(
+                image, mask, 1e10, 1.0, return_parent=True
+            )
+            expected = distance
+        else:
+            distance, parent = FastGeodis.generalised_geodesic_exact3d(
+                image, mask, spacing, 1e10, 1.0, return_parent=True
+            )
+            expected = distance
+        self.assertEqual(parent.dtype, torch.uint8)
+        np.testing.assert_allclose(distance.numpy(), expected.numpy(), rtol=1e-5)
+
+        points = torch.tensor([[0] * num_dims, [base_dim - 1] * num_dims])
+        paths = FastGeodis.geodesic_backtrack(parent, points)
+        self.assertEqual(len(paths), 2)
+        for point, path in zip(points, paths):
+            np.testing.assert_array_equal(path[0].numpy(), point.numpy())
+            np.testing.assert_array_equal(path[-1].numpy(), np.array(seed[2:]))
+
+            # path only takes unit steps with strictly decreasing distance
+            steps = (path[1:] - path[:-1]).abs()
+            self.assertTrue(torch.all(steps <= 1))
+            path_dist = distance[(0, 0) + tuple(path.t())]
+            self.assertTrue(torch.all(path_dist[1:] < path_dist[:-1]))
+
+            if engine == "exact":
+                # cost along the path adds up to the exact distance
+                path_image = image[(0, 0) + tuple(path.t())]
+                cost = (path_image[1:] - path_image[:-1]).abs().sum()
+                self.assertAlmostEqual(cost.item(), path_dist[0].item(), places=3)
+
+    @parameterized.expand([(2, 32), (3, 16)])
+    def test_exact_lower_bound(self, num_dims, base_dim):
+        image_shape = get_simple_shape(base_dim=base_dim, num_dims=num_dims)
+        image = torch.rand(image_shape, dtype=torch.float32)
+        mask = torch.ones(image_shape, dtype=torch.float32)
+        mask[(0, 0) + (0,) * num_dims] = 0
+
+        spacing = [1.0, 1.0, 1.0]
+        if num_dims == 2:
+            exact = FastGeodis.generalised_geodesic_exact2d(image, mask, 1e10, 0.5)
+            raster = FastGeodis.generalised_geodesic2d(image, mask, 1e10, 0.5, 2)
+        else:
+            exact = FastGeodis.generalised_geodesic_exact3d(image, mask, spacing, 1e10, 0.5)
+            raster = FastGeodis.generalised_geodesic3d(image, mask, spacing, 1e10, 0.5, 4)
+
+        # raster scanning can only over-estimate the exact distance
+        self.assertTrue(torch.all(exact <= raster + 1e-4))
+
+    def test_ill_points(self):
+        image = torch.rand([1, 1, 32, 32], dtype=torch.float32)
+        mask = torch.ones([1, 1, 32, 32], dtype=torch.float32)
+        mask[0, 0, 0, 0] = 0
+        _, parent = FastGeodis.generalised_geodesic_exact2d(
+            image, mask, 1e10, 1.0, return_parent=True
+        )
+
+        with self.assertRaises(ValueError):
+            FastGeodis.geodesic_backtrack(parent, torch.tensor([[0, 32]]))
+
+        with self.assertRaises(ValueError):
+            FastGeodis.geodesic_backtrack(parent, torch.tensor([[0, 0, 0]]))
+
+
+
+class TestGeodesicQuery(unittest.TestCase):
+    @parameterized.expand([(2, 64, 1, 1.0), (2, 64, 3, 0.5), (3, 16, 1, 0.5), (3, 16, 3, 1.0)])
+    def test_matches_exact(self, num_dims, base_dim, num_channels, lamb):
+        image_shape = get_simple_shape(base_dim=base_dim, num_dims=num_dims)
+        image = torch.rand([1, num_channels] + image_shape[2:], dtype=torch.float32)
+        mask = torch.ones(image_shape, dtype=torch.float32)
+        seed = (0, 0) + (base_dim // 3,) * num_dims
+        mask[seed] = 0
+
+        points = torch.tensor([[0] * num_dims, [base_dim - 1] * num_dims, list(seed[2:])])
+        spacing = [1.0, 2.0, 0.5]
+        if num_dims == 2:
+            exact = FastGeodis.generalised_geodesic_exact2d(image, mask, 1e10, lamb)
+            distance, paths = FastGeodis.geodesic_query2d(
+                image, mask, points, 1e10, lamb, return_path=True
+            )
+        else:
+            exact = FastGeodis.generalised_geodesic_exact3d(image, mask, spacing, 1e10, lamb)
+            distance, paths = FastGeodis.geodesic_query3d(
+                image, mask, points, spacing, 1e10, lamb, return_path=True
+            )
+
+        expected = exact[(0, 0) + tuple(points.t())]
+        np.testing.assert_allclose(distance.numpy(), expected.numpy(), rtol=1e-4, atol=1e-5)
+        self.assertEqual(distance[-1].item(), 0.0)
+        for point, path in zip(points, paths):
+            np.testing.assert_array_equal(path[0].numpy(), point.numpy())
+            np.testing.assert_array_equal(path[-1].numpy(), np.array(seed[2:]))
+
+    def test_ill_points(self):
+        image = torch.rand([1, 1, 32, 32], dtype=torch.float32)
+        mask = torch.ones([1, 1, 32, 32], dtype=torch.float32)
+        mask[0, 0, 0, 0] = 0
+
+        with self.assertRaises(ValueError):
+            FastGeodis.geodesic_query2d(image, mask, torch.tensor([[-1, 0]]), 1e10, 1.0)
+
+        with self.assertRaises(ValueError):
+            FastGeodis.geodesic_query2d(image, mask, torch.tensor([[0, 0, 0]]), 1e10, 1.0)
+
+
+class TestGeodesicAutograd(unittest.TestCase):
+    @parameterized.expand([(2, 24), (3, 10)])
+    def test_gradients(self, num_dims, base_dim):
+        image_shape = get_simple_shape(base_dim=base_dim, num_dims=num_dims)
+        image = torch.rand([1, 2] + image_shape[2:], dtype=torch.float32)
+        mask = torch.ones(image_shape, dtype=torch.float32)
+        mask[(0, 0) + (base_dim // 3,) * num_dims] = 0
+        mask[(0, 0) + (base_dim - 2,) * num_dims] = 0.2
+
+        v = 5.0
+        spacing = [1.5, 1.0, 1.0]
+
+        def distance_sum(image, mask, lamb):
+            if num_dims == 2:
+                return FastGeodis.differentiable_generalised_geodesic2d(
+                    image, mask, v, lamb, 8
+                ).sum(dtype=torch.float64)
+            return FastGeodis.differentiable_generalised_geodesic3d(
+                image, mask, spacing, v, lamb, 8
+            ).sum(dtype=torch.float64)
+
+        image.requires_grad_(True)
+        mask.requires_grad_(True)
+        lamb = torch.tensor(0.6, requires_grad=True)
+        distance_sum(image, mask, lamb).backward()
+
+        # every gradient of a distance ends at a seed, weighted by v
+        self.assertAlmostEqual(mask.grad.sum().item() / (v * mask.numel()), 1.0, places=4)
+
+        # central differences, the paths stay fixed for small changes
+        with torch.no_grad():
+            eps = 1e-3
+            fd_lamb = (
+                distance_sum(image, mask, 0.6 + eps) - distance_sum(image, mask, 0.6 - eps)
+            ) / (2 * eps)
+            self.assertAlmostEqual(lamb.grad.item() / fd_lamb.item(), 1.0, places=2)
+
+            index = (0, 1) + (base_dim // 2,) * num_dims
+            image_p = image.clone()
+            image_p[index] += eps
+            image_m = image.clone()
+            image_m[index] -= eps
+            fd_image = (distance_sum(image_p, mask, 0.6) - distance_sum(image_m, mask, 0.6)) / (2 * eps)
+            self.assertAlmostEqual(
+                image.grad[index].item(), fd_image.item(), delta=0.05 * abs(fd_image.item()) + 0.02
+            )
 
 if __name__ == "__main__":
     unittest.main()